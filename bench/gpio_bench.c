@@ -0,0 +1,181 @@
+/* Measures the per-call cost of the libopenbmc_intf GPIO path against a
+ * mock sysfs tree on tmpfs: ops/sec and p50/p99 latency for gpio_read,
+ * gpio_write, gpio_clock_cycle and an FSI putcfam frame.
+ *
+ * usage: gpio_bench [-n iterations] [-r root]
+ *
+ * Without -r a temporary tree is made under /dev/shm (or /tmp) and removed
+ * afterwards. The numbers are syscall costs only; real sysfs adds the
+ * driver's own work on top.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <gpio.h>
+#include "fsi.h"
+#include "mock_tree.h"
+
+#define BENCH_CLK   0
+#define BENCH_DATA  1
+#define BENCH_INPUT 2
+
+typedef int (*BenchOp)(void*, size_t);
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+cmp_u64(const void* a, const void* b)
+{
+	uint64_t x = *(const uint64_t*)a;
+	uint64_t y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static int
+run(const char* name, BenchOp op, void* arg, size_t iterations)
+{
+	uint64_t* samples = calloc(iterations, sizeof(uint64_t));
+	uint64_t total = 0;
+	size_t i;
+
+	if (samples == NULL) {
+		return -1;
+	}
+	for (i = 0; i < iterations; i++) {
+		uint64_t start = now_ns();
+		if (op(arg, i) != GPIO_OK) {
+			fprintf(stderr, "ERROR gpio_bench: %s failed\n", name);
+			free(samples);
+			return -1;
+		}
+		samples[i] = now_ns() - start;
+		total += samples[i];
+	}
+	qsort(samples, iterations, sizeof(uint64_t), cmp_u64);
+	printf("%-18s %12.0f ops/s   p50 %9.2f us   p99 %9.2f us\n", name,
+			iterations * 1e9 / (total ? total : 1),
+			samples[iterations / 2] / 1e3,
+			samples[iterations * 99 / 100] / 1e3);
+	free(samples);
+	return 0;
+}
+
+static int
+op_read(void* arg, size_t i)
+{
+	uint8_t value;
+	return gpio_read(arg, &value);
+}
+
+static int
+op_write(void* arg, size_t i)
+{
+	return gpio_write(arg, i & 1);
+}
+
+static int
+op_clock_cycle(void* arg, size_t i)
+{
+	return gpio_clock_cycle(arg, 1);
+}
+
+static int
+op_fsi_bitbang(void* arg, size_t i)
+{
+	const FsiPattern* frame = fsi_frame(0x281C, false, 0x30000000);
+	if (frame == NULL) {
+		return GPIO_ERROR;
+	}
+	return fsi_send(arg, frame);
+}
+
+static int
+bench_line(GPIO* gpio, const char* root, unsigned int num,
+		const char* direction)
+{
+	gpio->dev = g_strdup_printf("%s%s", root, MOCK_GPIO_DIR);
+	gpio->num = num;
+	gpio->direction = (gchar*)direction;
+	if (mock_line_config(root, num, direction)) {
+		return GPIO_INIT_ERROR;
+	}
+	return gpio_open(gpio);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char tmp[64];
+	const char* root = NULL;
+	size_t iterations = 100000;
+	GPIO clk = (GPIO){ "BENCH_CLK" };
+	GPIO data = (GPIO){ "BENCH_DATA" };
+	GPIO input = (GPIO){ "BENCH_INPUT" };
+	FsiEngine fsi;
+	int rc = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+		switch (opt) {
+		case 'n': iterations = strtoul(optarg, NULL, 0); break;
+		case 'r': root = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-n iterations] [-r root]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (iterations < 100) {
+		iterations = 100;
+	}
+	if (root == NULL) {
+		strcpy(tmp, "/dev/shm/gpio_bench.XXXXXX");
+		if (mkdtemp(tmp) == NULL) {
+			strcpy(tmp, "/tmp/gpio_bench.XXXXXX");
+			if (mkdtemp(tmp) == NULL) {
+				perror("gpio_bench");
+				return 1;
+			}
+		}
+	}
+	if (mock_tree_create(root ? root : tmp, "bench", 0, 8)) {
+		perror("gpio_bench");
+		return 1;
+	}
+	gpio_set_root(root ? root : tmp);
+
+	do {
+		const char* r = root ? root : tmp;
+		rc = bench_line(&clk, r, BENCH_CLK, "out");
+		rc |= bench_line(&data, r, BENCH_DATA, "out");
+		rc |= bench_line(&input, r, BENCH_INPUT, "in");
+		if (rc != GPIO_OK) {
+			fprintf(stderr, "ERROR gpio_bench: mock setup (rc=%d)\n", rc);
+			break;
+		}
+		fsi_engine_init(&fsi, &clk, &data);
+
+		printf("gpio_bench: %zu iterations, %s backend, root %s\n",
+				iterations, fsi.mmio ? "mmio" : "sysfs", r);
+		rc = run("gpio_read", op_read, &input, iterations);
+		rc |= run("gpio_write", op_write, &data, iterations);
+		rc |= run("gpio_clock_cycle", op_clock_cycle, &clk, iterations);
+		rc |= run("fsi_bitbang", op_fsi_bitbang, &fsi, iterations / 100);
+		fsi_engine_close(&fsi);
+	} while(0);
+
+	gpio_close(&clk);
+	gpio_close(&data);
+	gpio_close(&input);
+	if (root == NULL) {
+		mock_tree_remove(tmp);
+	}
+	return rc ? 1 : 0;
+}
@@ -0,0 +1,106 @@
+/* Builds a mock /sys/class/gpio tree and plays scripted input transitions
+ * into it, so daemons run with OBMC_GPIO_ROOT=<root> can be exercised on a
+ * development machine.
+ *
+ * usage: gpio_mock [-b base] [-n ngpio] [-l label] ROOT [SCRIPT]
+ *
+ * Each SCRIPT line is "<delay ms> <gpio number> <0|1>"; the delay is from
+ * the previous line. '#' starts a comment. Lines watched with
+ * gpio_event_open, as in pwrbutton, rstbutton and hostcheckstop, fall
+ * back to polling on a mock tree, so transitions are seen within
+ * GPIO_EVENT_POLL_MS; power_control polls pgood at its own interval.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "mock_tree.h"
+
+static int
+play_script(const char* root, FILE* script)
+{
+	char line[256];
+	int lineno = 0;
+
+	while (fgets(line, sizeof(line), script) != NULL) {
+		unsigned long delay_ms;
+		unsigned int num;
+		unsigned int value;
+		char* comment = strchr(line, '#');
+
+		lineno++;
+		if (comment != NULL) {
+			*comment = '\0';
+		}
+		if (strspn(line, " \t\r\n") == strlen(line)) {
+			continue;
+		}
+		if (sscanf(line, "%lu %u %u", &delay_ms, &num, &value) != 3) {
+			fprintf(stderr, "ERROR gpio_mock: bad script line %d\n", lineno);
+			return -1;
+		}
+		struct timespec ts = {
+			.tv_sec = delay_ms / 1000,
+			.tv_nsec = (delay_ms % 1000) * 1000000,
+		};
+		nanosleep(&ts, NULL);
+		if (mock_line_set(root, num, value ? 1 : 0)) {
+			fprintf(stderr, "ERROR gpio_mock: gpio%u: no such line\n", num);
+			return -1;
+		}
+		printf("gpio%u = %u\n", num, value ? 1 : 0);
+		fflush(stdout);
+	}
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned int base = 0;
+	unsigned int ngpio = 1024;
+	const char* label = "mock";
+	const char* root;
+	FILE* script;
+	int opt;
+	int rc;
+
+	while ((opt = getopt(argc, argv, "b:n:l:")) != -1) {
+		switch (opt) {
+		case 'b': base = strtoul(optarg, NULL, 0); break;
+		case 'n': ngpio = strtoul(optarg, NULL, 0); break;
+		case 'l': label = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-b base] [-n ngpio] [-l label] ROOT [SCRIPT]\n",
+					argv[0]);
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "usage: %s [-b base] [-n ngpio] [-l label] ROOT [SCRIPT]\n",
+				argv[0]);
+		return 1;
+	}
+	root = argv[optind];
+	if (mock_tree_create(root, label, base, ngpio)) {
+		perror("gpio_mock");
+		return 1;
+	}
+	printf("gpio_mock: %u lines from %u under %s%s\n", ngpio, base, root,
+			MOCK_GPIO_DIR);
+	if (optind + 1 >= argc) {
+		return 0;
+	}
+	script = strcmp(argv[optind + 1], "-") == 0 ?
+		stdin : fopen(argv[optind + 1], "r");
+	if (script == NULL) {
+		perror("gpio_mock");
+		return 1;
+	}
+	rc = play_script(root, script);
+	if (script != stdin) {
+		fclose(script);
+	}
+	return rc ? 1 : 0;
+}
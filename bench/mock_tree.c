@@ -0,0 +1,139 @@
+#define _XOPEN_SOURCE 500
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "mock_tree.h"
+
+static int
+mkdir_p(const char* path)
+{
+	char buf[512];
+	char* p;
+
+	snprintf(buf, sizeof(buf), "%s", path);
+	for (p = buf + 1; *p; p++) {
+		if (*p == '/') {
+			*p = '\0';
+			if (mkdir(buf, 0755) && errno != EEXIST) {
+				return -1;
+			}
+			*p = '/';
+		}
+	}
+	if (mkdir(buf, 0755) && errno != EEXIST) {
+		return -1;
+	}
+	return 0;
+}
+
+static int
+write_file(const char* path, const char* value)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+	if (write(fd, value, strlen(value)) != strlen(value)) {
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+int
+mock_tree_create(const char* root, const char* label, unsigned int base,
+		unsigned int ngpio)
+{
+	char path[512];
+	char value[32];
+	unsigned int i;
+
+	snprintf(path, sizeof(path), "%s%s/gpiochip%u", root, MOCK_GPIO_DIR, base);
+	if (mkdir_p(path)) {
+		return -1;
+	}
+	snprintf(path, sizeof(path), "%s%s/export", root, MOCK_GPIO_DIR);
+	write_file(path, "");
+	snprintf(path, sizeof(path), "%s%s/unexport", root, MOCK_GPIO_DIR);
+	write_file(path, "");
+
+	snprintf(path, sizeof(path), "%s%s/gpiochip%u/base", root, MOCK_GPIO_DIR, base);
+	snprintf(value, sizeof(value), "%u\n", base);
+	write_file(path, value);
+	snprintf(path, sizeof(path), "%s%s/gpiochip%u/ngpio", root, MOCK_GPIO_DIR, base);
+	snprintf(value, sizeof(value), "%u\n", ngpio);
+	write_file(path, value);
+	snprintf(path, sizeof(path), "%s%s/gpiochip%u/label", root, MOCK_GPIO_DIR, base);
+	snprintf(value, sizeof(value), "%s\n", label);
+	write_file(path, value);
+
+	for (i = base; i < base + ngpio; i++) {
+		snprintf(path, sizeof(path), "%s%s/gpio%u", root, MOCK_GPIO_DIR, i);
+		if (mkdir_p(path)) {
+			return -1;
+		}
+		if (mock_line_config(root, i, "in") || mock_line_set(root, i, 0)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+remove_entry(const char* path, const struct stat* st, int flag,
+		struct FTW* ftw)
+{
+	return remove(path);
+}
+
+void
+mock_tree_remove(const char* root)
+{
+	nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+/* Sets the direction and edge files the way the kernel would report them */
+int
+mock_line_config(const char* root, unsigned int num, const char* direction)
+{
+	char path[512];
+	const char* edge = "none";
+
+	if (strcmp(direction, "out") != 0 && strcmp(direction, "in") != 0) {
+		edge = direction;
+		direction = "in";
+	}
+	snprintf(path, sizeof(path), "%s%s/gpio%u/direction", root, MOCK_GPIO_DIR, num);
+	if (write_file(path, direction)) {
+		return -1;
+	}
+	snprintf(path, sizeof(path), "%s%s/gpio%u/edge", root, MOCK_GPIO_DIR, num);
+	return write_file(path, edge);
+}
+
+int
+mock_line_set(const char* root, unsigned int num, uint8_t value)
+{
+	char path[512];
+
+	int fd;
+	int rc = 0;
+
+	/* Overwrite in place so a concurrent reader never sees an empty file */
+	snprintf(path, sizeof(path), "%s%s/gpio%u/value", root, MOCK_GPIO_DIR, num);
+	fd = open(path, O_WRONLY | O_CREAT, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+	if (pwrite(fd, value ? "1" : "0", 1, 0) != 1) {
+		rc = -1;
+	}
+	close(fd);
+	return rc;
+}
@@ -0,0 +1,16 @@
+#ifndef __BENCH_MOCK_TREE_H__
+#define __BENCH_MOCK_TREE_H__
+
+#include <stdint.h>
+
+/* A /sys/class/gpio lookalike of plain files under a root directory, for
+ * use with gpio_set_root() or OBMC_GPIO_ROOT. Every line of the chip is
+ * created up front, so export and unexport are no-ops. */
+#define MOCK_GPIO_DIR "/sys/class/gpio"
+
+int mock_tree_create(const char*, const char*, unsigned int, unsigned int);
+void mock_tree_remove(const char*);
+int mock_line_config(const char*, unsigned int, const char*);
+int mock_line_set(const char*, unsigned int, uint8_t);
+
+#endif
@@ -136,6 +136,12 @@ POWER_CONFIG = {
     ],
 }
 
+# LEDs driven together by /org/openbmc/control/led/groups/<name>.
+# Members are names under /sys/class/leds.
+LED_GROUP_CONFIG = {
+    'enclosure_identify' : [ 'identify', 'heartbeat' ],
+}
+
 # Miscellaneous non-poll sensor with system specific properties.
 # The sensor id is the same as those defined in ID_LOOKUP['SENSOR'].
 MISC_SENSORS = {
@@ -15,11 +15,17 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <limits.h>
 #include <errno.h>
 #include <string.h>
 #include <getopt.h>
+#include <unistd.h>
 #include <systemd/sd-bus.h>
+#include <systemd/sd-event.h>
+#include "fan_zone.h"
+#include "fan_tach.h"
+#include "fan_monitor.h"
 
 #define DBUS_MAX_NAME_LEN 256
 
@@ -27,24 +33,309 @@ const char *objectmapper_service_name =  "org.openbmc.ObjectMapper";
 const char *objectmapper_object_name  =  "/org/openbmc/ObjectMapper";
 const char *objectmapper_intf_name    =  "org.openbmc.ObjectMapper";
 
+#define FAN_ZONE_CONFIG "/etc/fanctl/zones.conf"
+#define FAN_OBJECT_ROOT "/org/openbmc/control/fans"
+#define FAN_MONITOR_INTERVAL_MS 5000
+#define FAN_MIN_RPM 500
+#define FAN_RPM_HYSTERESIS 100
+
+struct fan_info;
+
+/* One /org/openbmc/control/fans/fanN object */
 typedef struct {
+	struct fan_info *info;
+	int id;
+	/* PWM last written, -1 if never written by fanctl */
+	int speed;
+	int cooling_zone;
+	/* Set by setMax; the zone leaves the fan at full speed until
+	 * setCoolingZone or setSpeed releases it */
+	int max_hold;
+	int pwm_num;
+	char path[DBUS_MAX_NAME_LEN];
+	sd_bus_slot *slot;
+	fan_monitor_t monitor;
+} fan_t;
+
+typedef struct fan_info {
 	int fan_num;
 	int cpu_num;
 	int core_num;
 	int dimm_num;
 	sd_bus *bus;
+	sd_event *event;
 	char sensor_service[DBUS_MAX_NAME_LEN];
 	char inventory_service[DBUS_MAX_NAME_LEN];
+	const char *zone_config;
+	/* --default_zones: built-in zone 0 when there is no zone config */
+	int default_zones;
+	fan_zones_t zones;
+	fan_t *fans;
+	/* tach thresholds for fault detection, in RPM */
+	int min_rpm;
+	int rpm_hysteresis;
+	/* hwmon tach files, fan_num entries */
+	fan_tach_t *tachs;
+	/* tach map asked for, and received, from the system manager */
+	int tach_requested;
+	int tach_loaded;
+	uint64_t last_tick;
+	/* a control pass or monitor round is still waiting on its calls */
+	int control_busy;
+	int monitor_busy;
 } fan_info_t;
 
-/* Get an object's bus name from ObjectMapper */
+/*
+ * Object path to bus name cache. Filled with one GetSubTree at startup and
+ * on demand with GetObject; entries are dropped when their owner leaves
+ * the bus, when the object's interfaces change, or when a call to them
+ * fails, and are then looked up again on next use.
+ */
+#define MAPPER_CACHE_BUCKETS 128
+#define MAPPER_CACHE_ROOT "/org/openbmc"
+
+typedef struct mapper_entry {
+	struct mapper_entry *next;
+	char *path;
+	char *connection;
+} mapper_entry_t;
+
+static mapper_entry_t *mapper_cache[MAPPER_CACHE_BUCKETS];
+
+static unsigned int mapper_cache_hash(const char *path)
+{
+	unsigned int hash = 5381;
+
+	while (*path)
+		hash = hash * 33 + (unsigned char)*path++;
+	return hash % MAPPER_CACHE_BUCKETS;
+}
+
+static const char *mapper_cache_lookup(const char *obj_path)
+{
+	mapper_entry_t *entry;
+
+	for (entry = mapper_cache[mapper_cache_hash(obj_path)]; entry;
+			entry = entry->next) {
+		if (strcmp(entry->path, obj_path) == 0)
+			return entry->connection;
+	}
+	return NULL;
+}
+
+static void mapper_cache_insert(const char *obj_path, const char *connection)
+{
+	unsigned int bucket = mapper_cache_hash(obj_path);
+	mapper_entry_t *entry;
+
+	for (entry = mapper_cache[bucket]; entry; entry = entry->next) {
+		if (strcmp(entry->path, obj_path) == 0) {
+			char *dup = strdup(connection);
+			if (dup) {
+				free(entry->connection);
+				entry->connection = dup;
+			}
+			return;
+		}
+	}
+	entry = calloc(1, sizeof(*entry));
+	if (!entry)
+		return;
+	entry->path = strdup(obj_path);
+	entry->connection = strdup(connection);
+	if (!entry->path || !entry->connection) {
+		free(entry->path);
+		free(entry->connection);
+		free(entry);
+		return;
+	}
+	entry->next = mapper_cache[bucket];
+	mapper_cache[bucket] = entry;
+}
+
+/* Drop entries for a path, or for every path owned by a bus name.
+ * With both NULL the whole cache is flushed. */
+static void mapper_cache_remove(const char *obj_path, const char *connection)
+{
+	mapper_entry_t **link, *entry;
+	int i;
+
+	for (i = 0; i < MAPPER_CACHE_BUCKETS; i++) {
+		link = &mapper_cache[i];
+		while ((entry = *link) != NULL) {
+			if ((obj_path && strcmp(entry->path, obj_path)) ||
+				(connection && strcmp(entry->connection, connection))) {
+				link = &entry->next;
+				continue;
+			}
+			*link = entry->next;
+			free(entry->path);
+			free(entry->connection);
+			free(entry);
+		}
+	}
+}
+
+/* Fill the cache with every object under MAPPER_CACHE_ROOT in one call */
+static int mapper_cache_fill(sd_bus *bus)
+{
+	sd_bus_error bus_error = SD_BUS_ERROR_NULL;
+	sd_bus_message *m = NULL;
+	const char *path, *owner, *name;
+	int count = 0;
+	int rc;
+
+	rc = sd_bus_call_method(bus,
+				objectmapper_service_name,
+				objectmapper_object_name,
+				objectmapper_intf_name,
+				"GetSubTree",
+				&bus_error,
+				&m,
+				"sias",
+				MAPPER_CACHE_ROOT, 0, 0);
+	if (rc < 0) {
+		fprintf(stderr,
+			"fanctl: Failed to GetSubTree: %s\n", bus_error.message);
+		goto finish;
+	}
+
+	rc = sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "{sa{sas}}");
+	if (rc < 0)
+		goto finish;
+	while ((rc = sd_bus_message_enter_container(m,
+				SD_BUS_TYPE_DICT_ENTRY, "sa{sas}")) > 0) {
+		name = NULL;
+		rc = sd_bus_message_read(m, "s", &path);
+		if (rc < 0)
+			break;
+		rc = sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "{sas}");
+		if (rc < 0)
+			break;
+		while ((rc = sd_bus_message_enter_container(m,
+					SD_BUS_TYPE_DICT_ENTRY, "sas")) > 0) {
+			rc = sd_bus_message_read(m, "s", &owner);
+			if (rc < 0)
+				break;
+			rc = sd_bus_message_skip(m, "as");
+			if (rc < 0)
+				break;
+			rc = sd_bus_message_exit_container(m);
+			if (rc < 0)
+				break;
+			/* same choice as GetObject: the first owner */
+			if (!name)
+				name = owner;
+		}
+		if (rc < 0)
+			break;
+		rc = sd_bus_message_exit_container(m);
+		if (rc < 0)
+			break;
+		rc = sd_bus_message_exit_container(m);
+		if (rc < 0)
+			break;
+		if (name) {
+			mapper_cache_insert(path, name);
+			count++;
+		}
+	}
+	if (rc < 0) {
+		fprintf(stderr, "fanctl: Failed to parse GetSubTree reply: %s\n",
+				strerror(-rc));
+		goto finish;
+	}
+	fprintf(stderr, "fanctl: Cached bus names for %d objects\n", count);
+
+finish:
+	sd_bus_error_free(&bus_error);
+	sd_bus_message_unref(m);
+
+	return rc;
+}
+
+static int mapper_on_name_owner_changed(sd_bus_message *m, void *user_data,
+		sd_bus_error *ret_error)
+{
+	const char *name, *old_owner, *new_owner;
+	int rc;
+
+	rc = sd_bus_message_read(m, "sss", &name, &old_owner, &new_owner);
+	if (rc < 0)
+		return 0;
+	/* Names appearing for the first time cannot make an entry stale */
+	if (!old_owner[0])
+		return 0;
+
+	if (strcmp(name, objectmapper_service_name) == 0) {
+		mapper_cache_remove(NULL, NULL);
+		return 0;
+	}
+	mapper_cache_remove(NULL, name);
+	mapper_cache_remove(NULL, old_owner);
+
+	return 0;
+}
+
+static int mapper_on_interfaces_changed(sd_bus_message *m, void *user_data,
+		sd_bus_error *ret_error)
+{
+	const char *obj_path;
+
+	if (sd_bus_message_read(m, "o", &obj_path) >= 0)
+		mapper_cache_remove(obj_path, NULL);
+
+	return 0;
+}
+
+static int mapper_cache_init(sd_bus *bus)
+{
+	int rc;
+
+	rc = sd_bus_add_match(bus, NULL,
+			"type='signal',"
+			"sender='org.freedesktop.DBus',"
+			"interface='org.freedesktop.DBus',"
+			"member='NameOwnerChanged'",
+			mapper_on_name_owner_changed, NULL);
+	if (rc < 0)
+		return rc;
+	rc = sd_bus_add_match(bus, NULL,
+			"type='signal',"
+			"interface='org.freedesktop.DBus.ObjectManager',"
+			"member='InterfacesAdded'",
+			mapper_on_interfaces_changed, NULL);
+	if (rc < 0)
+		return rc;
+	rc = sd_bus_add_match(bus, NULL,
+			"type='signal',"
+			"interface='org.freedesktop.DBus.ObjectManager',"
+			"member='InterfacesRemoved'",
+			mapper_on_interfaces_changed, NULL);
+	if (rc < 0)
+		return rc;
+
+	/* Misses still fall back to GetObject, so a failed fill is not fatal */
+	mapper_cache_fill(bus);
+
+	return 0;
+}
+
+/* Get an object's bus name, from the cache or from ObjectMapper */
 int get_connection(sd_bus *bus, char *connection, const char *obj_path)
 {
 	sd_bus_error bus_error = SD_BUS_ERROR_NULL;
 	sd_bus_message *m = NULL;
 	char *temp_buf = NULL, *intf = NULL;
+	const char *cached;
 	int rc;
 
+	cached = mapper_cache_lookup(obj_path);
+	if (cached) {
+		strncpy(connection, cached, DBUS_MAX_NAME_LEN);
+		return 0;
+	}
+
 	rc = sd_bus_call_method(bus,
 				objectmapper_service_name,
 				objectmapper_object_name,
@@ -62,7 +353,12 @@ int get_connection(sd_bus *bus, char *connection, const char *obj_path)
 
 	/* Get the key, aka, the bus name */
 	sd_bus_message_read(m, "a{sas}", 1, &temp_buf, 1, &intf);
+	if (!temp_buf) {
+		rc = -ENXIO;
+		goto finish;
+	}
 	strncpy(connection, temp_buf, DBUS_MAX_NAME_LEN);
+	mapper_cache_insert(obj_path, connection);
 
 finish:
 	sd_bus_error_free(&bus_error);
@@ -99,10 +395,12 @@ int set_dbus_sensor(sd_bus *bus, const char *obj_path, int val)
 				&response,
 				"i",
 				val);
-	if (rc < 0)
+	if (rc < 0) {
 		fprintf(stderr,
 			"fanctl: Failed to set sensor %s:[%s]\n",
 			obj_path, strerror(-rc));
+		mapper_cache_remove(obj_path, NULL);
+	}
 
 finish:
 	sd_bus_error_free(&bus_error);
@@ -113,20 +411,18 @@ finish:
 }
 
 /* Read sensor value from "org.openbmc.Sensors" */
-int read_dbus_sensor(sd_bus *bus, const char *obj_path)
+int read_dbus_sensor(sd_bus *bus, const char *obj_path, int *val)
 {
 	char connection[DBUS_MAX_NAME_LEN];
 	sd_bus_error bus_error = SD_BUS_ERROR_NULL;
 	sd_bus_message *response = NULL;
 	int rc;
-	int val = 0;
 
 	if (!bus || !obj_path)
-		return 0;
+		return -EINVAL;
 
 	rc = get_connection(bus, connection, obj_path);
 	if (rc < 0) {
-		val = 0;
 		fprintf(stderr,
 			"fanctl: Failed to get bus name for %s\n", obj_path);
 		goto finish;
@@ -141,171 +437,978 @@ int read_dbus_sensor(sd_bus *bus, const char *obj_path)
 				&response,
 				NULL);
 	if (rc < 0) {
-		val = 0;
 		fprintf(stderr,
 			"fanctl: Failed to read sensor value from %s:[%s]\n",
 			obj_path, strerror(-rc));
+		mapper_cache_remove(obj_path, NULL);
 		goto finish;
 	}
 
-	rc = sd_bus_message_read(response, "v","i", &val);
-	if (rc < 0) {
-		val = 0;
-		fprintf(stderr,
-			"fanctl: Failed to parse sensor value "
-			"response message from %s:[%s]\n",
-			obj_path, strerror(-rc));
+	rc = sd_bus_message_read(response, "v","i", val);
+	if (rc < 0) {
+		fprintf(stderr,
+			"fanctl: Failed to parse sensor value "
+			"response message from %s:[%s]\n",
+			obj_path, strerror(-rc));
+	}
+
+finish:
+	sd_bus_error_free(&bus_error);
+	sd_bus_message_unref(response);
+	sd_bus_flush(bus);
+
+	return rc < 0 ? rc : 0;
+}
+
+/*
+ * Parse a temperature reading into degrees C. Sensors publish either
+ * degrees or millidegrees depending on their backend, so anything from
+ * 1000 up is taken as millidegrees. Zero and negative values are how
+ * sensors without a reading (e.g. host powered off) report, and are
+ * returned as -ENODATA.
+ */
+static int fan_temp_parse(sd_bus_message *response, double *temp)
+{
+	const char *contents = NULL;
+	union {
+		int32_t i;
+		uint32_t u;
+		int64_t x;
+		uint64_t t;
+		double d;
+	} val;
+	int rc;
+
+	rc = sd_bus_message_peek_type(response, NULL, &contents);
+	if (rc < 0)
+		return rc;
+	rc = sd_bus_message_enter_container(response, 'v', contents);
+	if (rc < 0)
+		return rc;
+	rc = sd_bus_message_read_basic(response, contents[0], &val);
+	if (rc < 0)
+		return rc;
+
+	switch (contents[0]) {
+	case 'i':
+		*temp = val.i;
+		break;
+	case 'u':
+		*temp = val.u;
+		break;
+	case 'x':
+		*temp = val.x;
+		break;
+	case 't':
+		*temp = val.t;
+		break;
+	case 'd':
+		*temp = val.d;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (*temp <= 0)
+		return -ENODATA;
+	if (*temp >= 1000)
+		*temp /= 1000;
+
+	return 0;
+}
+
+/* set fan speed with /org/openbmc/sensors/speed/fan* object */
+static int fan_set_speed(sd_bus *bus, int fan_id, uint8_t fan_speed)
+{
+	char obj_path[DBUS_MAX_NAME_LEN];
+	int rc;
+
+	if (!bus)
+		return -1;
+
+	snprintf(obj_path, sizeof(obj_path),
+		"/org/openbmc/sensors/speed/fan%d", fan_id);
+	rc = set_dbus_sensor(bus, obj_path, fan_speed);
+	if (rc < 0)
+		fprintf(stderr, "fanctl: Failed to set fan[%d] speed[%d]\n",
+				fan_id, fan_speed);
+
+	return rc;
+}
+
+/*
+ * FAN_TACH_OFFSET is specific to Barreleye.
+ * Barreleye uses NTC7904D HW Monitor as Fan tachometoer.
+ * The 13-bit FANIN value is made up Higer part: [12:5],
+ * and Lower part: [4:0], which are read from two sensors.
+ * see: https://www.nuvoton.com/resource-files/NCT7904D_Datasheet_V1.44.pdf
+ */
+#define FAN_TACH_OFFSET 5
+static int fan_tach_combine(int fan_tach_H, int fan_tach_L)
+{
+	/* invalid sensor value is -1 */
+	if (fan_tach_H <= 0 || fan_tach_L <= 0)
+		return 0;
+	return fan_tach_H << FAN_TACH_OFFSET | fan_tach_L;
+}
+
+/*
+ * The FANIN value is a count of the tach period, not a speed, so it
+ * grows as the fan slows and saturates at FAN_TACH_STOPPED when the fan
+ * stops. Convert it the way the kernel's nct7904 driver does; a stopped
+ * or missing reading is 0 RPM.
+ */
+#define FAN_TACH_STOPPED 0x1fff
+#define FAN_TACH_RPM_SCALE 1350000
+static int fan_tach_rpm(int count)
+{
+	if (count <= 0 || count >= FAN_TACH_STOPPED)
+		return 0;
+	return FAN_TACH_RPM_SCALE / count;
+}
+
+/*
+ * Combined tach reading of a fan; fails rather than report 0. Fans mapped
+ * to hwmon are read straight from it, both halves in one go; the rest, or
+ * a mapped fan whose hwmon read fails, go through the sensor objects on
+ * D-Bus.
+ */
+static int fan_get_speed(fan_info_t *info, int fan_id, int *speed)
+{
+	int fan_tach_H = 0, fan_tach_L = 0;
+	char obj_path[DBUS_MAX_NAME_LEN];
+	int rc;
+
+	if (fan_tach_read(&info->tachs[fan_id],
+				&fan_tach_H, &fan_tach_L) == 0) {
+		*speed = fan_tach_combine(fan_tach_H, fan_tach_L);
+		return 0;
+	}
+
+	/* get fan tach */
+	/* The object path is specific to Barreleye */
+	snprintf(obj_path, sizeof(obj_path),
+		"/org/openbmc/sensors/tach/fan%dH", fan_id);
+	rc = read_dbus_sensor(info->bus, obj_path, &fan_tach_H);
+	if (rc < 0)
+		return rc;
+	snprintf(obj_path, sizeof(obj_path),
+		"/org/openbmc/sensors/tach/fan%dL", fan_id);
+	rc = read_dbus_sensor(info->bus, obj_path, &fan_tach_L);
+	if (rc < 0)
+		return rc;
+
+	*speed = fan_tach_combine(fan_tach_H, fan_tach_L);
+	return 0;
+}
+
+static void fan_speed_changed(fan_t *fan, int speed)
+{
+	fan->speed = speed;
+	sd_bus_emit_signal(fan->info->bus, fan->path, "org.openbmc.Fan",
+			"SpeedChanged", "i", speed);
+	sd_bus_emit_properties_changed(fan->info->bus, fan->path,
+			"org.openbmc.Fan", "speed", NULL);
+}
+
+/*
+ * Write a PWM to a fan, skipping the D-Bus round trip when it would not
+ * change anything.
+ */
+static int fan_apply_speed(fan_t *fan, int speed)
+{
+	int rc;
+
+	if (speed == fan->speed)
+		return 0;
+	rc = fan_set_speed(fan->info->bus, fan->id, speed);
+	if (rc < 0)
+		return rc;
+
+	fan_speed_changed(fan, speed);
+	return 0;
+}
+
+/*
+ * Background tach monitor: every fan's tach is sampled on a timer, and by
+ * updatePresent, into its monitor's history. This feeds one reading in;
+ * a new fault is logged and TachError emitted here, and the transitions
+ * are returned for the caller to write to inventory, so Present and Fault
+ * are only written when fan_monitor_sample reports a change.
+ */
+static int fan_monitor_record(fan_info_t *info, fan_t *fan, int speed)
+{
+	fan_monitor_t *mon = &fan->monitor;
+	int rpm = fan_tach_rpm(speed);
+	int changed;
+
+	changed = fan_monitor_sample(mon, rpm, info->min_rpm,
+			info->rpm_hysteresis);
+	if ((changed & FAN_FAULT_CHANGED) && mon->fault) {
+		fprintf(stderr, "fanctl: fan%d at %d RPM, below %d\n",
+				fan->id, rpm, info->min_rpm);
+		sd_bus_emit_signal(info->bus, fan->path, "org.openbmc.Fan",
+				"TachError", NULL);
+	}
+
+	return changed;
+}
+
+/*
+ * setMax and updatePresent fan out into one asynchronous call per fan and
+ * reply once the last of them has completed, so every fan is driven within
+ * about one bus round trip instead of one per fan. The batch holds the
+ * method call being answered and the first error seen. The control and
+ * monitor timers use batches too, with no call to answer.
+ */
+typedef void (*fan_batch_done_t)(void *user_data, int rc);
+
+typedef struct {
+	/* method call to answer, or NULL for a batch started by a timer */
+	sd_bus_message *call;
+	/* optional, called once the batch is complete */
+	fan_batch_done_t done;
+	void *user_data;
+	int pending;
+	int rc;
+} fan_batch_t;
+
+struct fan_op;
+
+/* One tach sensor read of an updatePresent op */
+typedef struct {
+	struct fan_op *op;
+	int value;
+	/* < 0 if the read failed */
+	int rc;
+} fan_tach_read_t;
+
+typedef struct fan_op {
+	fan_batch_t *batch;
+	fan_t *fan;
+	int speed;
+	/* inventory setter called and the value written */
+	const char *member;
+	int value;
+	int reads;
+	fan_tach_read_t tach[2];
+	char obj_path[DBUS_MAX_NAME_LEN];
+} fan_op_t;
+
+static fan_batch_t *fan_batch_new(sd_bus_message *call)
+{
+	fan_batch_t *batch = calloc(1, sizeof(*batch));
+
+	if (!batch)
+		return NULL;
+	if (call)
+		batch->call = sd_bus_message_ref(call);
+	/* Held by the caller until every op has been issued */
+	batch->pending = 1;
+
+	return batch;
+}
+
+static void fan_batch_put(fan_batch_t *batch, int rc)
+{
+	if (rc < 0 && batch->rc == 0)
+		batch->rc = rc;
+	if (--batch->pending)
+		return;
+
+	if (batch->call) {
+		sd_bus_reply_method_return(batch->call, "i", batch->rc);
+		sd_bus_message_unref(batch->call);
+	}
+	if (batch->done)
+		batch->done(batch->user_data, batch->rc);
+	free(batch);
+}
+
+static fan_op_t *fan_op_new(fan_batch_t *batch, fan_t *fan)
+{
+	fan_op_t *op = calloc(1, sizeof(*op));
+
+	if (!op)
+		return NULL;
+	op->batch = batch;
+	op->fan = fan;
+	batch->pending++;
+
+	return op;
+}
+
+static void fan_op_done(fan_op_t *op, int rc)
+{
+	fan_batch_put(op->batch, rc);
+	free(op);
+}
+
+static int fan_reply_errno(sd_bus_message *reply, const char *obj_path)
+{
+	const sd_bus_error *error;
+	int rc;
+
+	if (!sd_bus_message_is_method_error(reply, NULL))
+		return 0;
+
+	error = sd_bus_message_get_error(reply);
+	rc = -sd_bus_message_get_errno(reply);
+	fprintf(stderr, "fanctl: Call to %s failed: %s\n", obj_path,
+			error && error->message ? error->message : strerror(-rc));
+	mapper_cache_remove(obj_path, NULL);
+
+	return rc < 0 ? rc : -EIO;
+}
+
+/*
+ * One asynchronous call made for an op. The bus name comes from the mapper
+ * cache or, on a miss, from an asynchronous GetObject, so issuing a batch
+ * never waits on the mapper. done is called exactly once, with the reply,
+ * or with a NULL reply and rc < 0 when the name could not be resolved, the
+ * call could not be sent or it returned an error. String arguments are not
+ * copied and must outlive the call.
+ */
+typedef void (*fan_call_done_t)(void *user_data, sd_bus_message *reply,
+		int rc);
+
+typedef struct {
+	sd_bus *bus;
+	fan_call_done_t done;
+	void *user_data;
+	const char *interface;
+	const char *member;
+	const char *types;
+	int int_arg;
+	const char *str_arg;
+	char obj_path[DBUS_MAX_NAME_LEN];
+} fan_call_t;
+
+static void fan_call_finish(fan_call_t *call, sd_bus_message *reply, int rc)
+{
+	call->done(call->user_data, reply, rc);
+	free(call);
+}
+
+static int fan_call_reply(sd_bus_message *reply, void *user_data,
+		sd_bus_error *ret_error)
+{
+	fan_call_t *call = user_data;
+	int rc;
+
+	rc = fan_reply_errno(reply, call->obj_path);
+	fan_call_finish(call, rc < 0 ? NULL : reply, rc);
+
+	return 0;
+}
+
+static int fan_call_send(fan_call_t *call, const char *connection)
+{
+	int rc;
+
+	if (!call->types)
+		rc = sd_bus_call_method_async(call->bus, NULL, connection,
+				call->obj_path, call->interface, call->member,
+				fan_call_reply, call, NULL);
+	else if (call->types[0] == 'i')
+		rc = sd_bus_call_method_async(call->bus, NULL, connection,
+				call->obj_path, call->interface, call->member,
+				fan_call_reply, call, call->types, call->int_arg);
+	else
+		rc = sd_bus_call_method_async(call->bus, NULL, connection,
+				call->obj_path, call->interface, call->member,
+				fan_call_reply, call, call->types, call->str_arg);
+	if (rc < 0)
+		fprintf(stderr, "fanctl: Failed to call %s on %s: %s\n",
+				call->member, call->obj_path, strerror(-rc));
+
+	return rc;
+}
+
+/* GetObject answered a cache miss: remember the name and make the call */
+static int fan_call_resolved(sd_bus_message *reply, void *user_data,
+		sd_bus_error *ret_error)
+{
+	fan_call_t *call = user_data;
+	const char *connection = NULL, *intf = NULL;
+	int rc;
+
+	if (sd_bus_message_is_method_error(reply, NULL)) {
+		const sd_bus_error *error = sd_bus_message_get_error(reply);
+
+		rc = -sd_bus_message_get_errno(reply);
+		if (rc >= 0)
+			rc = -EIO;
+		fprintf(stderr, "fanctl: Failed to GetObject %s: %s\n",
+				call->obj_path,
+				error && error->message ?
+				error->message : strerror(-rc));
+		goto fail;
+	}
+
+	/* Get the key, aka, the bus name */
+	rc = sd_bus_message_read(reply, "a{sas}", 1, &connection, 1, &intf);
+	if (rc < 0 || !connection) {
+		fprintf(stderr, "fanctl: Failed to get bus name for %s\n",
+				call->obj_path);
+		rc = -ENXIO;
+		goto fail;
+	}
+	mapper_cache_insert(call->obj_path, connection);
+	rc = fan_call_send(call, connection);
+	if (rc >= 0)
+		return 0;
+
+fail:
+	fan_call_finish(call, NULL, rc);
+	return 0;
+}
+
+static int fan_call_async(sd_bus *bus, const char *obj_path,
+		void *user_data, fan_call_done_t done, const char *interface,
+		const char *member, const char *types, const void *arg)
+{
+	const char *cached;
+	fan_call_t *call;
+	int rc;
+
+	call = calloc(1, sizeof(*call));
+	if (!call)
+		return -ENOMEM;
+	call->bus = bus;
+	call->done = done;
+	call->user_data = user_data;
+	call->interface = interface;
+	call->member = member;
+	call->types = types;
+	if (types && types[0] == 'i')
+		call->int_arg = *(const int *)arg;
+	else if (types)
+		call->str_arg = arg;
+	snprintf(call->obj_path, sizeof(call->obj_path), "%s", obj_path);
+
+	cached = mapper_cache_lookup(call->obj_path);
+	if (cached) {
+		rc = fan_call_send(call, cached);
+	} else {
+		rc = sd_bus_call_method_async(bus, NULL,
+				objectmapper_service_name,
+				objectmapper_object_name,
+				objectmapper_intf_name,
+				"GetObject", fan_call_resolved, call,
+				"s", call->obj_path);
+		if (rc < 0)
+			fprintf(stderr, "fanctl: Failed to GetObject %s: %s\n",
+					call->obj_path, strerror(-rc));
+	}
+	if (rc < 0)
+		free(call);
+
+	return rc;
+}
+
+static void fan_max_done(void *user_data, sd_bus_message *reply, int rc)
+{
+	fan_op_t *op = user_data;
+
+	if (rc == 0) {
+		fan_speed_changed(op->fan, op->speed);
+		fprintf(stderr, "fanctl: Set fan%d to max speed\n",
+				op->fan->id);
+	}
+	fan_op_done(op, rc);
+}
+
+/*
+ * Ramp every fan to full speed. Each fan stays there, whatever its zone
+ * asks for, until setCoolingZone or setSpeed is called on that fan.
+ */
+static int fan_set_max_speed(fan_info_t *info, sd_bus_message *msg)
+{
+	fan_batch_t *batch;
+	fan_op_t *op;
+	int i, rc;
+
+	batch = fan_batch_new(msg);
+	if (!batch)
+		return -ENOMEM;
+	for (i = 0; i < info->fan_num; i++) {
+		info->fans[i].max_hold = 1;
+		op = fan_op_new(batch, &info->fans[i]);
+		if (!op) {
+			if (!batch->rc)
+				batch->rc = -ENOMEM;
+			break;
+		}
+		op->speed = FAN_PWM_MAX;
+		snprintf(op->obj_path, sizeof(op->obj_path),
+				"/org/openbmc/sensors/speed/fan%d", i);
+		rc = fan_call_async(info->bus, op->obj_path, op, fan_max_done,
+				"org.openbmc.SensorValue", "setValue", "i",
+				&op->speed);
+		if (rc < 0)
+			fan_op_done(op, rc);
+	}
+	fan_batch_put(batch, 0);
+
+	return 0;
+}
+
+/*
+ * Control passes run on the same asynchronous calls, so a pass never holds
+ * up the event loop: every sensor of a zone is read in parallel, and the
+ * zone's fans are written once the last reading is in. A pass holds its
+ * tick's batch until its writes are done.
+ */
+struct fan_zone_pass;
+
+typedef struct {
+	struct fan_zone_pass *pass;
+	int input;
+} fan_temp_read_t;
+
+typedef struct fan_zone_pass {
+	fan_batch_t *batch;
+	fan_info_t *info;
+	fan_zone_t *zone;
+	double dt;
+	int pending;
+	/* hottest valid reading of each input */
+	double hottest[FAN_ZONE_MAX_INPUTS];
+	int valid[FAN_ZONE_MAX_INPUTS];
+	fan_temp_read_t *reads;
+} fan_zone_pass_t;
+
+static void fan_speed_done(void *user_data, sd_bus_message *reply, int rc)
+{
+	fan_op_t *op = user_data;
+
+	if (rc == 0)
+		fan_speed_changed(op->fan, op->speed);
+	fan_op_done(op, rc);
+}
+
+/* Write a zone's PWM to a fan, unless the fan already runs at it */
+static void fan_zone_write(fan_batch_t *batch, fan_t *fan, int speed)
+{
+	fan_op_t *op;
+	int rc;
+
+	if (speed == fan->speed)
+		return;
+	op = fan_op_new(batch, fan);
+	if (!op)
+		return;
+	op->speed = speed;
+	snprintf(op->obj_path, sizeof(op->obj_path),
+			"/org/openbmc/sensors/speed/fan%d", fan->id);
+	rc = fan_call_async(fan->info->bus, op->obj_path, op, fan_speed_done,
+			"org.openbmc.SensorValue", "setValue", "i", &op->speed);
+	if (rc < 0)
+		fan_op_done(op, rc);
+}
+
+/*
+ * Every reading of a zone is in: each input proposes a PWM from the
+ * hottest valid reading among its sensors and the zone takes the highest
+ * proposal. A zone left with no readings at all runs at its maximum.
+ */
+static void fan_zone_pass_put(fan_zone_pass_t *pass)
+{
+	fan_info_t *info = pass->info;
+	fan_zone_t *zone = pass->zone;
+	int i, proposal;
+	int pwm = -1;
+
+	if (--pass->pending)
+		return;
+
+	for (i = 0; i < zone->num_inputs; i++) {
+		fan_input_t *input = &zone->inputs[i];
+
+		if (!pass->valid[i]) {
+			/* Restart the derivative term once readings return */
+			input->primed = 0;
+			continue;
+		}
+		proposal = fan_input_update(input, pass->hottest[i], pass->dt);
+		if (proposal > pwm)
+			pwm = proposal;
+	}
+
+	if (pwm < 0) {
+		if (zone->pwm != zone->max_pwm)
+			fprintf(stderr, "fanctl: No temperatures for zone %d, "
+					"running at max\n", zone->id);
+		pwm = zone->max_pwm;
+	}
+	if (pwm > zone->max_pwm)
+		pwm = zone->max_pwm;
+	if (pwm < zone->min_pwm)
+		pwm = zone->min_pwm;
+	zone->pwm = pwm;
+
+	for (i = 0; i < info->fan_num; i++) {
+		if (info->fans[i].cooling_zone == zone->id &&
+				!info->fans[i].max_hold)
+			fan_zone_write(pass->batch, &info->fans[i], pwm);
+	}
+
+	fan_batch_put(pass->batch, 0);
+	free(pass->reads);
+	free(pass);
+}
+
+static void fan_temp_done(void *user_data, sd_bus_message *reply, int rc)
+{
+	fan_temp_read_t *read = user_data;
+	fan_zone_pass_t *pass = read->pass;
+	double temp;
+
+	if (rc == 0 && fan_temp_parse(reply, &temp) == 0 &&
+			(!pass->valid[read->input] ||
+			 temp > pass->hottest[read->input])) {
+		pass->hottest[read->input] = temp;
+		pass->valid[read->input] = 1;
+	}
+	fan_zone_pass_put(pass);
+}
+
+static void fan_zone_start(fan_batch_t *batch, fan_info_t *info,
+		fan_zone_t *zone, double dt)
+{
+	fan_zone_pass_t *pass;
+	fan_temp_read_t *read;
+	int i, j, num_reads = 0;
+	int rc;
+
+	for (i = 0; i < zone->num_inputs; i++)
+		num_reads += zone->inputs[i].num_sensors;
+
+	pass = calloc(1, sizeof(*pass));
+	if (!pass)
+		return;
+	pass->reads = calloc(num_reads ? num_reads : 1, sizeof(*pass->reads));
+	if (!pass->reads) {
+		free(pass);
+		return;
+	}
+	pass->batch = batch;
+	pass->info = info;
+	pass->zone = zone;
+	pass->dt = dt;
+	batch->pending++;
+	/* Held until every read has been issued */
+	pass->pending = 1;
+
+	read = pass->reads;
+	for (i = 0; i < zone->num_inputs; i++) {
+		for (j = 0; j < zone->inputs[i].num_sensors; j++, read++) {
+			read->pass = pass;
+			read->input = i;
+			rc = fan_call_async(info->bus,
+					zone->inputs[i].sensors[j], read,
+					fan_temp_done, "org.openbmc.SensorValue",
+					"getValue", NULL, NULL);
+			if (rc >= 0)
+				pass->pending++;
+		}
+	}
+	fan_zone_pass_put(pass);
+}
+
+static void fan_control_done(void *user_data, int rc)
+{
+	fan_info_t *info = user_data;
+
+	info->control_busy = 0;
+}
+
+static int fan_control_tick(sd_event_source *source, uint64_t usec,
+		void *user_data)
+{
+	fan_info_t *info = user_data;
+	fan_batch_t *batch;
+	double dt = 0;
+	int i;
+
+	/* A pass still waiting on slow sensors is not stacked on */
+	if (!info->control_busy) {
+		if (info->last_tick)
+			dt = (usec - info->last_tick) / 1000000.0;
+		info->last_tick = usec;
+
+		batch = fan_batch_new(NULL);
+		if (batch) {
+			batch->done = fan_control_done;
+			batch->user_data = info;
+			info->control_busy = 1;
+			for (i = 0; i < info->zones.num_zones; i++)
+				fan_zone_start(batch, info,
+						&info->zones.zones[i], dt);
+			fan_batch_put(batch, 0);
+		}
 	}
 
-finish:
-	sd_bus_error_free(&bus_error);
-	sd_bus_message_unref(response);
-	sd_bus_flush(bus);
+	sd_event_source_set_time(source,
+			usec + info->zones.interval_ms * 1000ULL);
+	return sd_event_source_set_enabled(source, SD_EVENT_ONESHOT);
+}
 
-	return val;
+static void fan_inventory_done(void *user_data, sd_bus_message *reply,
+		int rc)
+{
+	fan_op_t *op = user_data;
+
+	if (rc == 0)
+		fprintf(stderr, "fanctl: %s fan%d: %s\n", op->member,
+				op->fan->id, op->value ? "True" : "False");
+	fan_op_done(op, rc);
 }
 
-/* set fan speed with /org/openbmc/sensors/speed/fan* object */
-static int fan_set_speed(sd_bus *bus, int fan_id, uint8_t fan_speed)
+/* set a Fan Inventory 'True'/'False' property through its setter */
+static void fan_set_inventory(fan_op_t *op, const char *member, int val)
 {
-	char obj_path[DBUS_MAX_NAME_LEN];
 	int rc;
 
-	if (!bus)
-		return -1;
-
-	snprintf(obj_path, sizeof(obj_path),
-		"/org/openbmc/sensors/speed/fan%d", fan_id);
-	rc = set_dbus_sensor(bus, obj_path, fan_speed);
+	op->member = member;
+	op->value = val;
+	snprintf(op->obj_path, sizeof(op->obj_path),
+		"/org/openbmc/inventory/system/chassis/fan%d", op->fan->id);
+	rc = fan_call_async(op->fan->info->bus, op->obj_path, op,
+			fan_inventory_done, "org.openbmc.InventoryItem",
+			member, "s", val ? "True" : "False");
 	if (rc < 0)
-		fprintf(stderr, "fanctl: Failed to set fan[%d] speed[%d]\n",
-				fan_id, fan_speed);
+		fan_op_done(op, rc);
+}
 
-	return rc;
+/*
+ * Both tach halves are in: the combined reading goes through the fan's
+ * monitor, and Present or Fault are only written when the monitor reports
+ * that they changed.
+ */
+static void fan_tach_complete(fan_op_t *op)
+{
+	fan_monitor_t *mon = &op->fan->monitor;
+	fan_op_t *fault_op;
+	int half, changed;
+
+	/* A failed read says nothing about presence; leave it as it was */
+	for (half = 0; half < 2; half++) {
+		if (op->tach[half].rc < 0) {
+			fprintf(stderr, "fanctl: fan%d tach read failed\n",
+					op->fan->id);
+			fan_op_done(op, op->tach[half].rc);
+			return;
+		}
+	}
+
+	op->speed = fan_tach_combine(op->tach[0].value, op->tach[1].value);
+	/* updatePresent logs what it read; the monitor timer stays quiet */
+	if (op->batch->call)
+		fprintf(stderr, "fan%d speed: %d\n", op->fan->id, op->speed);
+
+	changed = fan_monitor_record(op->fan->info, op->fan, op->speed);
+	if (changed & FAN_FAULT_CHANGED) {
+		fault_op = fan_op_new(op->batch, op->fan);
+		if (fault_op)
+			fan_set_inventory(fault_op, "setFault", mon->fault);
+	}
+	if (changed & FAN_PRESENT_CHANGED)
+		fan_set_inventory(op, "setPresent", mon->present);
+	else
+		fan_op_done(op, 0);
 }
 
-static int fan_set_max_speed(fan_info_t *info)
+static void fan_tach_done(void *user_data, sd_bus_message *reply, int rc)
 {
-	int i;
-	int rc = -1;
+	fan_tach_read_t *read = user_data;
+	fan_op_t *op = read->op;
 
-	if (!info)
-		return -1;
-	for (i = 0; i < info->fan_num; i++) {
-		rc = fan_set_speed(info->bus, i, 255);
-		if (rc < 0)
-			break;
-		fprintf(stderr, "fanctl: Set fan%d to max speed\n", i);
+	if (rc == 0)
+		rc = sd_bus_message_read(reply, "v", "i", &read->value);
+	if (rc < 0)
+		read->rc = rc;
+	if (--op->reads == 0)
+		fan_tach_complete(op);
+}
+
+/*
+ * Sample one fan's tach as part of a batch: straight from hwmon when
+ * mapped, otherwise by reading both halves in parallel over D-Bus.
+ */
+static int fan_tach_start(fan_batch_t *batch, fan_t *fan)
+{
+	fan_info_t *info = fan->info;
+	fan_op_t *op;
+	int half;
+
+	op = fan_op_new(batch, fan);
+	if (!op)
+		return -ENOMEM;
+
+	if (fan_tach_read(&info->tachs[fan->id], &op->tach[0].value,
+				&op->tach[1].value) == 0) {
+		fan_tach_complete(op);
+		return 0;
 	}
 
-	return rc;
+	/* Hold the op until both reads have been issued */
+	op->reads = 1;
+	for (half = 0; half < 2; half++) {
+		op->tach[half].op = op;
+		/* The object path is specific to Barreleye */
+		snprintf(op->obj_path, sizeof(op->obj_path),
+			"/org/openbmc/sensors/tach/fan%d%c",
+			fan->id, half ? 'L' : 'H');
+		op->tach[half].rc = fan_call_async(info->bus, op->obj_path,
+				&op->tach[half], fan_tach_done,
+				"org.openbmc.SensorValue", "getValue",
+				NULL, NULL);
+		if (op->tach[half].rc >= 0) {
+			op->tach[half].rc = 0;
+			op->reads++;
+		}
+	}
+	if (--op->reads == 0)
+		fan_tach_complete(op);
+
+	return 0;
 }
+
 /*
- * FAN_TACH_OFFSET is specific to Barreleye.
- * Barreleye uses NTC7904D HW Monitor as Fan tachometoer.
- * The 13-bit FANIN value is made up Higer part: [12:5],
- * and Lower part: [4:0], which are read from two sensors.
- * see: https://www.nuvoton.com/resource-files/NCT7904D_Datasheet_V1.44.pdf
+ * Update Fan Invertory 'Present' status by first reading fan speed.
+ * The reading goes to the fan's monitor, which decides presence: a fan
+ * never seen spinning is not 'Present', one that stops later is faulty.
+ * The tachs of all fans are read in parallel, and each fan's setPresent
+ * goes out as soon as its own readings are in.
  */
-#define FAN_TACH_OFFSET 5
-static int fan_get_speed(sd_bus *bus, int fan_id)
+static int fan_update_present(fan_info_t *info, sd_bus_message *msg)
 {
-	int fan_tach_H = 0, fan_tach_L = 0;
-	char obj_path[DBUS_MAX_NAME_LEN];
-	int fan_speed;
+	fan_batch_t *batch;
+	int i, rc;
 
-	/* get fan tach */
-	/* The object path is specific to Barreleye */
-	snprintf(obj_path, sizeof(obj_path),
-		"/org/openbmc/sensors/tach/fan%dH", fan_id);
-	fan_tach_H = read_dbus_sensor(bus, obj_path);
-	snprintf(obj_path, sizeof(obj_path),
-		"/org/openbmc/sensors/tach/fan%dL", fan_id);
-	fan_tach_L = read_dbus_sensor(bus, obj_path);
+	batch = fan_batch_new(msg);
+	if (!batch)
+		return -ENOMEM;
 
-	/* invalid sensor value is -1 */
-	if (fan_tach_H <= 0 || fan_tach_L <= 0)
-		fan_speed = 0;
-	else
-		fan_speed = fan_tach_H << FAN_TACH_OFFSET | fan_tach_L;
+	for (i = 0; i < info->fan_num; i++) {
+		rc = fan_tach_start(batch, &info->fans[i]);
+		if (rc < 0) {
+			if (!batch->rc)
+				batch->rc = rc;
+			break;
+		}
+	}
+	fan_batch_put(batch, 0);
 
-	fprintf(stderr, "fan%d speed: %d\n", fan_id, fan_speed);
-	return fan_speed;
+	return 0;
 }
 
-/* set Fan Inventory 'Present' status */
-int fan_set_present(sd_bus *bus, int fan_id, int val)
+/*
+ * The hwmon files behind each fan's tach come from the HWMON_CONFIG
+ * entries the sensor manager reads, as served by the system manager.
+ * Until that answers, every fan is read over D-Bus, and the monitor
+ * timer asks again, so fanctl can start before the system manager.
+ */
+static int fan_tach_config_reply(sd_bus_message *reply, void *user_data,
+		sd_bus_error *ret_error)
 {
-	sd_bus_error bus_error = SD_BUS_ERROR_NULL;
-	sd_bus_message *response = NULL;
+	fan_info_t *info = user_data;
+	const char *instance, *high, *low;
+	int fan, mapped = 0;
 	int rc;
-	char obj_path[DBUS_MAX_NAME_LEN];
-	char connection[DBUS_MAX_NAME_LEN];
 
-	snprintf(obj_path, sizeof(obj_path),
-		"/org/openbmc/inventory/system/chassis/fan%d", fan_id);
+	info->tach_requested = 0;
+	if (sd_bus_message_is_method_error(reply, NULL)) {
+		const sd_bus_error *error = sd_bus_message_get_error(reply);
 
-	rc = get_connection(bus, connection, obj_path);
+		fprintf(stderr, "fanctl: Failed to get tach config: %s\n",
+				error && error->message ? error->message :
+				"unknown error");
+		return 0;
+	}
+
+	rc = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(isss)");
+	while (rc >= 0 && (rc = sd_bus_message_read(reply, "(isss)", &fan,
+					&instance, &high, &low)) > 0) {
+		if (fan < 0 || fan >= info->fan_num)
+			continue;
+		if (fan_tach_map(&info->tachs[fan], instance, high, low) < 0) {
+			fprintf(stderr, "fanctl: Invalid tach entry for fan%d\n",
+					fan);
+			continue;
+		}
+		mapped++;
+	}
 	if (rc < 0) {
-		fprintf(stderr,
-			"fanctl: Failed to get bus name for %s\n", obj_path);
-		goto finish;
+		fprintf(stderr, "fanctl: Failed to parse tach config: %s\n",
+				strerror(-rc));
+		return 0;
 	}
 
-	rc = sd_bus_call_method(bus,
-				connection,
-				obj_path,
-				"org.openbmc.InventoryItem",
-				"setPresent",
-				&bus_error,
-				&response,
-				"s",
-				(val == 1 ? "True" : "False"));
-	if(rc < 0)
-		fprintf(stderr,
-			"fanctl: Failed to update fan presence via dbus: %s\n",
-			bus_error.message);
+	info->tach_loaded = 1;
+	if (mapped)
+		fprintf(stderr, "fanctl: %d fans read from hwmon\n", mapped);
 
-	fprintf(stderr, "fanctl: Set fan%d present status to: %s\n",
-			fan_id, (val == 1 ? "True" : "False"));
+	return 0;
+}
 
-finish:
-	sd_bus_error_free(&bus_error);
-	sd_bus_message_unref(response);
-	sd_bus_flush(bus);
+static void fan_tach_request(fan_info_t *info)
+{
+	int rc;
 
-	return rc;
+	rc = sd_bus_call_method_async(info->bus, NULL,
+			"org.openbmc.managers.System",
+			"/org/openbmc/managers/System",
+			"org.openbmc.managers.System",
+			"getFanTachConfiguration",
+			fan_tach_config_reply, info, NULL);
+	if (rc < 0) {
+		fprintf(stderr, "fanctl: Failed to request tach config: %s\n",
+				strerror(-rc));
+		return;
+	}
+	info->tach_requested = 1;
 }
 
-/*
- * Update Fan Invertory 'Present' status by first reading fan speed.
- * If fan speed is '0', the fan is considerred not 'Present'.
- */
-static int fan_update_present(fan_info_t *info)
+static void fan_monitor_done(void *user_data, int rc)
 {
-	int i;
-	int rc = -1;
-	int fan_speed;
+	fan_info_t *info = user_data;
 
-	if (!info)
-		return -1;
+	info->monitor_busy = 0;
+}
 
-	for (i = 0; i < info->fan_num; i++) {
-		fan_speed = fan_get_speed(info->bus, i);
-		if (fan_speed > 0)
-			rc = fan_set_present(info->bus, i, 1);
-		else
-			rc = fan_set_present(info->bus, i, 0);
+/* Sample every fan, unless the last round is still waiting on its calls */
+static int fan_monitor_tick(sd_event_source *source, uint64_t usec,
+		void *user_data)
+{
+	fan_info_t *info = user_data;
+	fan_batch_t *batch;
+	int i;
 
-		if (rc < 0) {
-			fprintf(stderr,
-				"fanctl: Failed to set fan present status\n");
-			break;
+	if (!info->tach_loaded && !info->tach_requested)
+		fan_tach_request(info);
+
+	if (!info->monitor_busy) {
+		batch = fan_batch_new(NULL);
+		if (batch) {
+			batch->done = fan_monitor_done;
+			batch->user_data = info;
+			info->monitor_busy = 1;
+			for (i = 0; i < info->fan_num; i++) {
+				if (fan_tach_start(batch, &info->fans[i]) < 0)
+					break;
+			}
+			fan_batch_put(batch, 0);
 		}
 	}
 
-	return rc;
+	sd_event_source_set_time(source,
+			usec + FAN_MONITOR_INTERVAL_MS * 1000ULL);
+	return sd_event_source_set_enabled(source, SD_EVENT_ONESHOT);
 }
+
 /*
  * Router function for any FAN operations that come via dbus
  */
@@ -324,13 +1427,18 @@ static int fan_function_router(sd_bus_message *msg, void *user_data,
 	}
 
 	/* Route the user action to appropriate handlers. */
+	/* These reply from the event loop once every fan has answered */
 	if ((strcmp(fan_function, "setMax") == 0)) {
-		rc = fan_set_max_speed(info);
-		return sd_bus_reply_method_return(msg, "i", rc);
+		rc = fan_set_max_speed(info, msg);
+		if (rc < 0)
+			return sd_bus_reply_method_return(msg, "i", rc);
+		return 1;
 	}
 	if ((strcmp(fan_function, "updatePresent") == 0)) {
-		rc = fan_update_present(info);
-		return sd_bus_reply_method_return(msg, "i", rc);
+		rc = fan_update_present(info, msg);
+		if (rc < 0)
+			return sd_bus_reply_method_return(msg, "i", rc);
+		return 1;
 	}
 
 	return sd_bus_reply_method_return(msg, "i", rc);
@@ -347,13 +1455,184 @@ static const sd_bus_vtable fan_control_vtable[] =
 	SD_BUS_VTABLE_END,
 };
 
+static int fan_set_cooling_zone(sd_bus_message *msg, void *user_data,
+		sd_bus_error *ret_error)
+{
+	fan_t *fan = user_data;
+	fan_info_t *info = fan->info;
+	fan_zone_t *zone = NULL;
+	int id;
+	int rc;
+
+	rc = sd_bus_message_read(msg, "i", &id);
+	if (rc < 0)
+		return rc;
+	if (id != FAN_ZONE_MANUAL) {
+		zone = fan_zones_find(&info->zones, id);
+		if (!zone)
+			return sd_bus_error_setf(ret_error,
+					SD_BUS_ERROR_INVALID_ARGS,
+					"No cooling zone %d", id);
+	}
+
+	fan->cooling_zone = id;
+	fan->max_hold = 0;
+	sd_bus_emit_properties_changed(info->bus, fan->path,
+			"org.openbmc.Fan", "cooling_zone", NULL);
+	if (zone && zone->pwm >= 0)
+		fan_apply_speed(fan, zone->pwm);
+
+	return sd_bus_reply_method_return(msg, NULL);
+}
+
+static int fan_get_tach(sd_bus_message *msg, void *user_data,
+		sd_bus_error *ret_error)
+{
+	fan_t *fan = user_data;
+	int speed;
+
+	if (fan_get_speed(fan->info, fan->id, &speed) < 0)
+		return sd_bus_error_setf(ret_error, SD_BUS_ERROR_FAILED,
+				"Failed to read fan%d tach", fan->id);
+
+	return sd_bus_reply_method_return(msg, "i", speed);
+}
+
+/* Manual override: takes the fan out of its cooling zone */
+static int fan_set_manual_speed(sd_bus_message *msg, void *user_data,
+		sd_bus_error *ret_error)
+{
+	fan_t *fan = user_data;
+	int speed;
+	int rc;
+
+	rc = sd_bus_message_read(msg, "i", &speed);
+	if (rc < 0)
+		return rc;
+	if (speed < 0 || speed > FAN_PWM_MAX)
+		return sd_bus_error_setf(ret_error, SD_BUS_ERROR_INVALID_ARGS,
+				"Speed %d out of range", speed);
+
+	fan->max_hold = 0;
+	if (fan->cooling_zone != FAN_ZONE_MANUAL) {
+		fan->cooling_zone = FAN_ZONE_MANUAL;
+		sd_bus_emit_properties_changed(fan->info->bus, fan->path,
+				"org.openbmc.Fan", "cooling_zone", NULL);
+	}
+	rc = fan_apply_speed(fan, speed);
+	if (rc < 0)
+		return sd_bus_error_setf(ret_error, SD_BUS_ERROR_FAILED,
+				"Failed to set fan%d speed", fan->id);
+
+	return sd_bus_reply_method_return(msg, NULL);
+}
+
+static const sd_bus_vtable fan_vtable[] =
+{
+	SD_BUS_VTABLE_START(0),
+	SD_BUS_METHOD("setCoolingZone", "i", "", &fan_set_cooling_zone,
+			SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("getSpeed", "", "i", &fan_get_tach,
+			SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("setSpeed", "i", "", &fan_set_manual_speed,
+			SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_PROPERTY("speed", "i", NULL, offsetof(fan_t, speed),
+			SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+	SD_BUS_PROPERTY("cooling_zone", "i", NULL,
+			offsetof(fan_t, cooling_zone),
+			SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+	SD_BUS_PROPERTY("pwm_num", "i", NULL, offsetof(fan_t, pwm_num),
+			SD_BUS_VTABLE_PROPERTY_CONST),
+	SD_BUS_SIGNAL("SpeedChanged", "i", 0),
+	SD_BUS_SIGNAL("TachError", "", 0),
+	SD_BUS_VTABLE_END,
+};
+
+static int fan_zones_init(fan_info_t *info)
+{
+	fan_counts_t counts = {
+		.fan_num = info->fan_num,
+		.cpu_num = info->cpu_num,
+		.core_num = info->core_num,
+		.dimm_num = info->dimm_num,
+	};
+	int *fan_zone;
+	int i, rc;
+
+	info->fans = calloc(info->fan_num, sizeof(fan_t));
+	fan_zone = calloc(info->fan_num, sizeof(int));
+	if (info->fan_num && (!info->fans || !fan_zone)) {
+		free(fan_zone);
+		return -ENOMEM;
+	}
+
+	if (info->zone_config) {
+		rc = fan_zones_load(&info->zones, info->zone_config, &counts,
+				fan_zone);
+		if (rc < 0)
+			fprintf(stderr, "fanctl: Failed to load zones from %s\n",
+					info->zone_config);
+	} else if (info->default_zones) {
+		rc = fan_zones_default(&info->zones, &counts, fan_zone);
+	} else {
+		/* Zone control is opt-in; every fan stays under manual control */
+		memset(&info->zones, 0, sizeof(info->zones));
+		for (i = 0; i < info->fan_num; i++)
+			fan_zone[i] = FAN_ZONE_MANUAL;
+		rc = 0;
+	}
+	if (rc < 0) {
+		free(fan_zone);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < info->fan_num; i++) {
+		fan_t *fan = &info->fans[i];
+
+		fan->info = info;
+		fan->id = i;
+		fan->speed = -1;
+		fan->pwm_num = i;
+		fan->cooling_zone = fan_zone[i];
+		snprintf(fan->path, sizeof(fan->path),
+				FAN_OBJECT_ROOT "/fan%d", i);
+		fan_monitor_init(&fan->monitor);
+	}
+	free(fan_zone);
+
+	return 0;
+}
+
+static int fan_tachs_init(fan_info_t *info)
+{
+	info->tachs = calloc(info->fan_num, sizeof(fan_tach_t));
+	if (info->fan_num && !info->tachs)
+		return -ENOMEM;
+	fan_tach_init(info->tachs, info->fan_num);
+
+	return 0;
+}
+
 int start_fan_services(fan_info_t *info)
 {
 	/* Generic error reporter. */
 	int rc = -1;
 	/* slot where we are offering the FAN dbus service. */
 	sd_bus_slot *fan_slot = NULL;
-	const char *fan_object = "/org/openbmc/control/fans";
+	sd_event_source *tick = NULL;
+	sd_event_source *monitor = NULL;
+	const char *fan_object = FAN_OBJECT_ROOT;
+	uint64_t now;
+	int i;
+
+	rc = fan_zones_init(info);
+	if (rc < 0) {
+		fprintf(stderr, "fanctl: Failed to set up cooling zones\n");
+		return rc;
+	}
+	rc = fan_tachs_init(info);
+	if (rc < 0)
+		return rc;
 
 	info->bus = NULL;
 	/* Get a hook onto system bus. */
@@ -363,6 +1642,13 @@ int start_fan_services(fan_info_t *info)
 		return rc;
 	}
 
+	rc = mapper_cache_init(info->bus);
+	if (rc < 0) {
+		fprintf(stderr, "fanctl: Failed to watch bus name changes: %s\n",
+				strerror(-rc));
+		return rc;
+	}
+
 	/* Install the object */
 	rc = sd_bus_add_object_vtable(info->bus,
 			&fan_slot,
@@ -376,6 +1662,20 @@ int start_fan_services(fan_info_t *info)
 		return rc;
 	}
 
+	for (i = 0; i < info->fan_num; i++) {
+		rc = sd_bus_add_object_vtable(info->bus,
+				&info->fans[i].slot,
+				info->fans[i].path,
+				"org.openbmc.Fan",
+				fan_vtable,
+				&info->fans[i]);
+		if (rc < 0) {
+			fprintf(stderr, "fanctl: Failed to add %s to dbus: %s\n",
+					info->fans[i].path, strerror(-rc));
+			return rc;
+		}
+	}
+
 	/* If we had success in adding the providers, request for a bus name. */
 	rc = sd_bus_request_name(info->bus,
 			"org.openbmc.control.Fans", 0);
@@ -385,28 +1685,63 @@ int start_fan_services(fan_info_t *info)
 		return rc;
 	}
 
-	for (;;) {
-		/* Process requests */
-		rc = sd_bus_process(info->bus, NULL);
+	rc = sd_event_default(&info->event);
+	if (rc < 0) {
+		fprintf(stderr, "fanctl: Failed to get event loop: %s\n",
+				strerror(-rc));
+		return rc;
+	}
+
+	rc = sd_bus_attach_event(info->bus, info->event,
+			SD_EVENT_PRIORITY_NORMAL);
+	if (rc < 0) {
+		fprintf(stderr, "fanctl: Failed to attach bus to event loop: %s\n",
+				strerror(-rc));
+		return rc;
+	}
+
+	fan_tach_request(info);
+
+	/* First control pass straight away, then every interval */
+	if (info->zones.num_zones && info->fan_num) {
+		sd_event_now(info->event, CLOCK_MONOTONIC, &now);
+		rc = sd_event_add_time(info->event, &tick, CLOCK_MONOTONIC,
+				now, 0, fan_control_tick, info);
 		if (rc < 0) {
-			fprintf(stderr, "fanctl: Failed to process bus: %s\n",
+			fprintf(stderr, "fanctl: Failed to start control loop: %s\n",
 					strerror(-rc));
-			break;
-		}
-		if (rc > 0) {
-			continue;
+			return rc;
 		}
+	}
 
-		rc = sd_bus_wait(info->bus, (uint64_t) - 1);
+	if (info->fan_num) {
+		sd_event_now(info->event, CLOCK_MONOTONIC, &now);
+		rc = sd_event_add_time(info->event, &monitor, CLOCK_MONOTONIC,
+				now, 0, fan_monitor_tick, info);
 		if (rc < 0) {
-			fprintf(stderr, "fanctl: Failed to wait on bus: %s\n",
-				strerror(-rc));
-			break;
+			fprintf(stderr, "fanctl: Failed to start tach monitor: %s\n",
+					strerror(-rc));
+			return rc;
 		}
 	}
 
+	rc = sd_event_loop(info->event);
+	if (rc < 0)
+		fprintf(stderr, "fanctl: Event loop failed: %s\n",
+				strerror(-rc));
+
+	sd_event_source_unref(tick);
+	sd_event_source_unref(monitor);
+	for (i = 0; i < info->fan_num; i++) {
+		sd_bus_slot_unref(info->fans[i].slot);
+		fan_tach_close(&info->tachs[i]);
+	}
 	sd_bus_slot_unref(fan_slot);
 	sd_bus_unref(info->bus);
+	sd_event_unref(info->event);
+	fan_zones_free(&info->zones);
+	free(info->fans);
+	free(info->tachs);
 
 	return rc;
 }
@@ -435,11 +1770,15 @@ static int parse_argument(int argc, char **argv, fan_info_t *info)
 		{"core_num",    required_argument, 0, 'c'},
 		{"cpu_num",    required_argument, 0, 'p'},
 		{"dimm_num",    required_argument, 0, 'd'},
+		{"zone_config", required_argument, 0, 'z'},
+		{"default_zones", no_argument, 0, 'Z'},
+		{"min_rpm",     required_argument, 0, 'm'},
+		{"rpm_hysteresis", required_argument, 0, 'y'},
 		{0, 0, 0, 0}
 	};
 
 	while (1) {
-		c = getopt_long (argc, argv, "c:d:f:p:", long_options, NULL);
+		c = getopt_long (argc, argv, "c:d:f:m:p:y:z:Z", long_options, NULL);
 
 		/* Detect the end of the options. */
 		if (c == -1)
@@ -474,12 +1813,36 @@ static int parse_argument(int argc, char **argv, fan_info_t *info)
 				return -1;
 			}
 			break;
+		case 'z':
+			info->zone_config = optarg;
+			break;
+		case 'Z':
+			info->default_zones = 1;
+			break;
+		case 'm':
+			info->min_rpm = str_to_int(optarg);
+			if (info->min_rpm == -1) {
+				fprintf(stderr, "fanctl: Wrong min_rpm: %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'y':
+			info->rpm_hysteresis = str_to_int(optarg);
+			if (info->rpm_hysteresis == -1) {
+				fprintf(stderr, "fanctl: Wrong rpm_hysteresis: %s\n",
+						optarg);
+				return -1;
+			}
+			break;
 		default:
 			fprintf(stderr, "fanctl: Wrong argument\n");
 			return -1;
 		}
 	}
 
+	if (!info->zone_config && access(FAN_ZONE_CONFIG, R_OK) == 0)
+		info->zone_config = FAN_ZONE_CONFIG;
+
 	return 0;
 }
 
@@ -489,6 +1852,8 @@ int main(int argc, char **argv)
 	fan_info_t fan_info;
 
 	memset(&fan_info, 0, sizeof(fan_info));
+	fan_info.min_rpm = FAN_MIN_RPM;
+	fan_info.rpm_hysteresis = FAN_RPM_HYSTERESIS;
 	rc = parse_argument(argc, argv, &fan_info);
 	if (rc < 0) {
 		fprintf(stderr, "fanctl: Error parse argument\n");
@@ -0,0 +1,89 @@
+/**
+ * Copyright © 2016 IBM Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string.h>
+#include "fan_monitor.h"
+
+void fan_monitor_init(fan_monitor_t *mon)
+{
+	memset(mon, 0, sizeof(*mon));
+	mon->present = -1;
+	mon->fault = -1;
+}
+
+/* Reading from age samples ago, 0 being the latest */
+int fan_monitor_last(const fan_monitor_t *mon, int age)
+{
+	return mon->history[(mon->head + FAN_TACH_HISTORY - 1 - age) %
+			FAN_TACH_HISTORY];
+}
+
+/*
+ * Record a reading in RPM and re-evaluate the fan. A fan is present once
+ * FAN_MONITOR_SAMPLES readings in a row are spinning. Until then, as many
+ * stopped readings mark it absent; once it has been seen spinning, a
+ * stopped tach is a failed fan rather than a removed one. A present fan
+ * faults once that many readings are below min_rpm, stopped included,
+ * and only clears after that many at or above min_rpm + hysteresis, so a
+ * single bad read or a fan hovering at the threshold does not flap.
+ * Callers skip readings that failed rather than pass 0. Returns which
+ * states changed.
+ */
+int fan_monitor_sample(fan_monitor_t *mon, int rpm, int min_rpm,
+		int hysteresis)
+{
+	int zero = 0, spinning = 0, slow = 0, healthy = 0;
+	int changed = 0;
+	int i, val;
+
+	mon->history[mon->head] = rpm;
+	mon->head = (mon->head + 1) % FAN_TACH_HISTORY;
+	if (mon->count < FAN_TACH_HISTORY)
+		mon->count++;
+	if (mon->count < FAN_MONITOR_SAMPLES)
+		return 0;
+
+	for (i = 0; i < FAN_MONITOR_SAMPLES; i++) {
+		val = fan_monitor_last(mon, i);
+		if (val <= 0)
+			zero++;
+		else
+			spinning++;
+		if (val < min_rpm)
+			slow++;
+		else if (val >= min_rpm + hysteresis)
+			healthy++;
+	}
+
+	if (spinning == FAN_MONITOR_SAMPLES && mon->present != 1) {
+		mon->present = 1;
+		changed |= FAN_PRESENT_CHANGED;
+	} else if (zero == FAN_MONITOR_SAMPLES && mon->present == -1) {
+		mon->present = 0;
+		changed |= FAN_PRESENT_CHANGED;
+	}
+
+	if (mon->present != 1)
+		return changed;
+	if (slow == FAN_MONITOR_SAMPLES && mon->fault != 1) {
+		mon->fault = 1;
+		changed |= FAN_FAULT_CHANGED;
+	} else if (healthy == FAN_MONITOR_SAMPLES && mon->fault != 0) {
+		mon->fault = 0;
+		changed |= FAN_FAULT_CHANGED;
+	}
+
+	return changed;
+}
@@ -0,0 +1,42 @@
+/**
+ * Copyright © 2016 IBM Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __FAN_MONITOR_H__
+#define __FAN_MONITOR_H__
+
+#define FAN_TACH_HISTORY	8
+/* Consecutive samples that must agree before a state changes */
+#define FAN_MONITOR_SAMPLES	3
+
+/* fan_monitor_sample() return bits */
+#define FAN_PRESENT_CHANGED	(1 << 0)
+#define FAN_FAULT_CHANGED	(1 << 1)
+
+typedef struct {
+	/* recent readings in RPM */
+	int history[FAN_TACH_HISTORY];
+	int head;
+	int count;
+	/* 1, 0, or -1 until enough samples have been seen */
+	int present;
+	int fault;
+} fan_monitor_t;
+
+void fan_monitor_init(fan_monitor_t *mon);
+int fan_monitor_sample(fan_monitor_t *mon, int rpm, int min_rpm,
+		int hysteresis);
+int fan_monitor_last(const fan_monitor_t *mon, int age);
+
+#endif
@@ -0,0 +1,171 @@
+/**
+ * Copyright © 2016 IBM Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include "fan_tach.h"
+
+#define HWMON_PATH "/sys/class/hwmon"
+
+/* Leave every fan unmapped, reading its tach over D-Bus */
+void fan_tach_init(fan_tach_t *tachs, int fan_num)
+{
+	int i;
+
+	for (i = 0; i < fan_num; i++) {
+		memset(&tachs[i], 0, sizeof(tachs[i]));
+		tachs[i].fd[FAN_TACH_HIGH] = -1;
+		tachs[i].fd[FAN_TACH_LOW] = -1;
+	}
+}
+
+/*
+ * Map a fan to its hwmon files, e.g. "6-002e", "fan6_input", "fan5_input"
+ * for the Barreleye HWMON_CONFIG entries 'tach/fan0H' and 'tach/fan0L'.
+ * The files are opened on first read.
+ */
+int fan_tach_map(fan_tach_t *tach, const char *instance, const char *high,
+		const char *low)
+{
+	if (strlen(instance) >= FAN_TACH_NAME_LEN ||
+			strlen(high) >= FAN_TACH_NAME_LEN ||
+			strlen(low) >= FAN_TACH_NAME_LEN)
+		return -EINVAL;
+
+	fan_tach_close(tach);
+	strcpy(tach->instance, instance);
+	strcpy(tach->attr[FAN_TACH_HIGH], high);
+	strcpy(tach->attr[FAN_TACH_LOW], low);
+	tach->mapped = 1;
+
+	return 0;
+}
+
+/* Find /sys/class/hwmon/hwmonN whose device is the given instance */
+static int hwmon_find(const char *instance, char *dir, size_t len)
+{
+	char link[PATH_MAX], target[PATH_MAX];
+	struct dirent *entry;
+	const char *name;
+	DIR *d;
+	int rc = -ENOENT;
+
+	d = opendir(HWMON_PATH);
+	if (!d)
+		return -errno;
+	while ((entry = readdir(d))) {
+		if (entry->d_name[0] == '.')
+			continue;
+		snprintf(link, sizeof(link), HWMON_PATH "/%s/device",
+				entry->d_name);
+		if (!realpath(link, target))
+			continue;
+		name = strrchr(target, '/');
+		name = name ? name + 1 : target;
+		if (strcmp(name, instance) == 0) {
+			snprintf(dir, len, HWMON_PATH "/%s", entry->d_name);
+			rc = 0;
+			break;
+		}
+	}
+	closedir(d);
+
+	return rc;
+}
+
+static int fan_tach_open(fan_tach_t *tach)
+{
+	char dir[PATH_MAX], path[PATH_MAX + FAN_TACH_NAME_LEN];
+	int i, rc;
+
+	rc = hwmon_find(tach->instance, dir, sizeof(dir));
+	if (rc < 0)
+		return rc;
+	for (i = 0; i < FAN_TACH_HALVES; i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, tach->attr[i]);
+		tach->fd[i] = open(path, O_RDONLY | O_CLOEXEC);
+		if (tach->fd[i] < 0) {
+			rc = -errno;
+			fprintf(stderr, "fanctl: Failed to open %s: %s\n",
+					path, strerror(-rc));
+			fan_tach_close(tach);
+			return rc;
+		}
+	}
+
+	return 0;
+}
+
+static int read_attr(int fd, int *val)
+{
+	char buf[32];
+	ssize_t len;
+	char *end;
+
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len < 0)
+		return -errno;
+	if (len == 0)
+		return -ENODATA;
+	buf[len] = '\0';
+	*val = strtol(buf, &end, 10);
+	if (end == buf)
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * Read both tach halves back to back from the cached fds. The fds are
+ * dropped on any error so the hwmon device is looked up again next time,
+ * in case it was rebound under a new hwmonN.
+ */
+int fan_tach_read(fan_tach_t *tach, int *high, int *low)
+{
+	int rc;
+
+	if (!tach->mapped)
+		return -ENOENT;
+	if (tach->fd[FAN_TACH_HIGH] < 0) {
+		rc = fan_tach_open(tach);
+		if (rc < 0)
+			return rc;
+	}
+
+	rc = read_attr(tach->fd[FAN_TACH_HIGH], high);
+	if (rc == 0)
+		rc = read_attr(tach->fd[FAN_TACH_LOW], low);
+	if (rc < 0)
+		fan_tach_close(tach);
+
+	return rc;
+}
+
+void fan_tach_close(fan_tach_t *tach)
+{
+	int i;
+
+	for (i = 0; i < FAN_TACH_HALVES; i++) {
+		if (tach->fd[i] >= 0)
+			close(tach->fd[i]);
+		tach->fd[i] = -1;
+	}
+}
@@ -0,0 +1,46 @@
+/**
+ * Copyright © 2016 IBM Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __FAN_TACH_H__
+#define __FAN_TACH_H__
+
+#define FAN_TACH_NAME_LEN	32
+
+/* Tach halves, in the order fan_tach_read returns them */
+enum {
+	FAN_TACH_HIGH,
+	FAN_TACH_LOW,
+	FAN_TACH_HALVES,
+};
+
+/*
+ * hwmon files behind one fan's tach. The hwmon device is named by its
+ * instance ("6-002e"), the same key HWMON_CONFIG uses, because the
+ * hwmonN index is not stable across boots.
+ */
+typedef struct {
+	int mapped;
+	char instance[FAN_TACH_NAME_LEN];
+	char attr[FAN_TACH_HALVES][FAN_TACH_NAME_LEN];
+	int fd[FAN_TACH_HALVES];
+} fan_tach_t;
+
+void fan_tach_init(fan_tach_t *tachs, int fan_num);
+int fan_tach_map(fan_tach_t *tach, const char *instance, const char *high,
+		const char *low);
+int fan_tach_read(fan_tach_t *tach, int *high, int *low);
+void fan_tach_close(fan_tach_t *tach);
+
+#endif
@@ -0,0 +1,389 @@
+/**
+ * Copyright © 2016 IBM Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fan_zone.h"
+
+#define TEMP_SENSOR_PATH	"/org/openbmc/sensors/temperature"
+#define FAN_ZONE_INTERVAL_MS	5000
+#define FAN_ZONE_MIN_PWM	80
+
+/*
+ * Zone config, one statement per line, '#' for comments:
+ *
+ *   interval <ms>
+ *   zone <id> fans <n>[,<n>...] [min <pwm>] [max <pwm>]
+ *   pid <zone> <sensors> <setpoint> <kp> <ki> <kd>
+ *   step <zone> <sensors> <temp>:<pwm>[,<temp>:<pwm>...]
+ *
+ * <sensors> is "cpu" (every core of every cpu), "cpuN" (the cores of cpu
+ * N), "dimm" (every dimm), a name under /org/openbmc/sensors/temperature
+ * such as "ambient", or a full object path.
+ */
+
+static int add_sensor(fan_input_t *input, const char *path)
+{
+	char **sensors;
+
+	sensors = realloc(input->sensors,
+			(input->num_sensors + 1) * sizeof(char *));
+	if (!sensors)
+		return -1;
+	input->sensors = sensors;
+	input->sensors[input->num_sensors] = strdup(path);
+	if (!input->sensors[input->num_sensors])
+		return -1;
+	input->num_sensors++;
+
+	return 0;
+}
+
+static int add_cores(fan_input_t *input, int cpu, const fan_counts_t *counts)
+{
+	char path[256];
+	int core;
+
+	for (core = 0; core < counts->core_num; core++) {
+		snprintf(path, sizeof(path), TEMP_SENSOR_PATH "/cpu%d/core%d",
+				cpu, core);
+		if (add_sensor(input, path) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int expand_sensors(fan_input_t *input, const char *sel,
+		const fan_counts_t *counts)
+{
+	char path[256];
+	int cpu, dimm;
+	int rc = 0;
+
+	if (strcmp(sel, "cpu") == 0) {
+		for (cpu = 0; cpu < counts->cpu_num && !rc; cpu++)
+			rc = add_cores(input, cpu, counts);
+	} else if (sscanf(sel, "cpu%d", &cpu) == 1) {
+		rc = add_cores(input, cpu, counts);
+	} else if (strcmp(sel, "dimm") == 0) {
+		for (dimm = 0; dimm < counts->dimm_num && !rc; dimm++) {
+			snprintf(path, sizeof(path), TEMP_SENSOR_PATH "/dimm%d",
+					dimm);
+			rc = add_sensor(input, path);
+		}
+	} else if (sel[0] == '/') {
+		rc = add_sensor(input, sel);
+	} else {
+		snprintf(path, sizeof(path), TEMP_SENSOR_PATH "/%s", sel);
+		rc = add_sensor(input, path);
+	}
+
+	if (rc < 0 || input->num_sensors == 0) {
+		fprintf(stderr, "fanctl: No sensors for '%s'\n", sel);
+		return -1;
+	}
+	return 0;
+}
+
+static fan_zone_t *add_zone(fan_zones_t *zones, int id)
+{
+	fan_zone_t *zone = fan_zones_find(zones, id);
+
+	if (zone)
+		return zone;
+	zone = realloc(zones->zones, (zones->num_zones + 1) * sizeof(*zone));
+	if (!zone)
+		return NULL;
+	zones->zones = zone;
+	zone = &zones->zones[zones->num_zones++];
+	memset(zone, 0, sizeof(*zone));
+	zone->id = id;
+	zone->min_pwm = FAN_ZONE_MIN_PWM;
+	zone->max_pwm = FAN_PWM_MAX;
+	zone->pwm = -1;
+
+	return zone;
+}
+
+static fan_input_t *add_input(fan_zones_t *zones, int id,
+		fan_input_type_t type)
+{
+	fan_zone_t *zone = add_zone(zones, id);
+	fan_input_t *input;
+
+	if (!zone || zone->num_inputs == FAN_ZONE_MAX_INPUTS)
+		return NULL;
+	input = &zone->inputs[zone->num_inputs++];
+	memset(input, 0, sizeof(*input));
+	input->type = type;
+
+	return input;
+}
+
+static int parse_fans(const char *list, int zone_id,
+		const fan_counts_t *counts, int *fan_zone)
+{
+	char *copy = strdup(list);
+	char *tok, *save = NULL;
+	int fan;
+
+	if (!copy)
+		return -1;
+	for (tok = strtok_r(copy, ",", &save); tok;
+			tok = strtok_r(NULL, ",", &save)) {
+		fan = atoi(tok);
+		if (fan < 0 || fan >= counts->fan_num) {
+			fprintf(stderr, "fanctl: No fan%d for zone %d\n",
+					fan, zone_id);
+			free(copy);
+			return -1;
+		}
+		fan_zone[fan] = zone_id;
+	}
+	free(copy);
+
+	return 0;
+}
+
+static int parse_steps(fan_input_t *input, const char *list)
+{
+	const char *p = list;
+	int n;
+
+	while (*p) {
+		fan_step_t *step;
+
+		if (input->num_steps == FAN_ZONE_MAX_STEPS)
+			return -1;
+		step = &input->steps[input->num_steps];
+		if (sscanf(p, "%lf:%d%n", &step->temp, &step->pwm, &n) != 2)
+			return -1;
+		if (input->num_steps &&
+				step->temp <= input->steps[input->num_steps - 1].temp)
+			return -1;
+		input->num_steps++;
+		p += n;
+		if (*p == ',')
+			p++;
+		else if (*p)
+			return -1;
+	}
+
+	return input->num_steps ? 0 : -1;
+}
+
+static int parse_line(fan_zones_t *zones, char *line,
+		const fan_counts_t *counts, int *fan_zone)
+{
+	char keyword[16], sel[256], rest[256];
+	int id, n;
+	fan_input_t *input;
+
+	if (sscanf(line, "%15s", keyword) != 1)
+		return 0;
+
+	if (strcmp(keyword, "interval") == 0) {
+		if (sscanf(line, "%*s %d", &zones->interval_ms) != 1 ||
+				zones->interval_ms <= 0)
+			return -1;
+		return 0;
+	}
+	if (strcmp(keyword, "zone") == 0) {
+		fan_zone_t *zone;
+		char *opt;
+
+		if (sscanf(line, "%*s %d fans %255s%n", &id, sel, &n) != 2)
+			return -1;
+		zone = add_zone(zones, id);
+		if (!zone || parse_fans(sel, id, counts, fan_zone) < 0)
+			return -1;
+		if ((opt = strstr(line + n, "min ")))
+			zone->min_pwm = atoi(opt + 4);
+		if ((opt = strstr(line + n, "max ")))
+			zone->max_pwm = atoi(opt + 4);
+		return 0;
+	}
+	if (strcmp(keyword, "pid") == 0) {
+		double setpoint, kp, ki, kd;
+
+		if (sscanf(line, "%*s %d %255s %lf %lf %lf %lf",
+				&id, sel, &setpoint, &kp, &ki, &kd) != 6)
+			return -1;
+		input = add_input(zones, id, FAN_INPUT_PID);
+		if (!input)
+			return -1;
+		input->setpoint = setpoint;
+		input->kp = kp;
+		input->ki = ki;
+		input->kd = kd;
+		return expand_sensors(input, sel, counts);
+	}
+	if (strcmp(keyword, "step") == 0) {
+		if (sscanf(line, "%*s %d %255s %255s", &id, sel, rest) != 3)
+			return -1;
+		input = add_input(zones, id, FAN_INPUT_STEP);
+		if (!input || parse_steps(input, rest) < 0)
+			return -1;
+		return expand_sensors(input, sel, counts);
+	}
+
+	return -1;
+}
+
+/*
+ * Load zones from path. fan_zone[] (fan_num entries) receives each fan's
+ * zone; fans not named by any zone stay under manual control.
+ */
+int fan_zones_load(fan_zones_t *zones, const char *path,
+		const fan_counts_t *counts, int *fan_zone)
+{
+	char line[512];
+	char *comment;
+	int lineno = 0;
+	int i;
+	FILE *fp;
+
+	memset(zones, 0, sizeof(*zones));
+	zones->interval_ms = FAN_ZONE_INTERVAL_MS;
+	for (i = 0; i < counts->fan_num; i++)
+		fan_zone[i] = FAN_ZONE_MANUAL;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+	while (fgets(line, sizeof(line), fp)) {
+		lineno++;
+		comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+		if (parse_line(zones, line, counts, fan_zone) < 0) {
+			fprintf(stderr, "fanctl: %s:%d: invalid zone config\n",
+					path, lineno);
+			fclose(fp);
+			fan_zones_free(zones);
+			return -1;
+		}
+	}
+	fclose(fp);
+
+	return 0;
+}
+
+/*
+ * Built-in zones for --default_zones without a config file: every fan is
+ * in zone 0, driven by PID loops on the CPU cores and DIMMs and by a
+ * stepwise curve on the ambient sensor.
+ */
+int fan_zones_default(fan_zones_t *zones, const fan_counts_t *counts,
+		int *fan_zone)
+{
+	char line[128];
+	int i;
+
+	memset(zones, 0, sizeof(*zones));
+	zones->interval_ms = FAN_ZONE_INTERVAL_MS;
+	for (i = 0; i < counts->fan_num; i++)
+		fan_zone[i] = 0;
+	if (!add_zone(zones, 0))
+		return -1;
+
+	if (counts->cpu_num && counts->core_num) {
+		strcpy(line, "pid 0 cpu 85 8 0.5 0");
+		if (parse_line(zones, line, counts, fan_zone) < 0)
+			goto fail;
+	}
+	if (counts->dimm_num) {
+		strcpy(line, "pid 0 dimm 75 8 0.5 0");
+		if (parse_line(zones, line, counts, fan_zone) < 0)
+			goto fail;
+	}
+	strcpy(line, "step 0 ambient 25:80,30:110,35:150,40:200,45:255");
+	if (parse_line(zones, line, counts, fan_zone) < 0)
+		goto fail;
+
+	return 0;
+
+fail:
+	fan_zones_free(zones);
+	return -1;
+}
+
+void fan_zones_free(fan_zones_t *zones)
+{
+	int i, j, k;
+
+	for (i = 0; i < zones->num_zones; i++) {
+		fan_zone_t *zone = &zones->zones[i];
+		for (j = 0; j < zone->num_inputs; j++) {
+			for (k = 0; k < zone->inputs[j].num_sensors; k++)
+				free(zone->inputs[j].sensors[k]);
+			free(zone->inputs[j].sensors);
+		}
+	}
+	free(zones->zones);
+	zones->zones = NULL;
+	zones->num_zones = 0;
+}
+
+fan_zone_t *fan_zones_find(fan_zones_t *zones, int id)
+{
+	int i;
+
+	for (i = 0; i < zones->num_zones; i++)
+		if (zones->zones[i].id == id)
+			return &zones->zones[i];
+	return NULL;
+}
+
+/* PWM an input asks for at temp; dt is seconds since the last update */
+int fan_input_update(fan_input_t *input, double temp, double dt)
+{
+	double error, output;
+	int i, pwm;
+
+	if (input->type == FAN_INPUT_STEP) {
+		pwm = 0;
+		for (i = 0; i < input->num_steps; i++) {
+			if (temp < input->steps[i].temp)
+				break;
+			pwm = input->steps[i].pwm;
+		}
+		return pwm;
+	}
+
+	/* Positive error means too hot, which asks for more airflow */
+	error = temp - input->setpoint;
+	output = input->kp * error;
+	if (input->primed && dt > 0)
+		output += input->kd * (error - input->last_error) / dt;
+
+	/* Only integrate while the output is not saturated (anti-windup) */
+	if (dt > 0) {
+		double integral = input->integral + error * dt;
+		double total = output + input->ki * integral;
+		if (total >= 0 && total <= FAN_PWM_MAX)
+			input->integral = integral;
+	}
+	output += input->ki * input->integral;
+	input->last_error = error;
+	input->primed = 1;
+
+	if (output < 0)
+		return 0;
+	if (output > FAN_PWM_MAX)
+		return FAN_PWM_MAX;
+	return (int)(output + 0.5);
+}
@@ -0,0 +1,91 @@
+/**
+ * Copyright © 2016 IBM Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __FAN_ZONE_H__
+#define __FAN_ZONE_H__
+
+#define FAN_ZONE_MAX_INPUTS	8
+#define FAN_ZONE_MAX_STEPS	16
+#define FAN_PWM_MAX		255
+
+/* Fans not under automatic control, e.g. after setSpeed */
+#define FAN_ZONE_MANUAL		-1
+
+typedef enum {
+	FAN_INPUT_PID,
+	FAN_INPUT_STEP,
+} fan_input_type_t;
+
+typedef struct {
+	double temp;
+	int pwm;
+} fan_step_t;
+
+/*
+ * One temperature input of a zone: a set of sensors, of which the hottest
+ * valid reading drives either a PID loop towards a setpoint or a stepwise
+ * temperature to PWM curve.
+ */
+typedef struct {
+	fan_input_type_t type;
+	int num_sensors;
+	char **sensors;
+	/* PID */
+	double setpoint;
+	double kp;
+	double ki;
+	double kd;
+	double integral;
+	double last_error;
+	int primed;
+	/* stepwise */
+	int num_steps;
+	fan_step_t steps[FAN_ZONE_MAX_STEPS];
+} fan_input_t;
+
+typedef struct {
+	int id;
+	int min_pwm;
+	int max_pwm;
+	int num_inputs;
+	fan_input_t inputs[FAN_ZONE_MAX_INPUTS];
+	/* Last PWM the zone asked for, -1 before the first pass */
+	int pwm;
+} fan_zone_t;
+
+typedef struct {
+	int interval_ms;
+	int num_zones;
+	fan_zone_t *zones;
+} fan_zones_t;
+
+/* Sensor counts from the command line, used to expand "cpu" and "dimm" */
+typedef struct {
+	int fan_num;
+	int cpu_num;
+	int core_num;
+	int dimm_num;
+} fan_counts_t;
+
+int fan_zones_load(fan_zones_t *zones, const char *path,
+		const fan_counts_t *counts, int *fan_zone);
+int fan_zones_default(fan_zones_t *zones, const fan_counts_t *counts,
+		int *fan_zone);
+void fan_zones_free(fan_zones_t *zones);
+fan_zone_t *fan_zones_find(fan_zones_t *zones, int id);
+
+int fan_input_update(fan_input_t *input, double temp, double dt);
+
+#endif
@@ -3,6 +3,7 @@
 #include <openbmc_intf.h>
 #include <openbmc.h>
 #include <gpio.h>
+#include <gpio_event.h>
 
 static const gchar* dbus_object_path = "/org/openbmc/control";
 static const gchar* object_name = "/org/openbmc/control/checkstop0";
@@ -11,6 +12,13 @@ static const gchar* dbus_name = "org.openbmc.control.Checkstop";
 static GDBusObjectManagerServer *manager = NULL;
 
 GPIO checkstop = (GPIO){ "CHECKSTOP" };
+static GpioEventLine checkstop_line;
+
+// Need to wait at least 10s for the SBE to gather failure data. Also the
+// user may be monitoring the system and reset the system themselves. So
+// only act on a checkstop that has held for an arbitrary 30s; the same
+// window filters the flicker the line shows during power on/off.
+static const guint CHECKSTOP_SETTLE_MS = 30000;
 
 static bool
 is_host_booted(GDBusConnection* connection)
@@ -53,85 +61,46 @@ is_host_booted(GDBusConnection* connection)
     return false;
 }
 
-static gboolean
-chassis_reboot(gpointer connection)
+static void
+chassis_reboot(GDBusConnection* connection)
 {
-    int rc = 0;
-    uint8_t gpio = 0;
     GDBusProxy *proxy;
     GError *error;
     GVariant *parm = NULL;
     GVariant *result = NULL;
 
-    // The gpio line may flicker during power on/off, so check that the value
-    // is still 0 (checkstopped) and that host is booted in order to reboot
-    rc = gpio_open(&checkstop);
-    if (rc != GPIO_OK) {
-        return FALSE;
-    }
-    rc = gpio_read(&checkstop, &gpio);
-    if (rc != GPIO_OK) {
-        gpio_close(&checkstop);
-        return FALSE;
-    }
-    gpio_close(&checkstop);
-    if ((!gpio) && (is_host_booted(connection)))
-    {
-        printf("Host Checkstop, rebooting host\n");
-        error = NULL;
-        proxy = g_dbus_proxy_new_sync((GDBusConnection*)connection,
-            G_DBUS_PROXY_FLAGS_NONE,
-            NULL, /* GDBusInterfaceInfo* */
-            "org.openbmc.control.Chassis", /* name */
-            "/org/openbmc/control/chassis0", /* object path */
-            "org.openbmc.control.Chassis", /* interface name */
-            NULL, /* GCancellable */
-            &error);
-        g_assert_no_error(error);
-
-        error = NULL;
-        result = g_dbus_proxy_call_sync(proxy,
-            "reboot",
-            parm,
-            G_DBUS_CALL_FLAGS_NONE,
-            -1,
-            NULL,
-            &error);
-        g_assert_no_error(error);
-    }
+    printf("Host Checkstop, rebooting host\n");
+    error = NULL;
+    proxy = g_dbus_proxy_new_sync(connection,
+        G_DBUS_PROXY_FLAGS_NONE,
+        NULL, /* GDBusInterfaceInfo* */
+        "org.openbmc.control.Chassis", /* name */
+        "/org/openbmc/control/chassis0", /* object path */
+        "org.openbmc.control.Chassis", /* interface name */
+        NULL, /* GCancellable */
+        &error);
+    g_assert_no_error(error);
 
-    return FALSE;
+    error = NULL;
+    result = g_dbus_proxy_call_sync(proxy,
+        "reboot",
+        parm,
+        G_DBUS_CALL_FLAGS_NONE,
+        -1,
+        NULL,
+        &error);
+    g_assert_no_error(error);
 }
 
-static gboolean
-on_checkstop_interrupt(GIOChannel *channel,
-        GIOCondition condition,
-        gpointer connection)
+static void
+on_checkstop_event(const GpioEvent* event, gpointer connection)
 {
-    GError *error = 0;
-    gsize bytes_read = 0;
-    gchar buf[2];
-    buf[1] = '\0';
-
-    g_io_channel_seek_position( channel, 0, G_SEEK_SET, 0 );
-    g_io_channel_read_chars(channel,
-            buf, 1,
-            &bytes_read,
-            &error );
-    printf("checkstop gpio: %s\n",buf);
-
-    if(checkstop.irq_inited) {
-        // Need to wait at least 10s for the SBE to gather failure data.
-        // Also the user may be monitoring the system and reset the system
-        // themselves. So wait an arbitrary time of 30s (and check that the
-        // gpio value is still 0) before issuing reboot.
-        g_timeout_add(30000, chassis_reboot, connection);
-    }
-    else {
-        checkstop.irq_inited = true;
-    }
+    printf("checkstop gpio: %d\n", event->value);
 
-    return TRUE;
+    if ((!event->value) && (is_host_booted(connection)))
+    {
+        chassis_reboot(connection);
+    }
 }
 
 static void
@@ -150,7 +119,8 @@ on_bus_acquired(GDBusConnection *connection,
 
     rc = gpio_init(connection, &checkstop);
     if (rc == GPIO_OK) {
-        rc = gpio_open_interrupt(&checkstop, on_checkstop_interrupt, connection);
+        rc = gpio_event_open(&checkstop_line, &checkstop, 0,
+                CHECKSTOP_SETTLE_MS, on_checkstop_event, connection);
     }
     if (rc != GPIO_OK) {
         printf("ERROR Checkstop: GPIO setup (rc=%d)\n", rc);
@@ -3,22 +3,76 @@
 #include <errno.h>
 #include <string.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
 #include <systemd/sd-bus.h>
-
-static int led_stable_state_function(const char *, const char *);
-static int led_default_blink(const char *, const char *);
-static int read_led(const char *, const char *, void *, const size_t);
-static int led_custom_blink(const char *, sd_bus_message *);
+#include <systemd/sd-event.h>
+#include "led_pattern.h"
 
 /*
  * These are control files that are present for each led under
  *'/sys/class/leds/<led_name>/' which are used to trigger action
  * on the respective leds by writing predefined data.
  */
-const char *power_ctrl = "brightness";
-const char *blink_ctrl = "trigger";
-const char *duty_on = "delay_on";
-const char *duty_off = "delay_off";
+enum
+{
+	LED_BRIGHTNESS,
+	LED_TRIGGER,
+	LED_DELAY_ON,
+	LED_DELAY_OFF,
+	LED_CTRL_MAX,
+};
+
+static const char *led_ctrl_files[LED_CTRL_MAX] =
+{
+	[LED_BRIGHTNESS] = "brightness",
+	[LED_TRIGGER] = "trigger",
+	[LED_DELAY_ON] = "delay_on",
+	[LED_DELAY_OFF] = "delay_off",
+};
+
+#define LED_NAME_LEN	256
+#define LED_VALUE_LEN	32
+
+/*
+ * ------------------------------------------------------------------
+ * One LED under /sys/class/leds. Control files are opened on first
+ * use and kept open, and the last value written to each one is kept
+ * in 'shadow' so that writes which would not change anything are
+ * skipped and the state can be answered without touching sysfs.
+ * An empty shadow means the value is not known.
+ * ------------------------------------------------------------------
+ */
+typedef struct led
+{
+	struct led *next;
+	char name[LED_NAME_LEN];
+	/* Slot of the /org/openbmc/control/led/<name> object */
+	sd_bus_slot *slot;
+	int fd[LED_CTRL_MAX];
+	char shadow[LED_CTRL_MAX][LED_VALUE_LEN];
+
+	/* Software pattern being played, see led_pattern_start() */
+	led_pattern_t pattern;
+	int step;
+	uint64_t deadline;
+	/* Position in the pattern heap, -1 when no pattern is playing */
+	int heap_index;
+} led_t;
+
+/* All LEDs that have a dbus object */
+static led_t *led_list_head = NULL;
+
+static const char *led_dbus_root = "/org/openbmc/control/led";
+
+static int led_stable_state_function(led_t *, const char *);
+static int led_default_blink(led_t *, const char *);
+static int read_led(led_t *, int, void *, const size_t);
+static int led_custom_blink(led_t *, sd_bus_message *);
 
 /*
  * --------------------------------------------------
@@ -40,46 +94,423 @@ get_led_name(const char *dbus_path)
 	return led_name;
 }
 
+/*
+ * ------------------------------------------------------------
+ * Returns the cached fd for a control file, opening it if needed
+ * ------------------------------------------------------------
+ */
+static int
+led_ctrl_fd(led_t *led, int ctrl)
+{
+	/* To get /sys/class/leds/<name>/<control file> */
+	char led_path[128] = {0};
+	int len = 0;
+
+	if(led->fd[ctrl] >= 0)
+	{
+		return led->fd[ctrl];
+	}
+
+	len = snprintf(led_path, sizeof(led_path),
+			"/sys/class/leds/%s/%s", led->name, led_ctrl_files[ctrl]);
+	if(len >= sizeof(led_path))
+	{
+		fprintf(stderr, "Error. LED path is too long. :[%d]\n",len);
+		return -1;
+	}
+
+	led->fd[ctrl] = open(led_path, O_RDWR | O_CLOEXEC);
+	if(led->fd[ctrl] < 0)
+	{
+		fprintf(stderr,"Error:[%s] opening:[%s]\n",strerror(errno),led_path);
+	}
+	return led->fd[ctrl];
+}
+
+static void
+led_ctrl_close(led_t *led, int ctrl)
+{
+	if(led->fd[ctrl] >= 0)
+	{
+		close(led->fd[ctrl]);
+		led->fd[ctrl] = -1;
+	}
+	led->shadow[ctrl][0] = '\0';
+}
+
 /*
  * -------------------------------------------------------------------------
  * Writes the 'on / off / blink' trigger to leds.
  * -------------------------------------------------------------------------
  */
 int
-write_to_led(const char *name, const char *ctrl_file, const char *value)
+write_to_led(led_t *led, int ctrl, const char *value)
+{
+	int fd = -1;
+	int i = 0;
+	ssize_t len = 0;
+
+	/* Nothing to do if the file already holds this value */
+	if(strcmp(led->shadow[ctrl], value) == 0)
+	{
+		return 0;
+	}
+
+	fd = led_ctrl_fd(led, ctrl);
+	if(fd < 0)
+	{
+		return -1;
+	}
+
+	len = pwrite(fd, value, strlen(value), 0);
+	if(len != strlen(value))
+	{
+		fprintf(stderr, "Error:[%s] writing to :[%s/%s]\n",strerror(errno),
+				led->name, led_ctrl_files[ctrl]);
+		/* Reopen next time, the attribute may have been recreated */
+		led_ctrl_close(led, ctrl);
+		return -1;
+	}
+
+	if(ctrl == LED_TRIGGER)
+	{
+		/*
+		 * Changing the trigger removes and recreates the delay_* files
+		 * and, when leaving a trigger, turns the LED off.
+		 */
+		for(i = LED_DELAY_ON; i <= LED_DELAY_OFF; i++)
+		{
+			led_ctrl_close(led, i);
+		}
+		strcpy(led->shadow[LED_BRIGHTNESS],
+				strcmp(value, "none") == 0 ? "0" : "");
+	}
+
+	snprintf(led->shadow[ctrl], sizeof(led->shadow[ctrl]), "%s", value);
+	return 0;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Software pattern engine. LEDs playing a pattern sit in a min-heap keyed
+ * on the deadline of their current step, and one timerfd is armed for the
+ * earliest deadline of all of them. Each expiry only touches the LEDs that
+ * are due, so the cost does not grow with the number of LEDs playing.
+ * Deadlines advance by step duration rather than from 'now' so patterns
+ * do not drift, and LEDs started together stay in step.
+ * ------------------------------------------------------------------------
+ */
+static int led_timer_fd = -1;
+static led_t **led_heap = NULL;
+static int led_heap_len = 0;
+static int led_heap_size = 0;
+
+static uint64_t
+led_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void
+led_heap_swap(int a, int b)
+{
+	led_t *tmp = led_heap[a];
+
+	led_heap[a] = led_heap[b];
+	led_heap[b] = tmp;
+	led_heap[a]->heap_index = a;
+	led_heap[b]->heap_index = b;
+}
+
+static void
+led_heap_up(int i)
+{
+	while(i > 0 && led_heap[(i-1)/2]->deadline > led_heap[i]->deadline)
+	{
+		led_heap_swap(i, (i-1)/2);
+		i = (i-1)/2;
+	}
+}
+
+static void
+led_heap_down(int i)
+{
+	int child = 0;
+
+	while((child = 2*i + 1) < led_heap_len)
+	{
+		if(child + 1 < led_heap_len &&
+				led_heap[child+1]->deadline < led_heap[child]->deadline)
+		{
+			child++;
+		}
+		if(led_heap[i]->deadline <= led_heap[child]->deadline)
+		{
+			break;
+		}
+		led_heap_swap(i, child);
+		i = child;
+	}
+}
+
+static int
+led_heap_push(led_t *led)
+{
+	led_t **heap = NULL;
+
+	if(led_heap_len == led_heap_size)
+	{
+		heap = realloc(led_heap, (led_heap_size + 8) * sizeof(*heap));
+		if(heap == NULL)
+		{
+			return -1;
+		}
+		led_heap = heap;
+		led_heap_size += 8;
+	}
+	led->heap_index = led_heap_len++;
+	led_heap[led->heap_index] = led;
+	led_heap_up(led->heap_index);
+	return 0;
+}
+
+static void
+led_heap_remove(led_t *led)
+{
+	int i = led->heap_index;
+
+	led->heap_index = -1;
+	if(i != --led_heap_len)
+	{
+		led_heap[i] = led_heap[led_heap_len];
+		led_heap[i]->heap_index = i;
+		led_heap_up(i);
+		led_heap_down(led_heap[i]->heap_index);
+	}
+}
+
+/* Arms the timer for the earliest deadline, or disarms it */
+static void
+led_timer_arm(void)
+{
+	struct itimerspec its;
+	uint64_t deadline = 0;
+
+	if(led_timer_fd < 0)
+	{
+		return;
+	}
+
+	memset(&its, 0, sizeof(its));
+	if(led_heap_len)
+	{
+		deadline = led_heap[0]->deadline;
+		its.it_value.tv_sec = deadline / 1000;
+		its.it_value.tv_nsec = (deadline % 1000) * 1000000;
+	}
+	if(timerfd_settime(led_timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+	{
+		fprintf(stderr, "Error:[%s] arming LED pattern timer\n",
+				strerror(errno));
+	}
+}
+
+static void
+led_pattern_apply(led_t *led)
+{
+	char value[LED_VALUE_LEN] = {0};
+
+	snprintf(value, sizeof(value), "%d",
+			led->pattern.steps[led->step].brightness);
+	if(write_to_led(led, LED_BRIGHTNESS, value) < 0)
+	{
+		fprintf(stderr, "Error driving LED pattern:[%s]\n", led->name);
+	}
+}
+
+/*
+ * -------------------------------------------------------------------
+ * Stops any pattern playing on the LED, leaving it as it is. Called
+ * before every other LED operation so they take over cleanly.
+ * -------------------------------------------------------------------
+ */
+static void
+led_pattern_stop(led_t *led)
+{
+	if(led->heap_index >= 0)
+	{
+		led_heap_remove(led);
+		led_timer_arm();
+	}
+	led_pattern_free(&led->pattern);
+}
+
+/*
+ * --------------------------------------------------------------------
+ * Starts playing a pattern on the LED, which takes ownership of it.
+ * 'start' is the time of the first step so that a group can be started
+ * in phase.
+ * --------------------------------------------------------------------
+ */
+static int
+led_pattern_start(led_t *led, led_pattern_t *pattern, uint64_t start)
 {
-	/* Generic error reporter. */
 	int rc = -1;
 
-	/* To get /sys/class/leds/<name>/<control file> */
-	char led_path[128] = {0};
+	led_pattern_stop(led);
 
-	int len = 0;
-	len = snprintf(led_path, sizeof(led_path),
-			"/sys/class/leds/%s/%s",name, ctrl_file);
-	if(len >= sizeof(led_path))
+	if(led_timer_fd < 0)
 	{
-		fprintf(stderr, "Error. LED path is too long. :[%d]\n",len);
+		fprintf(stderr, "LED pattern engine is not running\n");
+		led_pattern_free(pattern);
 		return rc;
 	}
 
-	FILE *fp = fopen(led_path,"w");
-	if(fp == NULL)
+	/* Patterns drive brightness directly, so no kernel trigger */
+	rc = write_to_led(led, LED_TRIGGER, "none");
+	if(rc < 0)
 	{
-		fprintf(stderr,"Error:[%s] opening:[%s]\n",strerror(errno),led_path);
+		led_pattern_free(pattern);
+		return rc;
+	}
+
+	led->pattern = *pattern;
+	memset(pattern, 0, sizeof(*pattern));
+	led->step = 0;
+	led->deadline = start + led->pattern.steps[0].duration_ms;
+	led_pattern_apply(led);
+
+	rc = led_heap_push(led);
+	if(rc < 0)
+	{
+		led_pattern_free(&led->pattern);
 		return rc;
 	}
+	led_timer_arm();
+	return 0;
+}
+
+static int
+led_timer_handler(sd_event_source *es, int fd, uint32_t revents,
+		void *userdata)
+{
+	uint64_t expirations = 0;
+	uint64_t now = led_now_ms();
+	led_t *led = NULL;
+
+	/* Only drains the fd, the heap says what is due */
+	if(read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+	{
+		fprintf(stderr, "Error:[%s] reading LED pattern timer\n",
+				strerror(errno));
+	}
+
+	while(led_heap_len && led_heap[0]->deadline <= now)
+	{
+		led = led_heap[0];
+		if(++led->step == led->pattern.num_steps)
+		{
+			if(!led->pattern.repeat)
+			{
+				/* Done, the LED stays at the last step */
+				led_heap_remove(led);
+				led_pattern_free(&led->pattern);
+				continue;
+			}
+			led->step = 0;
+		}
+
+		led_pattern_apply(led);
+		led->deadline += led->pattern.steps[led->step].duration_ms;
+		/* Resync rather than replay missed steps after a stall */
+		if(led->deadline <= now)
+		{
+			led->deadline = now + led->pattern.steps[led->step].duration_ms;
+		}
+		led_heap_down(0);
+	}
+
+	led_timer_arm();
+	return 0;
+}
+
+/*
+ * -------------------------------------------------------------------
+ * Builds the pattern asked for by PlayPattern, PlayMorse or
+ * PlaySequence from the arguments of the method call.
+ * -------------------------------------------------------------------
+ */
+static int
+led_pattern_from_msg(sd_bus_message *msg, const char *led_function,
+		led_pattern_t *pattern)
+{
+	int rc = -1;
+	int repeat = 0;
+	const char *name = NULL;
+	uint8_t brightness = 0;
+	uint32_t duration_ms = 0;
 
-	rc = fwrite(value, strlen(value), 1, fp);
-	if(rc != 1)
+	memset(pattern, 0, sizeof(*pattern));
+
+	if(strcmp(led_function, "PlayPattern") == 0)
+	{
+		rc = sd_bus_message_read(msg, "s", &name);
+		if(rc >= 0)
+		{
+			rc = led_pattern_builtin(pattern, name);
+		}
+	}
+	else if(strcmp(led_function, "PlayMorse") == 0)
+	{
+		/* text, unit in ms, repeat */
+		rc = sd_bus_message_read(msg, "sub", &name, &duration_ms, &repeat);
+		if(rc >= 0)
+		{
+			rc = led_pattern_morse(pattern, name, duration_ms, repeat);
+		}
+	}
+	else if(strcmp(led_function, "PlaySequence") == 0)
 	{
-		fprintf(stderr, "Error:[%s] writing to :[%s]\n",strerror(errno),led_path);
+		rc = sd_bus_message_enter_container(msg, 'a', "(yu)");
+		while(rc >= 0 &&
+				(rc = sd_bus_message_read(msg, "(yu)", &brightness,
+						&duration_ms)) > 0)
+		{
+			rc = led_pattern_add(pattern, brightness, duration_ms);
+		}
+		if(rc >= 0)
+		{
+			rc = sd_bus_message_exit_container(msg);
+		}
+		if(rc >= 0)
+		{
+			rc = sd_bus_message_read(msg, "b", &repeat);
+		}
+		pattern->repeat = repeat;
+		if(rc >= 0 && pattern->num_steps == 0)
+		{
+			rc = -EINVAL;
+		}
 	}
 
-	fclose(fp);
+	if(rc < 0)
+	{
+		fprintf(stderr, "Invalid LED pattern for [%s]: %s\n",
+				led_function, strerror(-rc));
+		led_pattern_free(pattern);
+	}
+	return rc;
+}
 
-	/* When we get here, rc would be what it was from writing to the file */
-	return (rc == 1) ? 0 : -1;
+static int
+led_is_pattern_function(const char *led_function)
+{
+	return (strcmp(led_function, "PlayPattern") == 0) ||
+		(strcmp(led_function, "PlayMorse") == 0) ||
+		(strcmp(led_function, "PlaySequence") == 0);
 }
 
 /*
@@ -94,20 +525,9 @@ led_function_router(sd_bus_message *msg, void *user_data,
 	/* Generic error reporter. */
 	int rc = -1;
 
-	/* Extract the led name from the full dbus path */
-	const char *led_path = sd_bus_message_get_path(msg);
-	if(led_path == NULL)
-	{
-		fprintf(stderr, "Error. LED path is empty");
-		return sd_bus_reply_method_return(msg, "i", rc);
-	}
-
-	char *led_name = get_led_name(led_path);
-	if(led_name == NULL)
-	{
-		fprintf(stderr, "Invalid LED name for path :[%s]\n",led_path);
-		return sd_bus_reply_method_return(msg, "i", rc);
-	}
+	/* Each LED object is registered with its led_t */
+	led_t *led = user_data;
+	const char *led_name = led->name;
 
 	/* Now that we have the LED name, get the Operation. */
 	const char *led_function = sd_bus_message_get_member(msg);
@@ -121,30 +541,48 @@ led_function_router(sd_bus_message *msg, void *user_data,
 	if( (strcmp(led_function, "setOn") == 0) ||
 			(strcmp(led_function, "setOff") == 0))
 	{
-		rc = led_stable_state_function(led_name, led_function);
+		rc = led_stable_state_function(led, led_function);
 		return sd_bus_reply_method_return(msg, "i", rc);
 	}
 	else if( (strcmp(led_function, "setBlinkFast") == 0) ||
 			(strcmp(led_function, "setBlinkSlow") == 0))
 	{
-		rc = led_default_blink(led_name, led_function);
+		rc = led_default_blink(led, led_function);
 		return sd_bus_reply_method_return(msg, "i", rc);
 	}
 	else if(strcmp(led_function, "BlinkCustom") == 0)
 	{
-		rc = led_custom_blink(led_name, msg);
+		rc = led_custom_blink(led, msg);
+		return sd_bus_reply_method_return(msg, "i", rc);
+	}
+	else if(led_is_pattern_function(led_function))
+	{
+		led_pattern_t pattern;
+
+		rc = led_pattern_from_msg(msg, led_function, &pattern);
+		if(rc >= 0)
+		{
+			rc = led_pattern_start(led, &pattern, led_now_ms());
+		}
 		return sd_bus_reply_method_return(msg, "i", rc);
 	}
 	else if(strcmp(led_function, "GetLedState") == 0)
 	{
 		char value_str[10] = {0};
+		const char *value = led->shadow[LED_BRIGHTNESS];
 		const char *led_state = NULL;
 
-		rc = read_led(led_name, power_ctrl, value_str, sizeof(value_str)-1);
+		/* Answer from the shadow unless the LED is blinking */
+		rc = 0;
+		if(value[0] == '\0')
+		{
+			rc = read_led(led, LED_BRIGHTNESS, value_str, sizeof(value_str)-1);
+			value = value_str;
+		}
 		if(rc >= 0)
 		{
 			/* LED is active HI */
-			led_state = strtoul(value_str, NULL, 0) ? "On" : "Off";
+			led_state = strtoul(value, NULL, 0) ? "On" : "Off";
 		}
 		return sd_bus_reply_method_return(msg, "is", rc, led_state);
 	}
@@ -162,7 +600,7 @@ led_function_router(sd_bus_message *msg, void *user_data,
  * --------------------------------------------------------------
  */
 static int
-led_stable_state_function(const char *led_name, const char *led_function)
+led_stable_state_function(led_t *led, const char *led_function)
 {
 	/* Generic error reporter. */
 	int rc = -1;
@@ -187,7 +625,8 @@ led_stable_state_function(const char *led_name, const char *led_function)
 	 * Before doing anything, need to turn off the blinking
 	 * if there is one in progress by writing 'none' to trigger
 	 */
-	rc = write_to_led(led_name, blink_ctrl, "none");
+	led_pattern_stop(led);
+	rc = write_to_led(led, LED_TRIGGER, "none");
 	if(rc < 0)
 	{
 		fprintf(stderr,"Error disabling blink. Function:[%s]\n", led_function);
@@ -197,7 +636,7 @@ led_stable_state_function(const char *led_name, const char *led_function)
 	/*
 	 * Open the brightness file and write corresponding values.
 	 */
-	rc = write_to_led(led_name, power_ctrl, value);
+	rc = write_to_led(led, LED_BRIGHTNESS, value);
 	if(rc < 0)
 	{
 		fprintf(stderr,"Error driving LED. Function:[%s]\n", led_function);
@@ -210,16 +649,18 @@ led_stable_state_function(const char *led_name, const char *led_function)
 // Given the on and off duration, applies the action on the specified LED.
 //-----------------------------------------------------------------------------------
 int
-blink_led(const char *led_name, const char *on_duration, const char *off_duration)
+blink_led(led_t *led, const char *on_duration, const char *off_duration)
 {
 	/* Generic error reporter */
 	int rc = -1;
 
+	led_pattern_stop(led);
+
 	/* Protocol demands that 'timer' be echoed to 'trigger' */
-	rc = write_to_led(led_name, blink_ctrl, "timer");
+	rc = write_to_led(led, LED_TRIGGER, "timer");
 	if(rc < 0)
 	{
-		fprintf(stderr,"Error writing timer to Led:[%s]\n", led_name);
+		fprintf(stderr,"Error writing timer to Led:[%s]\n", led->name);
 		return rc;
 	}
 
@@ -228,17 +669,17 @@ blink_led(const char *led_name, const char *on_duration, const char *off_duratio
 	 *'delay_on' and 'delay_off' which are telling the time duration for a
 	 * particular LED on and off.
 	 */
-	rc = write_to_led(led_name, duty_on, on_duration);
+	rc = write_to_led(led, LED_DELAY_ON, on_duration);
 	if(rc < 0)
 	{
-		fprintf(stderr,"Error writing [%s] to delay_on:[%s]\n",on_duration,led_name);
+		fprintf(stderr,"Error writing [%s] to delay_on:[%s]\n",on_duration,led->name);
 		return rc;
 	}
 
-	rc = write_to_led(led_name, duty_off, off_duration);
+	rc = write_to_led(led, LED_DELAY_OFF, off_duration);
 	if(rc < 0)
 	{
-		fprintf(stderr,"Error writing [%s] to delay_off:[%s]\n",off_duration,led_name);
+		fprintf(stderr,"Error writing [%s] to delay_off:[%s]\n",off_duration,led->name);
 	}
 
 	return rc;
@@ -250,7 +691,7 @@ blink_led(const char *led_name, const char *on_duration, const char *off_duratio
  * ----------------------------------------------------
  */
 static int
-led_default_blink(const char *led_name, const char *blink_type)
+led_default_blink(led_t *led, const char *blink_type)
 {
 	/* Generic error reporter */
 	int rc = -1;
@@ -276,18 +717,18 @@ led_default_blink(const char *led_name, const char *blink_type)
 		return rc;
 	}
 
-	rc = blink_led(led_name, on_duration, off_duration);
+	rc = blink_led(led, on_duration, off_duration);
 
 	return rc;
 }
 
 /*
  * -------------------------------------------------
- * Blinks at user defined 'on' and 'off' intervals.
+ * Blinks at the given 'on' and 'off' intervals.
  * -------------------------------------------------
  */
 static int
-led_custom_blink(const char *led_name, sd_bus_message *msg)
+led_blink_ms(led_t *led, uint32_t user_input_on, uint32_t user_input_off)
 {
 	/* Generic error reporter. */
 	int rc = -1;
@@ -297,45 +738,58 @@ led_custom_blink(const char *led_name, sd_bus_message *msg)
 	char on_duration[32] = {0};
 	char off_duration[32] = {0};
 
+	/*
+	 * Converting user supplied integer arguments into string as required by
+	 * sys interface. The top level REST will make sure that an error is
+	 * thrown right away on invalid inputs. However, REST is allowing the
+	 * unsigned decimal and floating numbers but when its received here, its
+	 * received as decimal so no input validation needed.
+	 */
+	led_len = snprintf(on_duration, sizeof(on_duration),
+			"%d",user_input_on);
+	if(led_len >= sizeof(on_duration))
+	{
+		fprintf(stderr, "Error. Blink ON duration is too long. :[%d]\n",led_len);
+		return rc;
+	}
+
+	led_len = snprintf(off_duration, sizeof(off_duration),
+			"%d",user_input_off);
+	if(led_len >= sizeof(off_duration))
+	{
+		fprintf(stderr, "Error. Blink OFF duration is too long. :[%d]\n",led_len);
+		return rc;
+	}
+
+	/* We are good here.*/
+	rc = blink_led(led, on_duration, off_duration);
+	return rc;
+}
+
+/*
+ * -------------------------------------------------
+ * Blinks at user defined 'on' and 'off' intervals.
+ * -------------------------------------------------
+ */
+static int
+led_custom_blink(led_t *led, sd_bus_message *msg)
+{
+	/* Generic error reporter. */
+	int rc = -1;
+
 	/* User supplied 'on' and 'off' duration */
 	uint32_t user_input_on = 0;
 	uint32_t user_input_off = 0;
 
-	/* Extract values into 'ss' ( string, string) */
+	/* Extract values into 'uu' ( uint32, uint32) */
 	rc = sd_bus_message_read(msg, "uu", &user_input_on, &user_input_off);
 	if(rc < 0)
 	{
 		fprintf(stderr, "Failed to read 'on' and 'off' duration.[%s]\n", strerror(-rc));
+		return rc;
 	}
-	else
-	{
-		/*
-		 * Converting user supplied integer arguments into string as required by
-		 * sys interface. The top level REST will make sure that an error is
-		 * thrown right away on invalid inputs. However, REST is allowing the
-		 * unsigned decimal and floating numbers but when its received here, its
-		 * received as decimal so no input validation needed.
-		 */
-		led_len = snprintf(on_duration, sizeof(on_duration),
-				"%d",user_input_on);
-		if(led_len >= sizeof(on_duration))
-		{
-			fprintf(stderr, "Error. Blink ON duration is too long. :[%d]\n",led_len);
-			return rc;
-		}
 
-		led_len = snprintf(off_duration, sizeof(off_duration),
-				"%d",user_input_off);
-		if(led_len >= sizeof(off_duration))
-		{
-			fprintf(stderr, "Error. Blink OFF duration is too long. :[%d]\n",led_len);
-			return rc;
-		}
-
-		/* We are good here.*/
-		rc = blink_led(led_name, on_duration, off_duration);
-	}
-	return rc;
+	return led_blink_ms(led, user_input_on, user_input_off);
 }
 
 /*
@@ -348,12 +802,11 @@ led_custom_blink(const char *led_name, sd_bus_message *msg)
  * ----------------------------------------------------------------
  */
 static int
-read_led(const char *name, const char *ctrl_file,
-		void *value, const size_t len)
+read_led(led_t *led, int ctrl, void *value, const size_t len)
 {
 	/* Generic error reporter. */
 	int rc = -1;
-	int count = 0;
+	int fd = -1;
 
 	if(value == NULL || len <= 0)
 	{
@@ -361,33 +814,101 @@ read_led(const char *name, const char *ctrl_file,
 		return rc;
 	}
 
-	/* To get /sys/class/leds/<name>/<control file> */
-	char led_path[128] = {0};
-
-	int led_len = 0;
-	led_len = snprintf(led_path, sizeof(led_path),
-			"/sys/class/leds/%s/%s",name, ctrl_file);
-	if(led_len >= sizeof(led_path))
+	fd = led_ctrl_fd(led, ctrl);
+	if(fd < 0)
 	{
-		fprintf(stderr, "Error. LED path is too long. :[%d]\n",led_len);
 		return rc;
 	}
 
-	FILE *fp = fopen(led_path,"rb");
-	if(fp == NULL)
+	if(pread(fd, value, len, 0) < 0)
 	{
-		fprintf(stderr,"Error:[%s] opening:[%s]\n",strerror(errno),led_path);
+		fprintf(stderr,"Error:[%s] reading:[%s/%s]\n",strerror(errno),
+				led->name, led_ctrl_files[ctrl]);
+		led_ctrl_close(led, ctrl);
 		return rc;
 	}
 
-	char *sysfs_value = (char *)value;
-	while(!feof(fp) && (count < len))
+	return 0;
+}
+
+/*
+ * -------------------------------------------------------------
+ * Allocates the led_t for a /sys/class/leds entry and seeds its
+ * shadow with the current trigger and brightness
+ * -------------------------------------------------------------
+ */
+static led_t *
+led_new(const char *name)
+{
+	char value_str[4096] = {0};
+	char *start = NULL;
+	char *end = NULL;
+	int i = 0;
+
+	led_t *led = calloc(1, sizeof(*led));
+	if(led == NULL)
 	{
-		sysfs_value[count++] = fgetc(fp);
+		return NULL;
+	}
+	snprintf(led->name, sizeof(led->name), "%s", name);
+	led->heap_index = -1;
+	for(i = 0; i < LED_CTRL_MAX; i++)
+	{
+		led->fd[i] = -1;
 	}
 
-	fclose(fp);
-	return 0;
+	/* 'trigger' lists every trigger with the active one in brackets */
+	if(read_led(led, LED_TRIGGER, value_str, sizeof(value_str)-1) == 0)
+	{
+		start = strchr(value_str, '[');
+		end = start ? strchr(start, ']') : NULL;
+		if(end && end - start - 1 < LED_VALUE_LEN)
+		{
+			memcpy(led->shadow[LED_TRIGGER], start + 1, end - start - 1);
+		}
+	}
+
+	/* A triggered LED changes brightness on its own */
+	memset(value_str, 0, sizeof(value_str));
+	if(strcmp(led->shadow[LED_TRIGGER], "none") == 0 &&
+			read_led(led, LED_BRIGHTNESS, value_str, LED_VALUE_LEN-1) == 0)
+	{
+		snprintf(led->shadow[LED_BRIGHTNESS], LED_VALUE_LEN, "%lu",
+				strtoul(value_str, NULL, 0));
+	}
+
+	led->next = led_list_head;
+	led_list_head = led;
+	return led;
+}
+
+/*
+ * -----------------------------------------------------
+ * Drops an LED: its pattern, fds, dbus object and entry
+ * -----------------------------------------------------
+ */
+static void
+led_free(led_t *led)
+{
+	led_t **prev = NULL;
+	int i = 0;
+
+	led_pattern_stop(led);
+	for(i = 0; i < LED_CTRL_MAX; i++)
+	{
+		led_ctrl_close(led, i);
+	}
+	sd_bus_slot_unref(led->slot);
+
+	for(prev = &led_list_head; *prev; prev = &(*prev)->next)
+	{
+		if(*prev == led)
+		{
+			*prev = led->next;
+			break;
+		}
+	}
+	free(led);
 }
 
 /*
@@ -404,9 +925,377 @@ static const sd_bus_vtable led_control_vtable[] =
 	SD_BUS_METHOD("setBlinkSlow", "", "i", &led_function_router, SD_BUS_VTABLE_UNPRIVILEGED),
 	SD_BUS_METHOD("GetLedState", "", "is", &led_function_router, SD_BUS_VTABLE_UNPRIVILEGED),
 	SD_BUS_METHOD("BlinkCustom", "uu", "i", &led_function_router, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("PlayPattern", "s", "i", &led_function_router, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("PlayMorse", "sub", "i", &led_function_router, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("PlaySequence", "a(yu)b", "i", &led_function_router, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_VTABLE_END,
+};
+
+/*
+ * ------------------------------------------------------------------
+ * LED groups, e.g. an enclosure identify pattern, that are driven
+ * together by /org/openbmc/control/led/groups/<name>. Membership
+ * comes from LED_GROUP_CONFIG in the platform config by way of the
+ * system manager. Members are kept by name and looked up on each
+ * call, so LEDs that are missing at the time are skipped.
+ * ------------------------------------------------------------------
+ */
+typedef struct led_group
+{
+	struct led_group *next;
+	char name[LED_NAME_LEN];
+	int num_members;
+	char **members;
+} led_group_t;
+
+static led_group_t *led_group_head = NULL;
+
+/* Set once the System manager has answered for the group configuration */
+static int led_groups_loaded = 0;
+
+static led_t *
+led_find(const char *name)
+{
+	led_t *led = NULL;
+
+	for(led = led_list_head; led; led = led->next)
+	{
+		if(strcmp(led->name, name) == 0)
+		{
+			return led;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * ----------------------------------------------------------------
+ * Applies one operation to every member, back to back, so that the
+ * whole group changes state together.
+ * ----------------------------------------------------------------
+ */
+static int
+led_group_router(sd_bus_message *msg, void *user_data,
+		sd_bus_error *ret_error)
+{
+	/* Generic error reporter. */
+	int rc = -1;
+	int i = 0;
+	int member_rc = 0;
+	led_t *led = NULL;
+
+	led_group_t *group = user_data;
+	uint32_t user_input_on = 0;
+	uint32_t user_input_off = 0;
+	led_pattern_t pattern;
+	led_pattern_t copy;
+	uint64_t start = led_now_ms();
+
+	const char *led_function = sd_bus_message_get_member(msg);
+	if(led_function == NULL)
+	{
+		fprintf(stderr, "Null LED function specificed for group: [%s]\n",
+				group->name);
+		return sd_bus_reply_method_return(msg, "i", rc);
+	}
+
+	if(strcmp(led_function, "BlinkCustom") == 0)
+	{
+		rc = sd_bus_message_read(msg, "uu", &user_input_on, &user_input_off);
+		if(rc < 0)
+		{
+			fprintf(stderr, "Failed to read 'on' and 'off' duration.[%s]\n",
+					strerror(-rc));
+			return sd_bus_reply_method_return(msg, "i", -1);
+		}
+	}
+	else if(led_is_pattern_function(led_function))
+	{
+		rc = led_pattern_from_msg(msg, led_function, &pattern);
+		if(rc < 0)
+		{
+			return sd_bus_reply_method_return(msg, "i", rc);
+		}
+	}
+
+	rc = 0;
+	for(i = 0; i < group->num_members; i++)
+	{
+		led = led_find(group->members[i]);
+		if(led == NULL)
+		{
+			continue;
+		}
+
+		if( (strcmp(led_function, "setOn") == 0) ||
+				(strcmp(led_function, "setOff") == 0))
+		{
+			member_rc = led_stable_state_function(led, led_function);
+		}
+		else if( (strcmp(led_function, "setBlinkFast") == 0) ||
+				(strcmp(led_function, "setBlinkSlow") == 0))
+		{
+			member_rc = led_default_blink(led, led_function);
+		}
+		else if(strcmp(led_function, "BlinkCustom") == 0)
+		{
+			member_rc = led_blink_ms(led, user_input_on, user_input_off);
+		}
+		else if(led_is_pattern_function(led_function))
+		{
+			/* Every member gets its own copy, all started in phase */
+			copy = pattern;
+			copy.steps = malloc(pattern.num_steps * sizeof(led_step_t));
+			if(copy.steps == NULL)
+			{
+				member_rc = -1;
+			}
+			else
+			{
+				memcpy(copy.steps, pattern.steps,
+						pattern.num_steps * sizeof(led_step_t));
+				member_rc = led_pattern_start(led, &copy, start);
+			}
+		}
+		else
+		{
+			fprintf(stderr,"Invalid LED function:[%s]\n",led_function);
+			member_rc = -1;
+		}
+
+		/* Keep going so one bad LED does not hold back the rest */
+		if(member_rc < 0)
+		{
+			rc = member_rc;
+		}
+	}
+
+	if(led_is_pattern_function(led_function))
+	{
+		led_pattern_free(&pattern);
+	}
+	return sd_bus_reply_method_return(msg, "i", rc);
+}
+
+static const sd_bus_vtable led_group_vtable[] =
+{
+	SD_BUS_VTABLE_START(0),
+	SD_BUS_METHOD("setOn", "", "i", &led_group_router, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("setOff", "", "i", &led_group_router, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("setBlinkFast", "", "i", &led_group_router, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("setBlinkSlow", "", "i", &led_group_router, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("BlinkCustom", "uu", "i", &led_group_router, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("PlayPattern", "s", "i", &led_group_router, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("PlayMorse", "sub", "i", &led_group_router, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("PlaySequence", "a(yu)b", "i", &led_group_router, SD_BUS_VTABLE_UNPRIVILEGED),
 	SD_BUS_VTABLE_END,
 };
 
+static void
+led_group_free(led_group_t *group)
+{
+	while(group->num_members > 0)
+	{
+		free(group->members[--group->num_members]);
+	}
+	free(group->members);
+	free(group);
+}
+
+/*
+ * ---------------------------------------------------------------
+ * Reads one 'name -> [members]' entry of the group configuration
+ * ---------------------------------------------------------------
+ */
+static led_group_t *
+led_group_read(sd_bus_message *reply)
+{
+	int rc = -1;
+	const char *name = NULL;
+	const char *member = NULL;
+	char **members = NULL;
+
+	led_group_t *group = calloc(1, sizeof(*group));
+	if(group == NULL)
+	{
+		return NULL;
+	}
+
+	rc = sd_bus_message_read(reply, "s", &name);
+	if(rc < 0)
+	{
+		goto fail;
+	}
+	snprintf(group->name, sizeof(group->name), "%s", name);
+
+	rc = sd_bus_message_enter_container(reply, 'a', "s");
+	if(rc < 0)
+	{
+		goto fail;
+	}
+	while((rc = sd_bus_message_read(reply, "s", &member)) > 0)
+	{
+		members = realloc(group->members,
+				(group->num_members + 1) * sizeof(char *));
+		if(members == NULL)
+		{
+			goto fail;
+		}
+		group->members = members;
+		group->members[group->num_members] = strdup(member);
+		if(group->members[group->num_members] == NULL)
+		{
+			goto fail;
+		}
+		group->num_members++;
+
+		if(led_find(member) == NULL)
+		{
+			fprintf(stderr, "LED group [%s]: no LED [%s]\n", name, member);
+		}
+	}
+	if(rc < 0 || sd_bus_message_exit_container(reply) < 0)
+	{
+		goto fail;
+	}
+	return group;
+
+fail:
+	led_group_free(group);
+	return NULL;
+}
+
+/*
+ * -------------------------------------------------------------
+ * Fetches the group configuration and puts up one object each.
+ * A group that cannot be put up is logged and skipped so that it
+ * does not take the rest, or the LED service, down with it.
+ * -------------------------------------------------------------
+ */
+static void
+led_groups_load(sd_bus *bus_type)
+{
+	int rc = -1;
+	int len = 0;
+	char group_object[128] = {0};
+	sd_bus_error bus_error = SD_BUS_ERROR_NULL;
+	sd_bus_message *reply = NULL;
+	led_group_t *group = NULL;
+
+	rc = sd_bus_call_method(bus_type,
+			"org.openbmc.managers.System",
+			"/org/openbmc/managers/System",
+			"org.openbmc.managers.System",
+			"getLedGroupConfiguration",
+			&bus_error,
+			&reply,
+			NULL);
+	if(rc < 0)
+	{
+		fprintf(stderr, "No LED groups yet: %s\n",
+				bus_error.message ? bus_error.message : strerror(-rc));
+		sd_bus_error_free(&bus_error);
+		return;
+	}
+	led_groups_loaded = 1;
+
+	rc = sd_bus_message_enter_container(reply, 'a', "{sas}");
+	while(rc >= 0 &&
+			(rc = sd_bus_message_enter_container(reply, 'e', "sas")) > 0)
+	{
+		group = led_group_read(reply);
+		if(group == NULL)
+		{
+			/* The reply is left mid-entry, so nothing after it is readable */
+			rc = -EBADMSG;
+			break;
+		}
+		rc = sd_bus_message_exit_container(reply);
+
+		len = snprintf(group_object, sizeof(group_object), "%s/groups/%s",
+				led_dbus_root, group->name);
+		if(len >= sizeof(group_object))
+		{
+			fprintf(stderr, "Error. LED group object is too long:[%d]\n",len);
+			led_group_free(group);
+			continue;
+		}
+
+		if(sd_bus_add_object_vtable(bus_type,
+				NULL,
+				group_object,
+				"org.openbmc.LedGroup",
+				led_group_vtable,
+				group) < 0)
+		{
+			fprintf(stderr, "Failed to add LED group [%s] to dbus\n",
+					group->name);
+			led_group_free(group);
+			continue;
+		}
+		group->next = led_group_head;
+		led_group_head = group;
+		sd_bus_emit_object_added(bus_type, group_object);
+	}
+	if(rc < 0)
+	{
+		fprintf(stderr, "Failed to read LED group configuration: %s\n",
+				strerror(-rc));
+	}
+
+	sd_bus_message_unref(reply);
+}
+
+/*
+ * -------------------------------------------------------------
+ * Loads the groups once the System manager is on the bus, for
+ * when it comes up after the LED service.
+ * -------------------------------------------------------------
+ */
+static int
+led_groups_on_owner_changed(sd_bus_message *msg, void *user_data,
+		sd_bus_error *ret_error)
+{
+	const char *name = NULL;
+	const char *old_owner = NULL;
+	const char *new_owner = NULL;
+
+	if(sd_bus_message_read(msg, "sss", &name, &old_owner, &new_owner) < 0)
+	{
+		return 0;
+	}
+	if(!led_groups_loaded && new_owner[0] != '\0')
+	{
+		led_groups_load(user_data);
+	}
+	return 0;
+}
+
+/*
+ * -------------------------------------------------------------
+ * Watches for the System manager before asking it, so that a
+ * manager that starts in between is not missed. Platforms
+ * without LED groups just get none.
+ * -------------------------------------------------------------
+ */
+static void
+led_groups_init(sd_bus *bus_type)
+{
+	int rc = sd_bus_add_match(bus_type, NULL,
+			"type='signal',"
+			"sender='org.freedesktop.DBus',"
+			"interface='org.freedesktop.DBus',"
+			"member='NameOwnerChanged',"
+			"arg0='org.openbmc.managers.System'",
+			led_groups_on_owner_changed, bus_type);
+	if(rc < 0)
+	{
+		fprintf(stderr, "Failed to watch for the System manager: %s\n",
+				strerror(-rc));
+	}
+	led_groups_load(bus_type);
+}
+
 /*
  * ---------------------------------------------
  * Interested in all files except standard ones
@@ -423,6 +1312,289 @@ led_select(const struct dirent *entry)
 	return 1;
 }
 
+/*
+ * ------------------------------------------------------------
+ * Puts up the dbus object for an LED that appeared in sysfs.
+ * ------------------------------------------------------------
+ */
+static int
+led_add(sd_bus *bus_type, const char *name)
+{
+	/* Generic error reporter. */
+	int rc = -1;
+
+	/* Fully qualified Dbus object for a particular LED */
+	char led_object[128] = {0};
+	int len = 0;
+	led_t *led = NULL;
+
+	if(led_find(name) != NULL)
+	{
+		return 0;
+	}
+
+	len = snprintf(led_object, sizeof(led_object), "%s%s%s",
+			led_dbus_root, "/", name);
+	if(len >= sizeof(led_object))
+	{
+		fprintf(stderr, "Error. LED object is too long:[%d]\n",len);
+		return rc;
+	}
+
+	led = led_new(name);
+	if(led == NULL)
+	{
+		fprintf(stderr, "Error. Out of memory for LED:[%s]\n", name);
+		return rc;
+	}
+
+	/* Install the object */
+	rc = sd_bus_add_object_vtable(bus_type,
+			&led->slot,
+			led_object, /* object path */
+			"org.openbmc.Led", /* interface name */
+			led_control_vtable,
+			led);
+	if(rc < 0)
+	{
+		fprintf(stderr, "Failed to add object to dbus: %s\n", strerror(-rc));
+		led_free(led);
+		return rc;
+	}
+
+	/*
+	 * The object is up and the LED usable either way; a missed
+	 * InterfacesAdded only delays clients that wait for the signal.
+	 */
+	rc = sd_bus_emit_object_added(bus_type, led_object);
+	if(rc < 0)
+	{
+		fprintf(stderr, "Failed to emit InterfacesAdded "
+				"signal for LED [%s]: %s\n", name, strerror(-rc));
+	}
+	return 0;
+}
+
+/*
+ * ------------------------------------------------------------
+ * Takes down the dbus object of an LED that left sysfs.
+ * ------------------------------------------------------------
+ */
+static void
+led_remove(sd_bus *bus_type, const char *name)
+{
+	char led_object[128] = {0};
+	led_t *led = led_find(name);
+
+	if(led == NULL)
+	{
+		return;
+	}
+
+	snprintf(led_object, sizeof(led_object), "%s%s%s",
+			led_dbus_root, "/", name);
+
+	/* Announce before the vtable goes, the signal lists its interfaces */
+	if(sd_bus_emit_object_removed(bus_type, led_object) < 0)
+	{
+		fprintf(stderr, "Failed to emit InterfacesRemoved for [%s]\n", name);
+	}
+	led_free(led);
+}
+
+/*
+ * ---------------------------------------------------------------------
+ * Kernel uevents for the 'leds' class. sysfs does not raise inotify
+ * events for class devices, so LEDs coming and going with risers, PSUs
+ * or mezzanines are picked up from the netlink uevent broadcast.
+ * ---------------------------------------------------------------------
+ */
+static int
+led_uevent_open(void)
+{
+	int fd = -1;
+	struct sockaddr_nl addr;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+			NETLINK_KOBJECT_UEVENT);
+	if(fd < 0)
+	{
+		return -errno;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	/* Kernel broadcast group, as opposed to udev's re-broadcast */
+	addr.nl_groups = 1;
+	if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		close(fd);
+		return -errno;
+	}
+	return fd;
+}
+
+static int
+led_uevent_handler(sd_event_source *es, int fd, uint32_t revents,
+		void *userdata)
+{
+	sd_bus *bus_type = userdata;
+	char buf[4096];
+	struct sockaddr_nl addr;
+	struct iovec iov = { buf, sizeof(buf) - 1 };
+	struct msghdr hdr;
+	ssize_t len = 0;
+	char *key = NULL;
+	const char *action = NULL;
+	const char *subsystem = NULL;
+	const char *devpath = NULL;
+	const char *name = NULL;
+
+	for(;;)
+	{
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.msg_name = &addr;
+		hdr.msg_namelen = sizeof(addr);
+		hdr.msg_iov = &iov;
+		hdr.msg_iovlen = 1;
+
+		len = recvmsg(fd, &hdr, 0);
+		if(len < 0)
+		{
+			if(errno != EAGAIN && errno != EINTR)
+			{
+				fprintf(stderr, "Error:[%s] reading uevents\n", strerror(errno));
+			}
+			break;
+		}
+
+		/* Only trust the kernel */
+		if(addr.nl_pid != 0)
+		{
+			continue;
+		}
+		buf[len] = '\0';
+
+		/* "action@devpath" then NUL separated KEY=value pairs */
+		action = subsystem = devpath = NULL;
+		for(key = buf + strlen(buf) + 1; key < buf + len;
+				key += strlen(key) + 1)
+		{
+			if(strncmp(key, "ACTION=", 7) == 0)
+			{
+				action = key + 7;
+			}
+			else if(strncmp(key, "SUBSYSTEM=", 10) == 0)
+			{
+				subsystem = key + 10;
+			}
+			else if(strncmp(key, "DEVPATH=", 8) == 0)
+			{
+				devpath = key + 8;
+			}
+		}
+		if(!action || !subsystem || !devpath || strcmp(subsystem, "leds"))
+		{
+			continue;
+		}
+
+		name = get_led_name(devpath);
+		if(name == NULL || *name == '\0')
+		{
+			continue;
+		}
+
+		if(strcmp(action, "add") == 0)
+		{
+			fprintf(stderr, "LED [%s] added\n", name);
+			led_add(bus_type, name);
+		}
+		else if(strcmp(action, "remove") == 0)
+		{
+			fprintf(stderr, "LED [%s] removed\n", name);
+			led_remove(bus_type, name);
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * ------------------------------------------------------------
+ * Runs the bus, the pattern timer and the uevent monitor on one
+ * sd-event loop.
+ * ------------------------------------------------------------
+ */
+static int
+led_event_loop(sd_bus *bus_type, int uevent_fd)
+{
+	int rc = -1;
+	sd_event *event = NULL;
+	sd_event_source *timer_source = NULL;
+	sd_event_source *uevent_source = NULL;
+
+	rc = sd_event_default(&event);
+	if(rc < 0)
+	{
+		fprintf(stderr, "Failed to get event loop: %s\n", strerror(-rc));
+		return rc;
+	}
+
+	rc = sd_bus_attach_event(bus_type, event, SD_EVENT_PRIORITY_NORMAL);
+	if(rc < 0)
+	{
+		fprintf(stderr, "Failed to attach bus to event loop: %s\n",
+				strerror(-rc));
+		goto finish;
+	}
+
+	led_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if(led_timer_fd < 0)
+	{
+		rc = -errno;
+		fprintf(stderr, "Failed to create LED pattern timer: %s\n",
+				strerror(-rc));
+		goto finish;
+	}
+
+	rc = sd_event_add_io(event, &timer_source, led_timer_fd, EPOLLIN,
+			led_timer_handler, NULL);
+	if(rc < 0)
+	{
+		fprintf(stderr, "Failed to watch LED pattern timer: %s\n",
+				strerror(-rc));
+		goto finish;
+	}
+
+	if(uevent_fd >= 0)
+	{
+		rc = sd_event_add_io(event, &uevent_source, uevent_fd, EPOLLIN,
+				led_uevent_handler, bus_type);
+		if(rc < 0)
+		{
+			fprintf(stderr, "Failed to watch uevents: %s\n", strerror(-rc));
+			goto finish;
+		}
+	}
+
+	rc = sd_event_loop(event);
+	if(rc < 0)
+	{
+		fprintf(stderr, "Failed to run event loop: %s\n", strerror(-rc));
+	}
+
+finish:
+	sd_event_source_unref(uevent_source);
+	sd_event_source_unref(timer_source);
+	if(led_timer_fd >= 0)
+	{
+		close(led_timer_fd);
+		led_timer_fd = -1;
+	}
+	sd_event_unref(event);
+	return rc;
+}
+
 /*
  * ------------------------------------------------
  * Called as part of setting up skeleton services.
@@ -431,16 +1603,14 @@ led_select(const struct dirent *entry)
 int
 start_led_services()
 {
-	static const char *led_dbus_root = "/org/openbmc/control/led";
-
 	/* Generic error reporter. */
 	int rc = -1;
 	int num_leds = 0;
 	int count_leds = 0;
+	int uevent_fd = -1;
 
-	/* Bus and slot where we are offering the LED dbus service. */
+	/* Bus where we are offering the LED dbus service. */
 	sd_bus *bus_type = NULL;
-	sd_bus_slot *led_slot = NULL;
 
 	/* For walking '/sys/class/leds/' looking for names of LED.*/
 	struct dirent **led_list;
@@ -453,67 +1623,47 @@ start_led_services()
 		return rc;
 	}
 
-	count_leds = num_leds = scandir("/sys/class/leds/",
-			&led_list, led_select, alphasort);
-	if(num_leds <= 0)
-	{
-		fprintf(stderr,"No LEDs present in the system\n");
-
-		sd_bus_slot_unref(led_slot);
-		sd_bus_unref(bus_type);
-		return rc;
-	}
-
 	/* Install a freedesktop object manager */
 	rc = sd_bus_add_object_manager(bus_type, NULL, led_dbus_root);
 	if(rc < 0) {
 		fprintf(stderr, "Failed to add object to dbus: %s\n",
 				strerror(-rc));
 
-		sd_bus_slot_unref(led_slot);
 		sd_bus_unref(bus_type);
 		return rc;
 	}
 
-	/* Fully qualified Dbus object for a particular LED */
-	char led_object[128] = {0};
-	int len = 0;
+	/*
+	 * Start listening before the scan so an LED that shows up
+	 * in between is not missed; led_add ignores duplicates.
+	 */
+	uevent_fd = led_uevent_open();
+	if(uevent_fd < 0)
+	{
+		fprintf(stderr, "Failed to watch uevents, LED hot-plug disabled: %s\n",
+				strerror(-uevent_fd));
+	}
+
+	count_leds = num_leds = scandir("/sys/class/leds/",
+			&led_list, led_select, alphasort);
+	if(num_leds < 0)
+	{
+		fprintf(stderr,"Error:[%s] reading /sys/class/leds\n", strerror(errno));
+		count_leds = num_leds = 0;
+		led_list = NULL;
+	}
+	if(num_leds == 0)
+	{
+		fprintf(stderr,"No LEDs present in the system yet\n");
+	}
 
 	/* For each led present, announce the service on dbus. */
+	rc = 0;
 	while(num_leds--)
 	{
-		memset(led_object, 0x0, sizeof(led_object));
-
-		len = snprintf(led_object, sizeof(led_object), "%s%s%s",
-				led_dbus_root, "/", led_list[num_leds]->d_name);
-
-		if(len >= sizeof(led_object))
-		{
-			fprintf(stderr, "Error. LED object is too long:[%d]\n",len);
-			rc = -1;
-			break;
-		}
-
-		/* Install the object */
-		rc = sd_bus_add_object_vtable(bus_type,
-				&led_slot,
-				led_object, /* object path */
-				"org.openbmc.Led", /* interface name */
-				led_control_vtable,
-				NULL);
-
+		rc = led_add(bus_type, led_list[num_leds]->d_name);
 		if(rc < 0)
 		{
-			fprintf(stderr, "Failed to add object to dbus: %s\n", strerror(-rc));
-			break;
-		}
-
-		rc = sd_bus_emit_object_added(bus_type, led_object);
-
-		if(rc < 0)
-		{
-			fprintf(stderr, "Failed to emit InterfacesAdded "
-					"signal: %s\n", strerror(-rc));
 			break;
 		}
 	}
@@ -525,6 +1675,11 @@ start_led_services()
 	}
 	free(led_list);
 
+	if(rc >= 0)
+	{
+		led_groups_init(bus_type);
+	}
+
 	/* If we had success in adding the providers, request for a bus name. */
 	if(rc >= 0)
 	{
@@ -536,30 +1691,14 @@ start_led_services()
 		}
 		else
 		{
-			for(;;)
-			{
-				/* Process requests */
-				rc = sd_bus_process(bus_type, NULL);
-				if(rc < 0)
-				{
-					fprintf(stderr, "Failed to process bus: %s\n", strerror(-rc));
-					break;
-				}
-				if(rc > 0)
-				{
-					continue;
-				}
-
-				rc = sd_bus_wait(bus_type, (uint64_t) - 1);
-				if(rc < 0)
-				{
-					fprintf(stderr, "Failed to wait on bus: %s\n", strerror(-rc));
-					break;
-				}
-			}
+			rc = led_event_loop(bus_type, uevent_fd);
 		}
 	}
-	sd_bus_slot_unref(led_slot);
+
+	if(uevent_fd >= 0)
+	{
+		close(uevent_fd);
+	}
 	sd_bus_unref(bus_type);
 
 	return rc;
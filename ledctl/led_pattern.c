@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "led_pattern.h"
+
+#define LED_ON	255
+#define LED_OFF	0
+
+/* Morse unit used by the built in patterns */
+#define MORSE_UNIT_MS	150
+
+/* Steps of the 'breathe' ramp, each way */
+#define BREATHE_STEPS	16
+#define BREATHE_STEP_MS	60
+
+/*
+ * -----------------------------------------------------------
+ * Appends a step, merging it into the previous one when the
+ * brightness does not change so the engine wakes up less.
+ * -----------------------------------------------------------
+ */
+int
+led_pattern_add(led_pattern_t *pattern, uint8_t brightness,
+		uint32_t duration_ms)
+{
+	led_step_t *steps = NULL;
+
+	if(duration_ms < LED_PATTERN_MIN_MS)
+	{
+		return -EINVAL;
+	}
+
+	if(pattern->num_steps &&
+			pattern->steps[pattern->num_steps-1].brightness == brightness)
+	{
+		pattern->steps[pattern->num_steps-1].duration_ms += duration_ms;
+		return 0;
+	}
+
+	if(pattern->num_steps == LED_PATTERN_MAX_STEPS)
+	{
+		return -E2BIG;
+	}
+
+	steps = realloc(pattern->steps, (pattern->num_steps + 1) * sizeof(*steps));
+	if(steps == NULL)
+	{
+		return -ENOMEM;
+	}
+	pattern->steps = steps;
+	pattern->steps[pattern->num_steps].brightness = brightness;
+	pattern->steps[pattern->num_steps].duration_ms = duration_ms;
+	pattern->num_steps++;
+
+	return 0;
+}
+
+void
+led_pattern_free(led_pattern_t *pattern)
+{
+	free(pattern->steps);
+	memset(pattern, 0, sizeof(*pattern));
+}
+
+/* International morse for A-Z then 0-9 */
+static const char *morse_table[] =
+{
+	".-", "-...", "-.-.", "-..", ".", "..-.", "--.", "....", "..", ".---",
+	"-.-", ".-..", "--", "-.", "---", ".--.", "--.-", ".-.", "...", "-",
+	"..-", "...-", ".--", "-..-", "-.--", "--..",
+	"-----", ".----", "..---", "...--", "....-",
+	".....", "-....", "--...", "---..", "----.",
+};
+
+/*
+ * -------------------------------------------------------------
+ * Encodes text as morse: dot one unit on, dash three, one unit
+ * off between symbols, three between letters and seven between
+ * words and before the pattern repeats.
+ * -------------------------------------------------------------
+ */
+int
+led_pattern_morse(led_pattern_t *pattern, const char *text,
+		uint32_t unit_ms, int repeat)
+{
+	int rc = 0;
+	const char *code = NULL;
+	const char *c = NULL;
+	char ch = 0;
+
+	memset(pattern, 0, sizeof(*pattern));
+	pattern->repeat = repeat;
+
+	for(c = text; *c && rc == 0; c++)
+	{
+		ch = toupper((unsigned char)*c);
+		if(ch == ' ')
+		{
+			/* Letter gap already added, make it a word gap */
+			rc = led_pattern_add(pattern, LED_OFF, 4 * unit_ms);
+			continue;
+		}
+		if(ch >= 'A' && ch <= 'Z')
+		{
+			code = morse_table[ch - 'A'];
+		}
+		else if(ch >= '0' && ch <= '9')
+		{
+			code = morse_table[26 + ch - '0'];
+		}
+		else
+		{
+			rc = -EINVAL;
+			break;
+		}
+
+		for(; *code && rc == 0; code++)
+		{
+			rc = led_pattern_add(pattern, LED_ON,
+					(*code == '-' ? 3 : 1) * unit_ms);
+			if(rc == 0)
+			{
+				rc = led_pattern_add(pattern, LED_OFF, unit_ms);
+			}
+		}
+		if(rc == 0)
+		{
+			rc = led_pattern_add(pattern, LED_OFF, 2 * unit_ms);
+		}
+	}
+
+	if(rc == 0 && pattern->num_steps)
+	{
+		rc = led_pattern_add(pattern, LED_OFF, 4 * unit_ms);
+	}
+	if(rc < 0 || pattern->num_steps == 0)
+	{
+		led_pattern_free(pattern);
+		return rc < 0 ? rc : -EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * ------------------------------------------
+ * Patterns that can be asked for by name.
+ * ------------------------------------------
+ */
+int
+led_pattern_builtin(led_pattern_t *pattern, const char *name)
+{
+	int rc = 0;
+	int i = 0;
+
+	if(strcmp(name, "sos") == 0)
+	{
+		return led_pattern_morse(pattern, "SOS", MORSE_UNIT_MS, 1);
+	}
+
+	memset(pattern, 0, sizeof(*pattern));
+	pattern->repeat = 1;
+
+	if(strcmp(name, "double-blink") == 0)
+	{
+		rc |= led_pattern_add(pattern, LED_ON, 100);
+		rc |= led_pattern_add(pattern, LED_OFF, 100);
+		rc |= led_pattern_add(pattern, LED_ON, 100);
+		rc |= led_pattern_add(pattern, LED_OFF, 700);
+	}
+	else if(strcmp(name, "breathe") == 0)
+	{
+		/* Only PWM LEDs show the ramp, others see a slow blink */
+		for(i = 0; i < BREATHE_STEPS; i++)
+		{
+			rc |= led_pattern_add(pattern,
+					LED_ON * i / (BREATHE_STEPS - 1), BREATHE_STEP_MS);
+		}
+		for(i = BREATHE_STEPS - 1; i >= 0; i--)
+		{
+			rc |= led_pattern_add(pattern,
+					LED_ON * i / (BREATHE_STEPS - 1), BREATHE_STEP_MS);
+		}
+	}
+	else
+	{
+		rc = -ENOENT;
+	}
+
+	if(rc != 0)
+	{
+		led_pattern_free(pattern);
+		return rc < 0 ? rc : -EINVAL;
+	}
+	return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef __LED_PATTERN_H__
+#define __LED_PATTERN_H__
+
+#include <stdint.h>
+
+/* Shortest step the engine will play */
+#define LED_PATTERN_MIN_MS	10
+#define LED_PATTERN_MAX_STEPS	256
+
+/* Hold 'brightness' for 'duration_ms' */
+typedef struct
+{
+	uint8_t brightness;
+	uint32_t duration_ms;
+} led_step_t;
+
+typedef struct
+{
+	led_step_t *steps;
+	int num_steps;
+	int repeat;
+} led_pattern_t;
+
+int led_pattern_builtin(led_pattern_t *pattern, const char *name);
+int led_pattern_morse(led_pattern_t *pattern, const char *text,
+		uint32_t unit_ms, int repeat);
+int led_pattern_add(led_pattern_t *pattern, uint8_t brightness,
+		uint32_t duration_ms);
+void led_pattern_free(led_pattern_t *pattern);
+
+#endif
@@ -7,19 +7,487 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <argp.h>
+#include <dirent.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <linux/gpio.h>
 #include "openbmc_intf.h"
 #include "gpio.h"
 
+#define GPIO_CHARDEV_DIR      "/dev"
+#define GPIO_CONSUMER_LABEL   "openbmc"
+
+// Prefix for /sys/class/gpio and /dev, so a daemon can be pointed at a
+// mock tree (see bench/) with OBMC_GPIO_ROOT or gpio_set_root().
+static char* gpio_root = NULL;
+static bool gpio_root_set = false;
+
+// Backend is picked once per process; OBMC_GPIO_BACKEND=chardev in the
+// service environment moves a daemon over without code changes.
+static int gpio_backend = -1;
+
+void gpio_set_backend(int backend)
+{
+	gpio_backend = backend;
+}
+
+int gpio_get_backend(void)
+{
+	if (gpio_backend < 0)
+	{
+		const char* env = getenv("OBMC_GPIO_BACKEND");
+		gpio_backend = GPIO_BACKEND_SYSFS;
+		if (env != NULL && strcmp(env, "chardev") == 0)
+		{
+			gpio_backend = GPIO_BACKEND_CHARDEV;
+		}
+	}
+	return gpio_backend;
+}
+
+void gpio_set_root(const char* root)
+{
+	g_free(gpio_root);
+	gpio_root = (root != NULL && root[0] != '\0') ? g_strdup(root) : NULL;
+	gpio_root_set = true;
+}
+
+const char* gpio_get_root(void)
+{
+	if (!gpio_root_set)
+	{
+		gpio_set_root(getenv("OBMC_GPIO_ROOT"));
+	}
+	return gpio_root;
+}
+
+// Applies the root prefix to a path handed out by the gpio manager
+static gchar* gpio_rooted(gchar* path)
+{
+	const char* root = gpio_get_root();
+	return root != NULL ? g_strconcat(root, path, NULL) : path;
+}
+
+static int read_sysfs_uint(const char* path, unsigned int* value)
+{
+	char buf[32];
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	ssize_t len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0) {
+		return -1;
+	}
+	buf[len] = '\0';
+	*value = strtoul(buf, NULL, 0);
+	return 0;
+}
+
+static int read_sysfs_str(const char* path, char* buf, size_t size)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	ssize_t len = read(fd, buf, size - 1);
+	close(fd);
+	if (len <= 0) {
+		return -1;
+	}
+	if (buf[len - 1] == '\n') {
+		len--;
+	}
+	buf[len] = '\0';
+	return 0;
+}
+
+// Lines this process, or with OBMC_GPIO_STATE_DIR set any earlier process
+// since boot, has exported and configured, keyed by sysfs gpio number.
+// A line recorded with the requested configuration is not touched again
+// beyond checking that it is still exported. Every reconfiguration made
+// through this library rewrites or drops the entry, and unexporting the
+// line is caught by that check, so entries left by another process are
+// trusted the same way.
+static GHashTable* gpio_state = NULL;
+static unsigned long gpio_avoided = 0;
+
+static const char* gpio_state_dir(void)
+{
+	const char* dir = getenv("OBMC_GPIO_STATE_DIR");
+	return (dir != NULL && dir[0] != '\0') ? dir : NULL;
+}
+
+static void gpio_state_store(GPIO* gpio, const char* state)
+{
+	const char* dir = gpio_state_dir();
+	if (gpio_state == NULL)
+	{
+		gpio_state = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+				NULL, g_free);
+	}
+	g_hash_table_insert(gpio_state, GINT_TO_POINTER(gpio->num),
+			g_strdup(state));
+	if (dir != NULL)
+	{
+		char path[254];
+		int fd;
+		sprintf(path, "%s/gpio%d", dir, gpio->num);
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd >= 0)
+		{
+			if (write(fd, state, strlen(state)) != strlen(state))
+			{
+				// never leave a partial entry behind
+				g_print("GPIO %s: cannot record state: %s\n",
+						gpio->name, strerror(errno));
+				unlink(path);
+			}
+			close(fd);
+		}
+	}
+}
+
+// Drops a line whose kernel state is about to change behind the table
+static void gpio_state_forget(GPIO* gpio)
+{
+	const char* dir = gpio_state_dir();
+	if (gpio_state != NULL)
+	{
+		g_hash_table_remove(gpio_state, GINT_TO_POINTER(gpio->num));
+	}
+	if (dir != NULL)
+	{
+		char path[254];
+		sprintf(path, "%s/gpio%d", dir, gpio->num);
+		unlink(path);
+	}
+}
+
+static bool gpio_state_cached(GPIO* gpio)
+{
+	char path[254];
+	char cached[16];
+	const char* state = NULL;
+	const char* dir = gpio_state_dir();
+	struct stat st;
+
+	if (gpio_state != NULL)
+	{
+		state = g_hash_table_lookup(gpio_state, GINT_TO_POINTER(gpio->num));
+	}
+	if (state == NULL && dir != NULL)
+	{
+		sprintf(path, "%s/gpio%d", dir, gpio->num);
+		if (read_sysfs_str(path, cached, sizeof(cached)) == 0)
+		{
+			state = cached;
+		}
+	}
+	if (state == NULL || strcmp(state, gpio->direction) != 0)
+	{
+		return false;
+	}
+	// someone may have unexported it since
+	sprintf(path, "%s/gpio%d/value", gpio->dev, gpio->num);
+	if (stat(path, &st))
+	{
+		gpio_state_forget(gpio);
+		return false;
+	}
+	if (state == cached)
+	{
+		if (gpio_state == NULL)
+		{
+			gpio_state = g_hash_table_new_full(g_direct_hash,
+					g_direct_equal, NULL, g_free);
+		}
+		g_hash_table_insert(gpio_state, GINT_TO_POINTER(gpio->num),
+				g_strdup(cached));
+	}
+	// the direction or edge read, the value read for outputs and the write
+	gpio_avoided += strcmp(gpio->direction, "out") == 0 ? 3 : 2;
+	return true;
+}
+
+// Number of sysfs reads and writes gpio_init has skipped because the line
+// was already configured as requested
+unsigned long gpio_ops_avoided(void)
+{
+	return gpio_avoided;
+}
+
+// Finds the gpiochip owning the global sysfs gpio number; sets line_offset
+// to the line's index within that chip.
+static int gpio_sysfs_chip(GPIO* gpio, char* label, size_t size,
+		unsigned int* ngpio)
+{
+	char path[254];
+	unsigned int base;
+	struct dirent* entry;
+	DIR* dir;
+	int rc = GPIO_LOOKUP_ERROR;
+
+	dir = opendir(gpio->dev);
+	if (dir == NULL) {
+		return rc;
+	}
+	while ((entry = readdir(dir)) != NULL) {
+		if (strncmp(entry->d_name, "gpiochip", 8) != 0) {
+			continue;
+		}
+		sprintf(path, "%s/%s/base", gpio->dev, entry->d_name);
+		if (read_sysfs_uint(path, &base)) {
+			continue;
+		}
+		sprintf(path, "%s/%s/ngpio", gpio->dev, entry->d_name);
+		if (read_sysfs_uint(path, ngpio)) {
+			continue;
+		}
+		if (gpio->num < base || gpio->num >= base + *ngpio) {
+			continue;
+		}
+		sprintf(path, "%s/%s/label", gpio->dev, entry->d_name);
+		if (read_sysfs_str(path, label, size)) {
+			continue;
+		}
+		gpio->line_offset = gpio->num - base;
+		rc = GPIO_OK;
+		break;
+	}
+	closedir(dir);
+	return rc;
+}
+
+// Reports the controller label and line offset of an initialised gpio
+int gpio_chip_info(GPIO* gpio, char* label, size_t size)
+{
+	unsigned int ngpio;
+	g_assert (gpio != NULL);
+	return gpio_sysfs_chip(gpio, label, size, &ngpio);
+}
+
+// Translates the global sysfs gpio number into a gpiochip character device
+// and line offset by matching the owning chip's label and line count.
+static int gpio_chardev_open_chip(GPIO* gpio)
+{
+	char path[254];
+	char chardev_dir[254];
+	char label[GPIO_MAX_NAME_SIZE];
+	const char* root = gpio_get_root();
+	unsigned int ngpio;
+	struct dirent* entry;
+	DIR* dir;
+	int chip_fd = -1;
+
+	if (gpio_sysfs_chip(gpio, label, sizeof(label), &ngpio) != GPIO_OK) {
+		return -1;
+	}
+
+	sprintf(chardev_dir, "%s%s", root != NULL ? root : "", GPIO_CHARDEV_DIR);
+	dir = opendir(chardev_dir);
+	if (dir == NULL) {
+		return -1;
+	}
+	while ((entry = readdir(dir)) != NULL) {
+		struct gpiochip_info info;
+		if (strncmp(entry->d_name, "gpiochip", 8) != 0) {
+			continue;
+		}
+		sprintf(path, "%s/%s", chardev_dir, entry->d_name);
+		chip_fd = open(path, O_RDWR | O_CLOEXEC);
+		if (chip_fd < 0) {
+			continue;
+		}
+		memset(&info, 0, sizeof(info));
+		if (ioctl(chip_fd, GPIO_GET_CHIPINFO_IOCTL, &info) == 0 &&
+				info.lines == ngpio &&
+				strncmp(info.label, label, sizeof(info.label)) == 0) {
+			break;
+		}
+		close(chip_fd);
+		chip_fd = -1;
+	}
+	closedir(dir);
+	return chip_fd;
+}
+
+static int gpio_chardev_request(GPIO* gpio, int chip_fd, uint32_t flags,
+		uint8_t value)
+{
+	struct gpiohandle_request req;
+	memset(&req, 0, sizeof(req));
+	req.lineoffsets[0] = gpio->line_offset;
+	req.lines = 1;
+	req.flags = flags;
+	req.default_values[0] = value;
+	strncpy(req.consumer_label, GPIO_CONSUMER_LABEL,
+			sizeof(req.consumer_label) - 1);
+	if (ioctl(chip_fd, GPIO_GET_LINEHANDLE_IOCTL, &req) < 0) {
+		return -errno;
+	}
+	return req.fd;
+}
+
+// Hands back a line still exported by a sysfs user, so it can be requested
+static void gpio_chardev_unexport(GPIO* gpio)
+{
+	char dev[254];
+	char data[8];
+	int fd;
+
+	gpio_state_forget(gpio);
+	sprintf(dev, "%s/unexport", gpio->dev);
+	fd = open(dev, O_WRONLY);
+	if (fd < 0) {
+		return;
+	}
+	sprintf(data, "%d", gpio->num);
+	if (write(fd, data, strlen(data)) != strlen(data)) {
+		g_print("GPIO %s: unexport failed: %s\n", gpio->name,
+				strerror(errno));
+	}
+	close(fd);
+}
+
+// Reads the level a line is driving through sysfs, exporting it for the
+// read if nobody has. Exporting leaves both direction and level alone.
+static int gpio_chardev_level(GPIO* gpio, uint8_t* value)
+{
+	char path[254];
+	char data[8];
+	unsigned int level;
+	struct stat st;
+	int fd;
+
+	sprintf(path, "%s/gpio%d/value", gpio->dev, gpio->num);
+	if (stat(path, &st)) {
+		sprintf(data, "%d", gpio->num);
+		sprintf(path, "%s/export", gpio->dev);
+		fd = open(path, O_WRONLY);
+		if (fd < 0) {
+			return GPIO_OPEN_ERROR;
+		}
+		if (write(fd, data, strlen(data)) != strlen(data)) {
+			close(fd);
+			return GPIO_WRITE_ERROR;
+		}
+		close(fd);
+		sprintf(path, "%s/gpio%d/value", gpio->dev, gpio->num);
+	}
+	if (read_sysfs_uint(path, &level)) {
+		return GPIO_READ_ERROR;
+	}
+	*value = level != 0;
+	return GPIO_OK;
+}
+
+// Requests a long-lived line event fd for a line configured for edges.
+// gpio_read keeps working on it, and gpio_open_events watches it.
+static int gpio_chardev_events(GPIO* gpio, int chip_fd, uint32_t eventflags)
+{
+	struct gpioevent_request req;
+	memset(&req, 0, sizeof(req));
+	req.lineoffset = gpio->line_offset;
+	req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+	req.eventflags = eventflags;
+	strncpy(req.consumer_label, GPIO_CONSUMER_LABEL,
+			sizeof(req.consumer_label) - 1);
+	if (ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &req) < 0) {
+		return -errno;
+	}
+	return req.fd;
+}
+
+// Requests a long-lived line handle. Outputs are requested as outputs
+// driving the level they already have, so they never float in between.
+// Lines configured for edges get a line event fd instead.
+static int gpio_chardev_init(GPIO* gpio)
+{
+	uint32_t flags = GPIOHANDLE_REQUEST_INPUT;
+	uint32_t eventflags = 0;
+	uint8_t value = 0;
+	int chip_fd;
+	int fd;
+	int rc;
+
+	if (strcmp(gpio->direction, "out") == 0) {
+		// Keep the current level, as the sysfs path does.
+		rc = gpio_chardev_level(gpio, &value);
+		if (rc != GPIO_OK) {
+			return rc;
+		}
+		flags = GPIOHANDLE_REQUEST_OUTPUT;
+	} else if (strcmp(gpio->direction, "both") == 0) {
+		eventflags = GPIOEVENT_REQUEST_BOTH_EDGES;
+	} else if (strcmp(gpio->direction, "rising") == 0) {
+		eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+	} else if (strcmp(gpio->direction, "falling") == 0) {
+		eventflags = GPIOEVENT_REQUEST_FALLING_EDGE;
+	} else if (strcmp(gpio->direction, "in") != 0) {
+		return GPIO_INIT_ERROR;
+	}
+
+	chip_fd = gpio_chardev_open_chip(gpio);
+	if (chip_fd < 0) {
+		return GPIO_LOOKUP_ERROR;
+	}
+	if (eventflags) {
+		fd = gpio_chardev_events(gpio, chip_fd, eventflags);
+		if (fd == -EBUSY) {
+			// Still exported by a sysfs user; hand it back.
+			gpio_chardev_unexport(gpio);
+			fd = gpio_chardev_events(gpio, chip_fd, eventflags);
+		}
+	} else {
+		fd = gpio_chardev_request(gpio, chip_fd, flags, value);
+		if (fd == -EBUSY) {
+			// Still exported by a sysfs user, or by the level read above.
+			gpio_chardev_unexport(gpio);
+			fd = gpio_chardev_request(gpio, chip_fd, flags, value);
+		}
+	}
+	close(chip_fd);
+	if (fd < 0) {
+		return GPIO_OPEN_ERROR;
+	}
+	gpio->line_fd = fd;
+	gpio->line_events = eventflags != 0;
+	gpio->chardev = true;
+	return GPIO_OK;
+}
+
+static int gpio_chardev_set(GPIO* gpio, uint8_t value)
+{
+	struct gpiohandle_data data;
+	memset(&data, 0, sizeof(data));
+	if (gpio->line_shared &&
+			ioctl(gpio->line_fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0) {
+		return GPIO_READ_ERROR;
+	}
+	data.values[gpio->line_index] = value;
+	if (ioctl(gpio->line_fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) < 0) {
+		return GPIO_WRITE_ERROR;
+	}
+	return GPIO_OK;
+}
+
 
 int gpio_writec(GPIO* gpio, char value)
 {
 	g_assert (gpio != NULL);
 	int rc = GPIO_OK;
 	char buf[1];
+	if (gpio->chardev)
+	{
+		return gpio_chardev_set(gpio, value == '1');
+	}
 	buf[0] = value;
-	if (write(gpio->fd, buf, 1) != 1)
+	if (pwrite(gpio->fd, buf, 1, 0) != 1)
 	{
 		rc = GPIO_WRITE_ERROR;
 	}
@@ -31,12 +499,16 @@ int gpio_write(GPIO* gpio, uint8_t value)
 	g_assert (gpio != NULL);
 	int rc = GPIO_OK;
 	char buf[1];
+	if (gpio->chardev)
+	{
+		return gpio_chardev_set(gpio, value == 1);
+	}
 	buf[0] = '0';
 	if (value==1)
 	{
 		buf[0]='1';
 	}
-	if (write(gpio->fd, buf, 1) != 1)
+	if (pwrite(gpio->fd, buf, 1, 0) != 1)
 	{
 		rc = GPIO_WRITE_ERROR;
 	}
@@ -48,13 +520,26 @@ int gpio_read(GPIO* gpio, uint8_t *value)
 	g_assert (gpio != NULL);
 	char buf[1];
 	int r = GPIO_OK;
+	if (gpio->chardev)
+	{
+		struct gpiohandle_data data;
+		memset(&data, 0, sizeof(data));
+		if (ioctl(gpio->line_fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0)
+		{
+			return GPIO_READ_ERROR;
+		}
+		*value = data.values[gpio->line_index] ? 1 : 0;
+		return GPIO_OK;
+	}
 	if (gpio->fd <= 0)
 	{
 		r = GPIO_ERROR;
 	}
 	else
 	{
-		if (read(gpio->fd,&buf,1) != 1)
+		// value files are read and written at offset 0 through one
+		// long-lived fd, which also keeps a mock tree's files at one byte
+		if (pread(gpio->fd,&buf,1,0) != 1)
 		{
 			r = GPIO_READ_ERROR;
 		} else {
@@ -72,11 +557,11 @@ int gpio_clock_cycle(GPIO* gpio, int num_clks) {
         int i=0;
 	int r=GPIO_OK;
         for (i=0;i<num_clks;i++) {
-                if (gpio_writec(gpio,'0') == -1) {
+                if (gpio_writec(gpio,'0') != GPIO_OK) {
 			r = GPIO_WRITE_ERROR;
 			break;
 		}
-		if (gpio_writec(gpio,'1') == -1) {
+		if (gpio_writec(gpio,'1') != GPIO_OK) {
 			r = GPIO_WRITE_ERROR;
 			break;
 		}
@@ -84,47 +569,37 @@ int gpio_clock_cycle(GPIO* gpio, int num_clks) {
 	return r;
 }
 
-// Gets the gpio device path from gpio manager object
-int gpio_init(GDBusConnection *connection, GPIO* gpio)
+// Exports the line and configures its direction or edge
+static int gpio_setup(GPIO* gpio)
 {
 	int rc = GPIO_OK;
-	GDBusProxy *proxy;
-	GError *error;
-	GVariant *result;
 
-	error = NULL;
-	g_assert_no_error (error);
-	error = NULL;
-	proxy = g_dbus_proxy_new_sync (connection,
-                                 G_DBUS_PROXY_FLAGS_NONE,
-                                 NULL,                      /* GDBusInterfaceInfo */
-                                 "org.openbmc.managers.System", /* name */
-                                 "/org/openbmc/managers/System", /* object path */
-                                 "org.openbmc.managers.System",        /* interface */
-                                 NULL, /* GCancellable */
-                                 &error);
-	if (error != NULL) {
-		return GPIO_LOOKUP_ERROR;
+	if (gpio_get_backend() == GPIO_BACKEND_CHARDEV && !gpio->chardev)
+	{
+		rc = gpio_chardev_init(gpio);
+		if (rc == GPIO_OK)
+		{
+			g_print("GPIO %s: line handle %d on offset %u\n",
+					gpio->name, gpio->line_fd, gpio->line_offset);
+			return rc;
+		}
+		// fall back to sysfs for unmapped chips or lines without edges
+		rc = GPIO_OK;
+	}
+	if (gpio->chardev)
+	{
+		return GPIO_OK;
 	}
 
-	result = g_dbus_proxy_call_sync (proxy,
-                                   "gpioInit",
-                                   g_variant_new ("(s)", gpio->name),
-                                   G_DBUS_CALL_FLAGS_NONE,
-                                   -1,
-                                   NULL,
-                                   &error);
-
-	if (error != NULL) {
-		return GPIO_LOOKUP_ERROR;
+	if (gpio_state_cached(gpio))
+	{
+		return GPIO_OK;
 	}
-	g_assert (result != NULL);
-	g_variant_get (result, "(&si&s)", &gpio->dev,&gpio->num,&gpio->direction);
-	g_print("GPIO Lookup:  %s = %d,%s\n",gpio->name,gpio->num,gpio->direction);
 
 	//export and set direction
 	char dev[254];
 	char data[4];
+	char current[16];
 	int fd;
 	do {
 		struct stat st;
@@ -150,14 +625,25 @@ int gpio_init(GDBusConnection *connection, GPIO* gpio)
 		}
 		const char* file = "edge";
 		const char* direction = gpio->direction;
-		if (strcmp(direction, "in") == 0)
+		if (strcmp(direction, "in") == 0 || strcmp(direction, "out") == 0)
 		{
 			file = "direction";
 		}
-		else if (strcmp(direction, "out") == 0)
-		{
-			file = "direction";
+		sprintf(dev,"%s/gpio%d/%s",gpio->dev,gpio->num,file);
 
+		// Already configured this way, e.g. by an earlier run; writing
+		// it again would not change anything.
+		if (!result && read_sysfs_str(dev, current, sizeof(current)) == 0 &&
+				strcmp(current, direction) == 0)
+		{
+			// outputs skip the value read as well as the write
+			gpio_avoided += strcmp(direction, "out") == 0 ? 2 : 1;
+			rc = GPIO_OK;
+			gpio_state_store(gpio, direction);
+			break;
+		}
+		if (strcmp(direction, "out") == 0)
+		{
 			// Read current value, so we can set 'high' or 'low'.
 			// Setting direction directly to 'out' is the same as
 			// setting to 'low' which can change the value in the
@@ -171,7 +657,6 @@ int gpio_init(GDBusConnection *connection, GPIO* gpio)
 
 			direction = (value ? "high" : "low");
 		}
-		sprintf(dev,"%s/gpio%d/%s",gpio->dev,gpio->num,file);
 		fd = open(dev,O_WRONLY);
 		if (fd == GPIO_ERROR) {
 			rc = GPIO_WRITE_ERROR;
@@ -185,11 +670,118 @@ int gpio_init(GDBusConnection *connection, GPIO* gpio)
 
 		close(fd);
 		rc = GPIO_OK;
+		gpio_state_store(gpio, gpio->direction);
 	} while(0);
 
 	return rc;
 }
 
+// Gets the gpio device path from gpio manager object
+int gpio_init(GDBusConnection *connection, GPIO* gpio)
+{
+	GDBusProxy *proxy;
+	GError *error;
+	GVariant *result;
+
+	error = NULL;
+	g_assert_no_error (error);
+	error = NULL;
+	proxy = g_dbus_proxy_new_sync (connection,
+                                 G_DBUS_PROXY_FLAGS_NONE,
+                                 NULL,                      /* GDBusInterfaceInfo */
+                                 "org.openbmc.managers.System", /* name */
+                                 "/org/openbmc/managers/System", /* object path */
+                                 "org.openbmc.managers.System",        /* interface */
+                                 NULL, /* GCancellable */
+                                 &error);
+	if (error != NULL) {
+		return GPIO_LOOKUP_ERROR;
+	}
+
+	result = g_dbus_proxy_call_sync (proxy,
+                                   "gpioInit",
+                                   g_variant_new ("(s)", gpio->name),
+                                   G_DBUS_CALL_FLAGS_NONE,
+                                   -1,
+                                   NULL,
+                                   &error);
+
+	if (error != NULL) {
+		return GPIO_LOOKUP_ERROR;
+	}
+	g_assert (result != NULL);
+	g_variant_get (result, "(&si&s)", &gpio->dev,&gpio->num,&gpio->direction);
+	gpio->dev = gpio_rooted(gpio->dev);
+	g_print("GPIO Lookup:  %s = %d,%s\n",gpio->name,gpio->num,gpio->direction);
+
+	return gpio_setup(gpio);
+}
+
+// Resolves all gpios with a single gpioInitMany call to the gpio manager,
+// then sets each of them up locally. Returns the OR of per-gpio errors.
+int gpio_init_many(GDBusConnection *connection, GPIO** gpios, size_t num)
+{
+	int rc = GPIO_OK;
+	GError *error = NULL;
+	GVariantBuilder names;
+	GVariantIter *iter;
+	GVariant *result;
+	gchar *dev, *direction;
+	gint gpio_num;
+	size_t i;
+
+	g_variant_builder_init(&names, G_VARIANT_TYPE("as"));
+	for (i = 0; i < num; i++) {
+		g_variant_builder_add(&names, "s", gpios[i]->name);
+	}
+	result = g_dbus_connection_call_sync(connection,
+			"org.openbmc.managers.System", /* name */
+			"/org/openbmc/managers/System", /* object path */
+			"org.openbmc.managers.System", /* interface */
+			"gpioInitMany",
+			g_variant_new("(as)", &names),
+			G_VARIANT_TYPE("(a(sis))"),
+			G_DBUS_CALL_FLAGS_NONE,
+			-1,
+			NULL,
+			&error);
+	if (error != NULL) {
+		g_print("ERROR GPIO: gpioInitMany failed: %s\n", error->message);
+		g_error_free(error);
+		return GPIO_LOOKUP_ERROR;
+	}
+
+	g_variant_get(result, "(a(sis))", &iter);
+	for (i = 0; i < num &&
+			g_variant_iter_next(iter, "(sis)", &dev, &gpio_num, &direction);
+			i++) {
+		GPIO* gpio = gpios[i];
+		if (gpio_num < 0) {
+			g_print("ERROR GPIO: lookup failed for %s\n", gpio->name);
+			g_free(dev);
+			g_free(direction);
+			rc |= GPIO_LOOKUP_ERROR;
+			continue;
+		}
+		gpio->dev = gpio_rooted(dev);
+		if (gpio->dev != dev) {
+			g_free(dev);
+		}
+		gpio->num = gpio_num;
+		gpio->direction = direction;
+		g_print("GPIO Lookup:  %s = %d,%s\n",gpio->name,gpio->num,gpio->direction);
+		rc |= gpio_setup(gpio);
+	}
+	if (i < num) {
+		rc |= GPIO_LOOKUP_ERROR;
+	}
+	g_variant_iter_free(iter);
+	g_variant_unref(result);
+	g_print("GPIO: %lu sysfs operations skipped so far\n", gpio_avoided);
+
+	return rc;
+}
+
 
 
 
@@ -219,12 +811,120 @@ int gpio_open_interrupt(GPIO* gpio, GIOFunc func, gpointer user_data)
 	return rc;
 }
 
+// Watches both edges of an input line. On the chardev backend the line
+// handle is swapped for a line event fd, so each edge is queued and
+// gpio_read keeps working on it. A line configured for one edge already
+// holds an event fd for just that edge; it is requested again for both,
+// as callers track the level from the edges. Returns GPIO_INIT_ERROR
+// when the line cannot interrupt, so callers can fall back to polling.
+int gpio_open_events(GPIO* gpio, GIOFunc func, gpointer user_data)
+{
+	g_assert (gpio != NULL);
+	GIOCondition cond;
+	int fd;
+
+	if (gpio->chardev)
+	{
+		int chip_fd;
+		if (gpio->line_shared) {
+			return GPIO_INIT_ERROR;
+		}
+		chip_fd = gpio_chardev_open_chip(gpio);
+		if (chip_fd < 0) {
+			return GPIO_LOOKUP_ERROR;
+		}
+		close(gpio->line_fd);
+		fd = gpio_chardev_events(gpio, chip_fd,
+				GPIOEVENT_REQUEST_BOTH_EDGES);
+		if (fd < 0) {
+			// no edge support; restore a plain input handle
+			gpio->line_fd = gpio_chardev_request(gpio, chip_fd,
+					GPIOHANDLE_REQUEST_INPUT, 0);
+			if (gpio->line_fd < 0) {
+				gpio->line_fd = -1;
+			}
+			gpio->line_events = false;
+			close(chip_fd);
+			return GPIO_INIT_ERROR;
+		}
+		close(chip_fd);
+		gpio->line_fd = fd;
+		gpio->line_events = true;
+		cond = G_IO_IN;
+	}
+	else
+	{
+		char buf[255];
+		const char* edge = "both";
+		char c;
+		if (gpio_get_root() != NULL) {
+			// regular files in a mock tree never signal POLLPRI;
+			// let the caller poll instead
+			return GPIO_INIT_ERROR;
+		}
+		sprintf(buf, "%s/gpio%d/edge", gpio->dev, gpio->num);
+		fd = open(buf, O_WRONLY);
+		if (fd < 0) {
+			return GPIO_INIT_ERROR;
+		}
+		if (write(fd, edge, strlen(edge)) != strlen(edge)) {
+			close(fd);
+			return GPIO_INIT_ERROR;
+		}
+		close(fd);
+		gpio_state_store(gpio, edge);
+		sprintf(buf, "%s/gpio%d/value", gpio->dev, gpio->num);
+		gpio->fd = open(buf, O_RDONLY | O_NONBLOCK);
+		if (gpio->fd == -1) {
+			return GPIO_OPEN_ERROR;
+		}
+		// consume the initial state so poll only wakes on an edge
+		read(gpio->fd, &c, 1);
+		fd = gpio->fd;
+		cond = G_IO_PRI;
+	}
+	GIOChannel* channel = g_io_channel_unix_new(fd);
+	g_io_add_watch(channel, cond, func, user_data);
+	return GPIO_OK;
+}
+
+// Reads one edge from a line opened with gpio_open_events. The timestamp
+// is CLOCK_MONOTONIC nanoseconds taken as the edge is read, on both
+// backends: the kernel's own event timestamp is CLOCK_REALTIME before
+// Linux 5.7, which NTP can step, so it is not used.
+int gpio_read_event(GPIO* gpio, uint8_t* value, uint64_t* timestamp)
+{
+	g_assert (gpio != NULL);
+	struct timespec ts;
+	int rc = GPIO_OK;
+
+	if (gpio->chardev)
+	{
+		struct gpioevent_data event;
+		if (read(gpio->line_fd, &event, sizeof(event)) != sizeof(event)) {
+			return GPIO_READ_ERROR;
+		}
+		*value = event.id == GPIOEVENT_EVENT_RISING_EDGE ? 1 : 0;
+	}
+	else
+	{
+		rc = gpio_read(gpio, value);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	*timestamp = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	return rc;
+}
+
 int gpio_open(GPIO* gpio)
 {
 	g_assert (gpio != NULL);
 	// open gpio for writing or reading
 	char buf[254];
 	int rc = 0;
+	if (gpio->chardev) {
+		// handle stays requested; nothing to open
+		return GPIO_OK;
+	}
 	gpio->fd = -1;
 	if (gpio->direction == NULL) {
 		return GPIO_OPEN_ERROR;
@@ -248,5 +948,293 @@ int gpio_open(GPIO* gpio)
 
 void gpio_close(GPIO* gpio)
 {
+	if (gpio->chardev) {
+		return;
+	}
 	close(gpio->fd);
 }
+
+// Moves chardev members of the group onto one multi-line handle per chip
+// and direction. Lines keep their current level across the re-request.
+static int gpio_group_request(GpioGroup* group)
+{
+	int rc = GPIO_OK;
+	size_t i, j;
+	bool* done = g_malloc0_n(group->num_gpios, sizeof(bool));
+
+	for (i = 0; i < group->num_gpios; i++) {
+		GPIO* first = &group->gpios[i];
+		struct gpiohandle_request req;
+		uint32_t base;
+		int chip_fd;
+		bool out;
+
+		if (done[i] || !first->chardev || first->line_events) {
+			continue;
+		}
+		base = first->num - first->line_offset;
+		out = strcmp(first->direction, "out") == 0;
+
+		memset(&req, 0, sizeof(req));
+		req.flags = out ? GPIOHANDLE_REQUEST_OUTPUT : GPIOHANDLE_REQUEST_INPUT;
+		strncpy(req.consumer_label, GPIO_CONSUMER_LABEL,
+				sizeof(req.consumer_label) - 1);
+		for (j = i; j < group->num_gpios && req.lines < GPIOHANDLES_MAX; j++) {
+			GPIO* gpio = &group->gpios[j];
+			uint8_t value = 0;
+			if (done[j] || !gpio->chardev || gpio->line_events ||
+					gpio->num - gpio->line_offset != base ||
+					(strcmp(gpio->direction, "out") == 0) != out) {
+				continue;
+			}
+			if (gpio_read(gpio, &value) != GPIO_OK) {
+				continue;
+			}
+			req.lineoffsets[req.lines] = gpio->line_offset;
+			req.default_values[req.lines] = value;
+			req.lines++;
+		}
+
+		chip_fd = gpio_chardev_open_chip(first);
+		if (chip_fd < 0) {
+			rc = GPIO_LOOKUP_ERROR;
+			break;
+		}
+		// Release the single-line handles so the lines can be re-requested;
+		// the kernel refuses a line that is still held.
+		for (j = i; j < group->num_gpios; j++) {
+			GPIO* gpio = &group->gpios[j];
+			uint32_t k;
+			for (k = 0; k < req.lines; k++) {
+				if (!done[j] && gpio->chardev &&
+						gpio->num - gpio->line_offset == base &&
+						gpio->line_offset == req.lineoffsets[k]) {
+					close(gpio->line_fd);
+					gpio->line_fd = -1;
+					gpio->line_index = k;
+					done[j] = true;
+				}
+			}
+		}
+		if (ioctl(chip_fd, GPIO_GET_LINEHANDLE_IOCTL, &req) < 0) {
+			// Put the single-line handles back, at the levels they had
+			for (j = i; j < group->num_gpios; j++) {
+				GPIO* gpio = &group->gpios[j];
+				if (done[j] && gpio->line_fd == -1) {
+					gpio->line_fd = gpio_chardev_request(gpio, chip_fd,
+							req.flags,
+							req.default_values[gpio->line_index]);
+					if (gpio->line_fd < 0) {
+						g_print("GPIO %s: lost line handle: %s\n",
+								gpio->name, strerror(-gpio->line_fd));
+						gpio->line_fd = -1;
+					}
+					gpio->line_index = 0;
+				}
+			}
+			close(chip_fd);
+			rc = GPIO_OPEN_ERROR;
+			break;
+		}
+		close(chip_fd);
+
+		for (j = i; j < group->num_gpios; j++) {
+			GPIO* gpio = &group->gpios[j];
+			if (done[j] && gpio->line_fd == -1) {
+				gpio->line_fd = req.fd;
+				gpio->line_shared = req.lines > 1;
+			}
+		}
+		group->handle_fds = g_realloc(group->handle_fds,
+				(group->num_handles + 1) * sizeof(int));
+		group->handle_fds[group->num_handles++] = req.fd;
+	}
+	g_free(done);
+	return rc;
+}
+
+int gpio_group_init(GpioGroup* group, GPIO* gpios, gboolean* pols,
+		size_t num_gpios, GPIO* latch)
+{
+	g_assert (group != NULL);
+	int rc = GPIO_OK;
+	size_t i;
+
+	memset(group, 0, sizeof(*group));
+	group->gpios = gpios;
+	group->pols = pols;
+	group->num_gpios = num_gpios;
+	group->latch = latch;
+
+	rc = gpio_group_request(group);
+	if (rc != GPIO_OK) {
+		return rc;
+	}
+	// sysfs members keep their value file open for the group's lifetime
+	for (i = 0; i < num_gpios; i++) {
+		if (!gpios[i].chardev) {
+			rc = gpio_open(&gpios[i]);
+			if (rc != GPIO_OK) {
+				break;
+			}
+		}
+	}
+	if (rc == GPIO_OK && latch != NULL) {
+		rc = gpio_open(latch);
+	}
+	return rc;
+}
+
+// Drives every line to its asserted (1) or deasserted (0) level
+int gpio_group_set(GpioGroup* group, uint8_t state)
+{
+	g_assert (group != NULL);
+	int rc = GPIO_OK;
+	size_t h, i;
+
+	if (group->latch != NULL) {
+		rc = gpio_write(group->latch, 0);
+		if (rc != GPIO_OK) {
+			return rc;
+		}
+	}
+	for (h = 0; h < group->num_handles; h++) {
+		struct gpiohandle_data data;
+		memset(&data, 0, sizeof(data));
+		for (i = 0; i < group->num_gpios; i++) {
+			GPIO* gpio = &group->gpios[i];
+			if (gpio->chardev && gpio->line_fd == group->handle_fds[h]) {
+				data.values[gpio->line_index] = state ^ !group->pols[i];
+			}
+		}
+		if (ioctl(group->handle_fds[h], GPIOHANDLE_SET_LINE_VALUES_IOCTL,
+				&data) < 0) {
+			rc = GPIO_WRITE_ERROR;
+		}
+	}
+	// sysfs members, and edge lines, which keep their line event fd
+	for (i = 0; i < group->num_gpios; i++) {
+		GPIO* gpio = &group->gpios[i];
+		if (!gpio->chardev || gpio->line_events) {
+			rc |= gpio_write(gpio, state ^ !group->pols[i]);
+		}
+	}
+	if (group->latch != NULL) {
+		rc |= gpio_write(group->latch, 1);
+	}
+	return rc;
+}
+
+// Reads the asserted state of every line into states[num_gpios]
+int gpio_group_get(GpioGroup* group, uint8_t* states)
+{
+	g_assert (group != NULL);
+	int rc = GPIO_OK;
+	size_t h, i;
+
+	for (h = 0; h < group->num_handles; h++) {
+		struct gpiohandle_data data;
+		memset(&data, 0, sizeof(data));
+		if (ioctl(group->handle_fds[h], GPIOHANDLE_GET_LINE_VALUES_IOCTL,
+				&data) < 0) {
+			rc = GPIO_READ_ERROR;
+			continue;
+		}
+		for (i = 0; i < group->num_gpios; i++) {
+			GPIO* gpio = &group->gpios[i];
+			if (gpio->chardev && gpio->line_fd == group->handle_fds[h]) {
+				states[i] = !!data.values[gpio->line_index] ^
+					!group->pols[i];
+			}
+		}
+	}
+	for (i = 0; i < group->num_gpios; i++) {
+		GPIO* gpio = &group->gpios[i];
+		uint8_t value;
+		if (gpio->chardev && !gpio->line_events) {
+			continue;
+		}
+		if (gpio_read(gpio, &value) != GPIO_OK) {
+			rc = GPIO_READ_ERROR;
+			continue;
+		}
+		states[i] = value ^ !group->pols[i];
+	}
+	return rc;
+}
+
+// Closes sysfs value files. Chardev handles stay with the member GPIOs.
+void gpio_group_close(GpioGroup* group)
+{
+	size_t i;
+	for (i = 0; i < group->num_gpios; i++) {
+		gpio_close(&group->gpios[i]);
+	}
+	if (group->latch != NULL) {
+		gpio_close(group->latch);
+	}
+	g_free(group->handle_fds);
+	group->handle_fds = NULL;
+	group->num_handles = 0;
+}
+
+// Turns a line around at runtime, e.g. a bidirectional data line that is
+// sampled after driving a command. Outputs are driven to value. The
+// configured direction in gpio->direction is left untouched.
+int gpio_set_direction(GPIO* gpio, bool out, uint8_t value)
+{
+	g_assert (gpio != NULL);
+	int rc = GPIO_OK;
+	if (gpio->chardev)
+	{
+		int chip_fd;
+		int fd;
+		if (gpio->line_shared)
+		{
+			return GPIO_INIT_ERROR;
+		}
+		chip_fd = gpio_chardev_open_chip(gpio);
+		if (chip_fd < 0)
+		{
+			return GPIO_LOOKUP_ERROR;
+		}
+		close(gpio->line_fd);
+		gpio->line_events = false;
+		fd = gpio_chardev_request(gpio, chip_fd,
+				out ? GPIOHANDLE_REQUEST_OUTPUT : GPIOHANDLE_REQUEST_INPUT,
+				value);
+		close(chip_fd);
+		if (fd < 0)
+		{
+			gpio->line_fd = -1;
+			return GPIO_OPEN_ERROR;
+		}
+		gpio->line_fd = fd;
+		return GPIO_OK;
+	}
+
+	char dev[254];
+	const char* direction = out ? (value ? "high" : "low") : "in";
+	int fd;
+	sprintf(dev,"%s/gpio%d/direction",gpio->dev,gpio->num);
+	fd = open(dev,O_WRONLY);
+	if (fd < 0)
+	{
+		gpio_state_forget(gpio);
+		return GPIO_OPEN_ERROR;
+	}
+	if (write(fd,direction,strlen(direction)) != strlen(direction))
+	{
+		rc = GPIO_WRITE_ERROR;
+	}
+	close(fd);
+	if (rc == GPIO_OK)
+	{
+		gpio_state_store(gpio, out ? "out" : "in");
+	}
+	else
+	{
+		gpio_state_forget(gpio);
+	}
+	return rc;
+}
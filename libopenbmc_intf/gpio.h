@@ -12,8 +12,36 @@ typedef struct {
   gchar* direction;
   int fd;
   bool irq_inited;
+  /* Character device backend: line handle requested once in gpio_init */
+  bool chardev;
+  int line_fd;
+  uint32_t line_offset;
+  /* Position within line_fd when the handle is shared by a gpio group */
+  uint32_t line_index;
+  bool line_shared;
+  /* line_fd is a line event fd, for lines configured for edges */
+  bool line_events;
 } GPIO;
 
+/* Set of lines driven or sampled together. On the character device
+ * backend lines on the same chip share one multi-line handle, so a set
+ * is a single ioctl per chip. */
+typedef struct {
+  size_t num_gpios;
+  GPIO *gpios;
+  /* TRUE for active high */
+  gboolean *pols;
+  /* Optional active high latch enable; held low while outputs change and
+   * raised to commit them together. NULL if not used. */
+  GPIO *latch;
+  size_t num_handles;
+  int *handle_fds;
+} GpioGroup;
+
+//gpio backends
+#define GPIO_BACKEND_SYSFS   0
+#define GPIO_BACKEND_CHARDEV 1
+
 
 //gpio functions
 #define GPIO_OK           0x00
@@ -24,13 +52,28 @@ typedef struct {
 #define GPIO_WRITE_ERROR  0x10
 #define GPIO_LOOKUP_ERROR 0x20
 
+void gpio_set_backend(int);
+int gpio_get_backend(void);
+void gpio_set_root(const char*);
+const char* gpio_get_root(void);
 int gpio_init(GDBusConnection*, GPIO*);
+int gpio_init_many(GDBusConnection*, GPIO**, size_t);
 void gpio_close(GPIO*);
 int  gpio_open(GPIO*);
 int gpio_open_interrupt(GPIO*, GIOFunc, gpointer);
+int gpio_open_events(GPIO*, GIOFunc, gpointer);
+int gpio_read_event(GPIO*, uint8_t*, uint64_t*);
 int gpio_write(GPIO*, uint8_t);
 int gpio_writec(GPIO*, char);
 int gpio_clock_cycle(GPIO*, int);
 int gpio_read(GPIO*,uint8_t*);
+int gpio_set_direction(GPIO*, bool, uint8_t);
+int gpio_chip_info(GPIO*, char*, size_t);
+unsigned long gpio_ops_avoided(void);
+
+int gpio_group_init(GpioGroup*, GPIO*, gboolean*, size_t, GPIO*);
+int gpio_group_set(GpioGroup*, uint8_t);
+int gpio_group_get(GpioGroup*, uint8_t*);
+void gpio_group_close(GpioGroup*);
 
 #endif
@@ -0,0 +1,158 @@
+#include <stdint.h>
+#include <string.h>
+#include "gpio.h"
+#include "gpio_event.h"
+
+// How often a line that cannot interrupt is read instead
+#define GPIO_EVENT_POLL_MS 20
+
+static void
+gpio_event_deliver(GpioEventLine* line, uint8_t value, uint64_t timestamp)
+{
+	GpioEvent event;
+
+	line->value = value;
+	event.gpio = line->gpio;
+	event.value = value;
+	event.timestamp = timestamp;
+	line->func(&event, line->user_data);
+}
+
+// Ends a debounce or glitch window; reports the level the line settled on
+// if it differs from the last one reported. The level is read back rather
+// than taken from the edges, in case one was lost.
+static gboolean
+on_gpio_event_timer(gpointer user_data)
+{
+	GpioEventLine* line = user_data;
+	uint8_t value;
+
+	line->timer_id = 0;
+	if (gpio_read(line->gpio, &value) == GPIO_OK) {
+		line->pending = value;
+	}
+	if (line->pending != line->value) {
+		gpio_event_deliver(line, line->pending, line->pending_ts);
+	}
+	return FALSE;
+}
+
+static void
+gpio_event_edge(GpioEventLine* line, uint8_t value, uint64_t timestamp)
+{
+	// sysfs can wake without a level change, and chardev queues both
+	// edges of a pulse; only transitions matter here
+	if (value == line->pending) {
+		return;
+	}
+	line->pending = value;
+	line->pending_ts = timestamp;
+
+	if (line->glitch_ms) {
+		if (line->timer_id) {
+			g_source_remove(line->timer_id);
+			line->timer_id = 0;
+		}
+		if (value == line->value) {
+			// back where it was before the window closed
+			line->filtered++;
+			return;
+		}
+		line->timer_id = g_timeout_add(line->glitch_ms,
+				on_gpio_event_timer, line);
+		return;
+	}
+	if (line->timer_id) {
+		// bounce; settled level is reported when the window ends
+		line->filtered++;
+		return;
+	}
+	gpio_event_deliver(line, value, timestamp);
+	if (line->debounce_ms) {
+		line->timer_id = g_timeout_add(line->debounce_ms,
+				on_gpio_event_timer, line);
+	}
+}
+
+static gboolean
+on_gpio_event_io(GIOChannel *channel,
+		GIOCondition condition,
+		gpointer user_data)
+{
+	GpioEventLine* line = user_data;
+	uint8_t value;
+	uint64_t timestamp;
+
+	if (gpio_read_event(line->gpio, &value, &timestamp) == GPIO_OK) {
+		gpio_event_edge(line, value, timestamp);
+	}
+	return TRUE;
+}
+
+// Stands in for edges on a line that cannot interrupt, such as one in a
+// mock tree; a level change is taken as an edge when it is seen.
+static gboolean
+on_gpio_event_poll(gpointer user_data)
+{
+	GpioEventLine* line = user_data;
+	uint8_t value;
+
+	if (gpio_read(line->gpio, &value) == GPIO_OK) {
+		gpio_event_edge(line, value, g_get_monotonic_time() * 1000);
+	}
+	return TRUE;
+}
+
+// Starts watching both edges of gpio, which must already be set up with
+// gpio_init(). The line's current level is the starting point; no event
+// is delivered for it. A line that cannot interrupt is polled every
+// GPIO_EVENT_POLL_MS instead, so edges shorter than that can be missed.
+int gpio_event_open(GpioEventLine* line, GPIO* gpio, guint debounce_ms,
+		guint glitch_ms, GpioEventFunc func, gpointer user_data)
+{
+	int rc;
+	uint8_t value = 0;
+
+	memset(line, 0, sizeof(*line));
+	line->gpio = gpio;
+	line->func = func;
+	line->user_data = user_data;
+	line->debounce_ms = debounce_ms;
+	line->glitch_ms = glitch_ms;
+
+	rc = gpio_open_events(gpio, on_gpio_event_io, line);
+	if (rc == GPIO_INIT_ERROR) {
+		g_print("GPIO %s: no edge events, polling\n", gpio->name);
+		rc = GPIO_OK;
+		if (!gpio->chardev && gpio->fd <= 0) {
+			rc = gpio_open(gpio);
+		}
+		if (rc == GPIO_OK) {
+			line->poll_id = g_timeout_add(GPIO_EVENT_POLL_MS,
+					on_gpio_event_poll, line);
+		}
+	}
+	if (rc != GPIO_OK) {
+		return rc;
+	}
+	rc = gpio_read(gpio, &value);
+	if (rc != GPIO_OK) {
+		return rc;
+	}
+	line->value = value;
+	line->pending = value;
+	gpio->irq_inited = true;
+	return GPIO_OK;
+}
+
+void gpio_event_close(GpioEventLine* line)
+{
+	if (line->poll_id) {
+		g_source_remove(line->poll_id);
+		line->poll_id = 0;
+	}
+	if (line->timer_id) {
+		g_source_remove(line->timer_id);
+		line->timer_id = 0;
+	}
+}
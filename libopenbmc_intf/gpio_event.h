@@ -0,0 +1,50 @@
+#ifndef __OBJECTS_GPIO_EVENT_H__
+#define __OBJECTS_GPIO_EVENT_H__
+
+#include <stdint.h>
+#include <gio/gio.h>
+#include "gpio.h"
+
+/* One filtered edge. The timestamp is CLOCK_MONOTONIC nanoseconds of when
+ * the edge was read from the line, not of its delivery after filtering,
+ * so two timestamps from the same line can be subtracted to time a press
+ * and compared with g_get_monotonic_time() * 1000. */
+typedef struct {
+  GPIO *gpio;
+  uint8_t value;
+  uint64_t timestamp;
+} GpioEvent;
+
+typedef void (*GpioEventFunc)(const GpioEvent*, gpointer);
+
+/* Edge watch on one input line. Lines that cannot interrupt are polled.
+ *
+ * debounce_ms: an edge is reported at once, then further edges are held
+ *   back for this long and the final level is reported at the end if it
+ *   differs. Suits buttons, whose leading edge should not be delayed.
+ * glitch_ms: an edge is only reported once the new level has been stable
+ *   for this long; shorter pulses are dropped.
+ */
+typedef struct {
+  GPIO *gpio;
+  GpioEventFunc func;
+  gpointer user_data;
+  guint debounce_ms;
+  guint glitch_ms;
+  /* last reported level */
+  uint8_t value;
+  /* last level seen on the line and when it was seen */
+  uint8_t pending;
+  uint64_t pending_ts;
+  guint timer_id;
+  /* level poll for a line that cannot interrupt */
+  guint poll_id;
+  /* edges dropped by the filter */
+  guint filtered;
+} GpioEventLine;
+
+int gpio_event_open(GpioEventLine*, GPIO*, guint, guint, GpioEventFunc,
+		gpointer);
+void gpio_event_close(GpioEventLine*);
+
+#endif
@@ -20,7 +20,6 @@
 #ifdef __arm__
 static inline void devmem(void* addr, uint32_t val)
 {
-	printf("devmem %p = 0x%08x\n",addr,val);
         asm volatile("" : : : "memory");
         *(volatile uint32_t *)addr = val;
 }
@@ -36,7 +35,7 @@ static inline uint32_t devmem_read(void* addr)
  //       write_reg(reg,val);
 //}
 #else
-static inline uint32_t devmem(uint32_t val, uint32_t reg)
+static inline void devmem(void* addr, uint32_t val)
 {
 }
 static inline uint32_t devmem_read(void* addr)
@@ -14507,11 +14507,102 @@ static const _ExtendedGDBusMethodInfo _control_host_method_info_reboot =
   FALSE
 };
 
+static const _ExtendedGDBusArgInfo _control_host_method_info_getcfam_IN_ARG_address =
+{
+  {
+    -1,
+    (gchar *) "address",
+    (gchar *) "u",
+    NULL
+  },
+  FALSE
+};
+
+static const _ExtendedGDBusArgInfo * const _control_host_method_info_getcfam_IN_ARG_pointers[] =
+{
+  &_control_host_method_info_getcfam_IN_ARG_address,
+  NULL
+};
+
+static const _ExtendedGDBusArgInfo _control_host_method_info_getcfam_OUT_ARG_data =
+{
+  {
+    -1,
+    (gchar *) "data",
+    (gchar *) "u",
+    NULL
+  },
+  FALSE
+};
+
+static const _ExtendedGDBusArgInfo * const _control_host_method_info_getcfam_OUT_ARG_pointers[] =
+{
+  &_control_host_method_info_getcfam_OUT_ARG_data,
+  NULL
+};
+
+static const _ExtendedGDBusMethodInfo _control_host_method_info_getcfam =
+{
+  {
+    -1,
+    (gchar *) "getcfam",
+    (GDBusArgInfo **) &_control_host_method_info_getcfam_IN_ARG_pointers,
+    (GDBusArgInfo **) &_control_host_method_info_getcfam_OUT_ARG_pointers,
+    NULL
+  },
+  "handle-getcfam",
+  FALSE
+};
+
+static const _ExtendedGDBusArgInfo _control_host_method_info_putcfam_IN_ARG_address =
+{
+  {
+    -1,
+    (gchar *) "address",
+    (gchar *) "u",
+    NULL
+  },
+  FALSE
+};
+
+static const _ExtendedGDBusArgInfo _control_host_method_info_putcfam_IN_ARG_data =
+{
+  {
+    -1,
+    (gchar *) "data",
+    (gchar *) "u",
+    NULL
+  },
+  FALSE
+};
+
+static const _ExtendedGDBusArgInfo * const _control_host_method_info_putcfam_IN_ARG_pointers[] =
+{
+  &_control_host_method_info_putcfam_IN_ARG_address,
+  &_control_host_method_info_putcfam_IN_ARG_data,
+  NULL
+};
+
+static const _ExtendedGDBusMethodInfo _control_host_method_info_putcfam =
+{
+  {
+    -1,
+    (gchar *) "putcfam",
+    (GDBusArgInfo **) &_control_host_method_info_putcfam_IN_ARG_pointers,
+    NULL,
+    NULL
+  },
+  "handle-putcfam",
+  FALSE
+};
+
 static const _ExtendedGDBusMethodInfo * const _control_host_method_info_pointers[] =
 {
   &_control_host_method_info_boot,
   &_control_host_method_info_shutdown,
   &_control_host_method_info_reboot,
+  &_control_host_method_info_getcfam,
+  &_control_host_method_info_putcfam,
   NULL
 };
 
@@ -14622,6 +14713,8 @@ control_host_override_properties (GObjectClass *klass, guint property_id_begin)
  * ControlHostIface:
  * @parent_iface: The parent interface.
  * @handle_boot: Handler for the #ControlHost::handle-boot signal.
+ * @handle_getcfam: Handler for the #ControlHost::handle-getcfam signal.
+ * @handle_putcfam: Handler for the #ControlHost::handle-putcfam signal.
  * @handle_reboot: Handler for the #ControlHost::handle-reboot signal.
  * @handle_shutdown: Handler for the #ControlHost::handle-shutdown signal.
  * @get_debug_mode: Getter for the #ControlHost:debug-mode property.
@@ -14704,6 +14797,53 @@ control_host_default_init (ControlHostIface *iface)
     1,
     G_TYPE_DBUS_METHOD_INVOCATION);
 
+  /**
+   * ControlHost::handle-getcfam:
+   * @object: A #ControlHost.
+   * @invocation: A #GDBusMethodInvocation.
+   * @arg_address: Argument passed by remote caller.
+   *
+   * Signal emitted when a remote caller is invoking the <link linkend="gdbus-method-org-openbmc-control-Host.getcfam">getcfam()</link> D-Bus method.
+   *
+   * If a signal handler returns %TRUE, it means the signal handler will handle the invocation (e.g. take a reference to @invocation and eventually call control_host_complete_getcfam() or e.g. g_dbus_method_invocation_return_error() on it) and no order signal handlers will run. If no signal handler handles the invocation, the %G_DBUS_ERROR_UNKNOWN_METHOD error is returned.
+   *
+   * Returns: %TRUE if the invocation was handled, %FALSE to let other signal handlers run.
+   */
+  g_signal_new ("handle-getcfam",
+    G_TYPE_FROM_INTERFACE (iface),
+    G_SIGNAL_RUN_LAST,
+    G_STRUCT_OFFSET (ControlHostIface, handle_getcfam),
+    g_signal_accumulator_true_handled,
+    NULL,
+    g_cclosure_marshal_generic,
+    G_TYPE_BOOLEAN,
+    2,
+    G_TYPE_DBUS_METHOD_INVOCATION, G_TYPE_UINT);
+
+  /**
+   * ControlHost::handle-putcfam:
+   * @object: A #ControlHost.
+   * @invocation: A #GDBusMethodInvocation.
+   * @arg_address: Argument passed by remote caller.
+   * @arg_data: Argument passed by remote caller.
+   *
+   * Signal emitted when a remote caller is invoking the <link linkend="gdbus-method-org-openbmc-control-Host.putcfam">putcfam()</link> D-Bus method.
+   *
+   * If a signal handler returns %TRUE, it means the signal handler will handle the invocation (e.g. take a reference to @invocation and eventually call control_host_complete_putcfam() or e.g. g_dbus_method_invocation_return_error() on it) and no order signal handlers will run. If no signal handler handles the invocation, the %G_DBUS_ERROR_UNKNOWN_METHOD error is returned.
+   *
+   * Returns: %TRUE if the invocation was handled, %FALSE to let other signal handlers run.
+   */
+  g_signal_new ("handle-putcfam",
+    G_TYPE_FROM_INTERFACE (iface),
+    G_SIGNAL_RUN_LAST,
+    G_STRUCT_OFFSET (ControlHostIface, handle_putcfam),
+    g_signal_accumulator_true_handled,
+    NULL,
+    g_cclosure_marshal_generic,
+    G_TYPE_BOOLEAN,
+    3,
+    G_TYPE_DBUS_METHOD_INVOCATION, G_TYPE_UINT, G_TYPE_UINT);
+
   /* GObject signals for received D-Bus signals: */
   /**
    * ControlHost::booted:
@@ -15115,6 +15255,214 @@ _out:
   return _ret != NULL;
 }
 
+/**
+ * control_host_call_getcfam:
+ * @proxy: A #ControlHostProxy.
+ * @arg_address: Argument to pass with the method invocation.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: A #GAsyncReadyCallback to call when the request is satisfied or %NULL.
+ * @user_data: User data to pass to @callback.
+ *
+ * Asynchronously invokes the <link linkend="gdbus-method-org-openbmc-control-Host.getcfam">getcfam()</link> D-Bus method on @proxy.
+ * When the operation is finished, @callback will be invoked in the <link linkend="g-main-context-push-thread-default">thread-default main loop</link> of the thread you are calling this method from.
+ * You can then call control_host_call_getcfam_finish() to get the result of the operation.
+ *
+ * See control_host_call_getcfam_sync() for the synchronous, blocking version of this method.
+ */
+void
+control_host_call_getcfam (
+    ControlHost *proxy,
+    guint arg_address,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  g_dbus_proxy_call (G_DBUS_PROXY (proxy),
+    "getcfam",
+    g_variant_new ("(u)",
+                   arg_address),
+    G_DBUS_CALL_FLAGS_NONE,
+    -1,
+    cancellable,
+    callback,
+    user_data);
+}
+
+/**
+ * control_host_call_getcfam_finish:
+ * @proxy: A #ControlHostProxy.
+ * @out_data: (out): Return location for return parameter or %NULL to ignore.
+ * @res: The #GAsyncResult obtained from the #GAsyncReadyCallback passed to control_host_call_getcfam().
+ * @error: Return location for error or %NULL.
+ *
+ * Finishes an operation started with control_host_call_getcfam().
+ *
+ * Returns: (skip): %TRUE if the call succeded, %FALSE if @error is set.
+ */
+gboolean
+control_host_call_getcfam_finish (
+    ControlHost *proxy,
+    guint *out_data,
+    GAsyncResult *res,
+    GError **error)
+{
+  GVariant *_ret;
+  _ret = g_dbus_proxy_call_finish (G_DBUS_PROXY (proxy), res, error);
+  if (_ret == NULL)
+    goto _out;
+  g_variant_get (_ret,
+                 "(u)",
+                 out_data);
+  g_variant_unref (_ret);
+_out:
+  return _ret != NULL;
+}
+
+/**
+ * control_host_call_getcfam_sync:
+ * @proxy: A #ControlHostProxy.
+ * @arg_address: Argument to pass with the method invocation.
+ * @out_data: (out): Return location for return parameter or %NULL to ignore.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Synchronously invokes the <link linkend="gdbus-method-org-openbmc-control-Host.getcfam">getcfam()</link> D-Bus method on @proxy. The calling thread is blocked until a reply is received.
+ *
+ * See control_host_call_getcfam() for the asynchronous version of this method.
+ *
+ * Returns: (skip): %TRUE if the call succeded, %FALSE if @error is set.
+ */
+gboolean
+control_host_call_getcfam_sync (
+    ControlHost *proxy,
+    guint arg_address,
+    guint *out_data,
+    GCancellable *cancellable,
+    GError **error)
+{
+  GVariant *_ret;
+  _ret = g_dbus_proxy_call_sync (G_DBUS_PROXY (proxy),
+    "getcfam",
+    g_variant_new ("(u)",
+                   arg_address),
+    G_DBUS_CALL_FLAGS_NONE,
+    -1,
+    cancellable,
+    error);
+  if (_ret == NULL)
+    goto _out;
+  g_variant_get (_ret,
+                 "(u)",
+                 out_data);
+  g_variant_unref (_ret);
+_out:
+  return _ret != NULL;
+}
+
+/**
+ * control_host_call_putcfam:
+ * @proxy: A #ControlHostProxy.
+ * @arg_address: Argument to pass with the method invocation.
+ * @arg_data: Argument to pass with the method invocation.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: A #GAsyncReadyCallback to call when the request is satisfied or %NULL.
+ * @user_data: User data to pass to @callback.
+ *
+ * Asynchronously invokes the <link linkend="gdbus-method-org-openbmc-control-Host.putcfam">putcfam()</link> D-Bus method on @proxy.
+ * When the operation is finished, @callback will be invoked in the <link linkend="g-main-context-push-thread-default">thread-default main loop</link> of the thread you are calling this method from.
+ * You can then call control_host_call_putcfam_finish() to get the result of the operation.
+ *
+ * See control_host_call_putcfam_sync() for the synchronous, blocking version of this method.
+ */
+void
+control_host_call_putcfam (
+    ControlHost *proxy,
+    guint arg_address,
+    guint arg_data,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  g_dbus_proxy_call (G_DBUS_PROXY (proxy),
+    "putcfam",
+    g_variant_new ("(uu)",
+                   arg_address,
+                   arg_data),
+    G_DBUS_CALL_FLAGS_NONE,
+    -1,
+    cancellable,
+    callback,
+    user_data);
+}
+
+/**
+ * control_host_call_putcfam_finish:
+ * @proxy: A #ControlHostProxy.
+ * @res: The #GAsyncResult obtained from the #GAsyncReadyCallback passed to control_host_call_putcfam().
+ * @error: Return location for error or %NULL.
+ *
+ * Finishes an operation started with control_host_call_putcfam().
+ *
+ * Returns: (skip): %TRUE if the call succeded, %FALSE if @error is set.
+ */
+gboolean
+control_host_call_putcfam_finish (
+    ControlHost *proxy,
+    GAsyncResult *res,
+    GError **error)
+{
+  GVariant *_ret;
+  _ret = g_dbus_proxy_call_finish (G_DBUS_PROXY (proxy), res, error);
+  if (_ret == NULL)
+    goto _out;
+  g_variant_get (_ret,
+                 "()");
+  g_variant_unref (_ret);
+_out:
+  return _ret != NULL;
+}
+
+/**
+ * control_host_call_putcfam_sync:
+ * @proxy: A #ControlHostProxy.
+ * @arg_address: Argument to pass with the method invocation.
+ * @arg_data: Argument to pass with the method invocation.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Synchronously invokes the <link linkend="gdbus-method-org-openbmc-control-Host.putcfam">putcfam()</link> D-Bus method on @proxy. The calling thread is blocked until a reply is received.
+ *
+ * See control_host_call_putcfam() for the asynchronous version of this method.
+ *
+ * Returns: (skip): %TRUE if the call succeded, %FALSE if @error is set.
+ */
+gboolean
+control_host_call_putcfam_sync (
+    ControlHost *proxy,
+    guint arg_address,
+    guint arg_data,
+    GCancellable *cancellable,
+    GError **error)
+{
+  GVariant *_ret;
+  _ret = g_dbus_proxy_call_sync (G_DBUS_PROXY (proxy),
+    "putcfam",
+    g_variant_new ("(uu)",
+                   arg_address,
+                   arg_data),
+    G_DBUS_CALL_FLAGS_NONE,
+    -1,
+    cancellable,
+    error);
+  if (_ret == NULL)
+    goto _out;
+  g_variant_get (_ret,
+                 "()");
+  g_variant_unref (_ret);
+_out:
+  return _ret != NULL;
+}
+
 /**
  * control_host_complete_boot:
  * @object: A #ControlHost.
@@ -15169,6 +15517,45 @@ control_host_complete_reboot (
     g_variant_new ("()"));
 }
 
+/**
+ * control_host_complete_getcfam:
+ * @object: A #ControlHost.
+ * @invocation: (transfer full): A #GDBusMethodInvocation.
+ * @data: Parameter to return.
+ *
+ * Helper function used in service implementations to finish handling invocations of the <link linkend="gdbus-method-org-openbmc-control-Host.getcfam">getcfam()</link> D-Bus method. If you instead want to finish handling an invocation by returning an error, use g_dbus_method_invocation_return_error() or similar.
+ *
+ * This method will free @invocation, you cannot use it afterwards.
+ */
+void
+control_host_complete_getcfam (
+    ControlHost *object,
+    GDBusMethodInvocation *invocation,
+    guint data)
+{
+  g_dbus_method_invocation_return_value (invocation,
+    g_variant_new ("(u)",
+                   data));
+}
+
+/**
+ * control_host_complete_putcfam:
+ * @object: A #ControlHost.
+ * @invocation: (transfer full): A #GDBusMethodInvocation.
+ *
+ * Helper function used in service implementations to finish handling invocations of the <link linkend="gdbus-method-org-openbmc-control-Host.putcfam">putcfam()</link> D-Bus method. If you instead want to finish handling an invocation by returning an error, use g_dbus_method_invocation_return_error() or similar.
+ *
+ * This method will free @invocation, you cannot use it afterwards.
+ */
+void
+control_host_complete_putcfam (
+    ControlHost *object,
+    GDBusMethodInvocation *invocation)
+{
+  g_dbus_method_invocation_return_value (invocation,
+    g_variant_new ("()"));
+}
+
 /* ------------------------------------------------------------------------ */
 
 /**
@@ -16202,10 +16589,68 @@ static const _ExtendedGDBusSignalInfo _control_power_signal_info_power_lost =
   "power-lost"
 };
 
+static const _ExtendedGDBusArgInfo _control_power_signal_info_power_good_at_ARG_timestamp =
+{
+  {
+    -1,
+    (gchar *) "timestamp",
+    (gchar *) "t",
+    NULL
+  },
+  FALSE
+};
+
+static const _ExtendedGDBusArgInfo * const _control_power_signal_info_power_good_at_ARG_pointers[] =
+{
+  &_control_power_signal_info_power_good_at_ARG_timestamp,
+  NULL
+};
+
+static const _ExtendedGDBusSignalInfo _control_power_signal_info_power_good_at =
+{
+  {
+    -1,
+    (gchar *) "PowerGoodAt",
+    (GDBusArgInfo **) &_control_power_signal_info_power_good_at_ARG_pointers,
+    NULL
+  },
+  "power-good-at"
+};
+
+static const _ExtendedGDBusArgInfo _control_power_signal_info_power_lost_at_ARG_timestamp =
+{
+  {
+    -1,
+    (gchar *) "timestamp",
+    (gchar *) "t",
+    NULL
+  },
+  FALSE
+};
+
+static const _ExtendedGDBusArgInfo * const _control_power_signal_info_power_lost_at_ARG_pointers[] =
+{
+  &_control_power_signal_info_power_lost_at_ARG_timestamp,
+  NULL
+};
+
+static const _ExtendedGDBusSignalInfo _control_power_signal_info_power_lost_at =
+{
+  {
+    -1,
+    (gchar *) "PowerLostAt",
+    (GDBusArgInfo **) &_control_power_signal_info_power_lost_at_ARG_pointers,
+    NULL
+  },
+  "power-lost-at"
+};
+
 static const _ExtendedGDBusSignalInfo * const _control_power_signal_info_pointers[] =
 {
   &_control_power_signal_info_power_good,
   &_control_power_signal_info_power_lost,
+  &_control_power_signal_info_power_good_at,
+  &_control_power_signal_info_power_lost_at,
   NULL
 };
 
@@ -16320,6 +16765,8 @@ control_power_override_properties (GObjectClass *klass, guint property_id_begin)
  * @get_state: Getter for the #ControlPower:state property.
  * @power_good: Handler for the #ControlPower::power-good signal.
  * @power_lost: Handler for the #ControlPower::power-lost signal.
+ * @power_good_at: Handler for the #ControlPower::power-good-at signal.
+ * @power_lost_at: Handler for the #ControlPower::power-lost-at signal.
  *
  * Virtual table for the D-Bus interface <link linkend="gdbus-interface-org-openbmc-control-Power.top_of_page">org.openbmc.control.Power</link>.
  */
@@ -16413,6 +16860,44 @@ control_power_default_init (ControlPowerIface *iface)
     G_TYPE_NONE,
     0);
 
+  /**
+   * ControlPower::power-good-at:
+   * @object: A #ControlPower.
+   * @arg_timestamp: Argument.
+   *
+   * On the client-side, this signal is emitted whenever the D-Bus signal <link linkend="gdbus-signal-org-openbmc-control-Power.PowerGoodAt">"PowerGoodAt"</link> is received.
+   *
+   * On the service-side, this signal can be used with e.g. g_signal_emit_by_name() to make the object emit the D-Bus signal.
+   */
+  g_signal_new ("power-good-at",
+    G_TYPE_FROM_INTERFACE (iface),
+    G_SIGNAL_RUN_LAST,
+    G_STRUCT_OFFSET (ControlPowerIface, power_good_at),
+    NULL,
+    NULL,
+    g_cclosure_marshal_generic,
+    G_TYPE_NONE,
+    1, G_TYPE_UINT64);
+
+  /**
+   * ControlPower::power-lost-at:
+   * @object: A #ControlPower.
+   * @arg_timestamp: Argument.
+   *
+   * On the client-side, this signal is emitted whenever the D-Bus signal <link linkend="gdbus-signal-org-openbmc-control-Power.PowerLostAt">"PowerLostAt"</link> is received.
+   *
+   * On the service-side, this signal can be used with e.g. g_signal_emit_by_name() to make the object emit the D-Bus signal.
+   */
+  g_signal_new ("power-lost-at",
+    G_TYPE_FROM_INTERFACE (iface),
+    G_SIGNAL_RUN_LAST,
+    G_STRUCT_OFFSET (ControlPowerIface, power_lost_at),
+    NULL,
+    NULL,
+    g_cclosure_marshal_generic,
+    G_TYPE_NONE,
+    1, G_TYPE_UINT64);
+
   /* GObject properties for D-Bus properties: */
   /**
    * ControlPower:pgood:
@@ -16562,6 +17047,36 @@ control_power_emit_power_lost (
   g_signal_emit_by_name (object, "power-lost");
 }
 
+/**
+ * control_power_emit_power_good_at:
+ * @object: A #ControlPower.
+ * @arg_timestamp: Argument to pass with the signal.
+ *
+ * Emits the <link linkend="gdbus-signal-org-openbmc-control-Power.PowerGoodAt">"PowerGoodAt"</link> D-Bus signal.
+ */
+void
+control_power_emit_power_good_at (
+    ControlPower *object,
+    guint64 arg_timestamp)
+{
+  g_signal_emit_by_name (object, "power-good-at", arg_timestamp);
+}
+
+/**
+ * control_power_emit_power_lost_at:
+ * @object: A #ControlPower.
+ * @arg_timestamp: Argument to pass with the signal.
+ *
+ * Emits the <link linkend="gdbus-signal-org-openbmc-control-Power.PowerLostAt">"PowerLostAt"</link> D-Bus signal.
+ */
+void
+control_power_emit_power_lost_at (
+    ControlPower *object,
+    guint64 arg_timestamp)
+{
+  g_signal_emit_by_name (object, "power-lost-at", arg_timestamp);
+}
+
 /**
  * control_power_call_set_power_state:
  * @proxy: A #ControlPowerProxy.
@@ -17513,6 +18028,54 @@ _control_power_on_signal_power_lost (
   g_list_free_full (connections, g_object_unref);
 }
 
+static void
+_control_power_on_signal_power_good_at (
+    ControlPower *object,
+    guint64 arg_timestamp)
+{
+  ControlPowerSkeleton *skeleton = CONTROL_POWER_SKELETON (object);
+
+  GList      *connections, *l;
+  GVariant   *signal_variant;
+  connections = g_dbus_interface_skeleton_get_connections (G_DBUS_INTERFACE_SKELETON (skeleton));
+
+  signal_variant = g_variant_ref_sink (g_variant_new ("(t)",
+                   arg_timestamp));
+  for (l = connections; l != NULL; l = l->next)
+    {
+      GDBusConnection *connection = l->data;
+      g_dbus_connection_emit_signal (connection,
+        NULL, g_dbus_interface_skeleton_get_object_path (G_DBUS_INTERFACE_SKELETON (skeleton)), "org.openbmc.control.Power", "PowerGoodAt",
+        signal_variant, NULL);
+    }
+  g_variant_unref (signal_variant);
+  g_list_free_full (connections, g_object_unref);
+}
+
+static void
+_control_power_on_signal_power_lost_at (
+    ControlPower *object,
+    guint64 arg_timestamp)
+{
+  ControlPowerSkeleton *skeleton = CONTROL_POWER_SKELETON (object);
+
+  GList      *connections, *l;
+  GVariant   *signal_variant;
+  connections = g_dbus_interface_skeleton_get_connections (G_DBUS_INTERFACE_SKELETON (skeleton));
+
+  signal_variant = g_variant_ref_sink (g_variant_new ("(t)",
+                   arg_timestamp));
+  for (l = connections; l != NULL; l = l->next)
+    {
+      GDBusConnection *connection = l->data;
+      g_dbus_connection_emit_signal (connection,
+        NULL, g_dbus_interface_skeleton_get_object_path (G_DBUS_INTERFACE_SKELETON (skeleton)), "org.openbmc.control.Power", "PowerLostAt",
+        signal_variant, NULL);
+    }
+  g_variant_unref (signal_variant);
+  g_list_free_full (connections, g_object_unref);
+}
+
 static void control_power_skeleton_iface_init (ControlPowerIface *iface);
 #if GLIB_VERSION_MAX_ALLOWED >= GLIB_VERSION_2_38
 G_DEFINE_TYPE_WITH_CODE (ControlPowerSkeleton, control_power_skeleton, G_TYPE_DBUS_INTERFACE_SKELETON,
@@ -17760,6 +18323,8 @@ control_power_skeleton_iface_init (ControlPowerIface *iface)
 {
   iface->power_good = _control_power_on_signal_power_good;
   iface->power_lost = _control_power_on_signal_power_lost;
+  iface->power_good_at = _control_power_on_signal_power_good_at;
+  iface->power_lost_at = _control_power_on_signal_power_lost_at;
   iface->get_pgood = control_power_skeleton_get_pgood;
   iface->get_state = control_power_skeleton_get_state;
   iface->get_pgood_timeout = control_power_skeleton_get_pgood_timeout;
@@ -1873,6 +1873,17 @@ struct _ControlHostIface
     ControlHost *object,
     GDBusMethodInvocation *invocation);
 
+  gboolean (*handle_getcfam) (
+    ControlHost *object,
+    GDBusMethodInvocation *invocation,
+    guint arg_address);
+
+  gboolean (*handle_putcfam) (
+    ControlHost *object,
+    GDBusMethodInvocation *invocation,
+    guint arg_address,
+    guint arg_data);
+
   gboolean (*handle_reboot) (
     ControlHost *object,
     GDBusMethodInvocation *invocation);
@@ -1909,6 +1920,15 @@ void control_host_complete_reboot (
     ControlHost *object,
     GDBusMethodInvocation *invocation);
 
+void control_host_complete_getcfam (
+    ControlHost *object,
+    GDBusMethodInvocation *invocation,
+    guint data);
+
+void control_host_complete_putcfam (
+    ControlHost *object,
+    GDBusMethodInvocation *invocation);
+
 
 
 /* D-Bus signal emissions functions: */
@@ -1966,6 +1986,46 @@ gboolean control_host_call_reboot_sync (
     GCancellable *cancellable,
     GError **error);
 
+void control_host_call_getcfam (
+    ControlHost *proxy,
+    guint arg_address,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+
+gboolean control_host_call_getcfam_finish (
+    ControlHost *proxy,
+    guint *out_data,
+    GAsyncResult *res,
+    GError **error);
+
+gboolean control_host_call_getcfam_sync (
+    ControlHost *proxy,
+    guint arg_address,
+    guint *out_data,
+    GCancellable *cancellable,
+    GError **error);
+
+void control_host_call_putcfam (
+    ControlHost *proxy,
+    guint arg_address,
+    guint arg_data,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+
+gboolean control_host_call_putcfam_finish (
+    ControlHost *proxy,
+    GAsyncResult *res,
+    GError **error);
+
+gboolean control_host_call_putcfam_sync (
+    ControlHost *proxy,
+    guint arg_address,
+    guint arg_data,
+    GCancellable *cancellable,
+    GError **error);
+
 
 
 /* D-Bus property accessors: */
@@ -2112,6 +2172,14 @@ struct _ControlPowerIface
   void (*power_lost) (
     ControlPower *object);
 
+  void (*power_good_at) (
+    ControlPower *object,
+    guint64 arg_timestamp);
+
+  void (*power_lost_at) (
+    ControlPower *object,
+    guint64 arg_timestamp);
+
 };
 
 GType control_power_get_type (void) G_GNUC_CONST;
@@ -2139,6 +2207,14 @@ void control_power_emit_power_good (
 void control_power_emit_power_lost (
     ControlPower *object);
 
+void control_power_emit_power_good_at (
+    ControlPower *object,
+    guint64 arg_timestamp);
+
+void control_power_emit_power_lost_at (
+    ControlPower *object,
+    guint64 arg_timestamp);
+
 
 
 /* D-Bus method calls: */
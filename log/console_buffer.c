@@ -0,0 +1,698 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "console_buffer.h"
+
+#define LINES_INIT_SIZE 64
+#define BASES_INIT_SIZE 4
+
+/* delta of a line whose time is the next entry in bases */
+#define TIME_BASE UINT32_MAX
+
+int console_buffer_init(struct console_buffer *cb, size_t capacity)
+{
+	memset(cb, 0, sizeof(*cb));
+	cb->fd = -1;
+	if (capacity < 2)
+		return -EINVAL;
+
+	cb->data = malloc(capacity);
+	cb->lines = malloc(LINES_INIT_SIZE * sizeof(*cb->lines));
+	cb->line_deltas = malloc(LINES_INIT_SIZE * sizeof(*cb->line_deltas));
+	if (!cb->data || !cb->lines || !cb->line_deltas) {
+		console_buffer_free(cb);
+		return -ENOMEM;
+	}
+	cb->alloc = capacity;
+	cb->capacity = capacity;
+	cb->lines_size = LINES_INIT_SIZE;
+
+	return 0;
+}
+
+void console_buffer_free(struct console_buffer *cb)
+{
+	if (cb->header)
+		munmap(cb->header, sizeof(*cb->header) + cb->alloc);
+	else
+		free(cb->data);
+	if (cb->fd >= 0)
+		close(cb->fd);
+	free(cb->path);
+	free(cb->lines);
+	free(cb->line_deltas);
+	free(cb->bases);
+	memset(cb, 0, sizeof(*cb));
+	cb->fd = -1;
+}
+
+static size_t line_index(const struct console_buffer *cb, size_t i)
+{
+	return (cb->lines_head + i) & (cb->lines_size - 1);
+}
+
+static uint64_t *line_slot(const struct console_buffer *cb, size_t i)
+{
+	return &cb->lines[line_index(cb, i)];
+}
+
+static uint64_t *base_slot(const struct console_buffer *cb, size_t i)
+{
+	return &cb->bases[(cb->bases_head + i) & (cb->bases_size - 1)];
+}
+
+static int base_push(struct console_buffer *cb, uint64_t time)
+{
+	uint64_t *bases;
+	size_t i, size;
+
+	if (cb->bases_count == cb->bases_size) {
+		/* unwrap into a buffer twice the size */
+		size = cb->bases_size ? 2 * cb->bases_size : BASES_INIT_SIZE;
+		bases = malloc(size * sizeof(*bases));
+		if (!bases)
+			return -ENOMEM;
+		for (i = 0; i < cb->bases_count; i++)
+			bases[i] = *base_slot(cb, i);
+		free(cb->bases);
+		cb->bases = bases;
+		cb->bases_size = size;
+		cb->bases_head = 0;
+	}
+	*base_slot(cb, cb->bases_count++) = time;
+
+	return 0;
+}
+
+/* Give the line in slot the time now, following a line at time prev: as
+ * a delta if the clock moved forward by less than a delta holds, or else
+ * as a new base, so that a clock stepped back or a long silence is kept
+ * as it was. Without memory for a base the line keeps time prev.
+ */
+static void time_set(struct console_buffer *cb, size_t slot, uint64_t prev,
+		uint64_t now)
+{
+	if (now >= prev && now - prev < TIME_BASE) {
+		cb->line_deltas[slot] = now - prev;
+	} else if (base_push(cb, now) == 0) {
+		cb->line_deltas[slot] = TIME_BASE;
+	} else {
+		cb->line_deltas[slot] = 0;
+		now = prev;
+	}
+	cb->last_time = now;
+}
+
+/* time of the line after one at time t, the i-th entry of lines starting
+ * it; *base counts the bases passed so far
+ */
+static uint64_t time_next(const struct console_buffer *cb, size_t i,
+		uint64_t t, size_t *base)
+{
+	uint32_t delta = cb->line_deltas[line_index(cb, i)];
+
+	if (delta == TIME_BASE)
+		return *base_slot(cb, (*base)++);
+	return t + delta;
+}
+
+static int line_push(struct console_buffer *cb, uint64_t seq, uint64_t now)
+{
+	uint32_t *deltas;
+	uint64_t *lines;
+	size_t i;
+
+	if (cb->lines_count == cb->lines_size) {
+		/* unwrap into buffers twice the size */
+		lines = malloc(2 * cb->lines_size * sizeof(*lines));
+		deltas = malloc(2 * cb->lines_size * sizeof(*deltas));
+		if (!lines || !deltas) {
+			free(lines);
+			free(deltas);
+			return -ENOMEM;
+		}
+		for (i = 0; i < cb->lines_count; i++) {
+			lines[i] = cb->lines[line_index(cb, i)];
+			deltas[i] = cb->line_deltas[line_index(cb, i)];
+		}
+		free(cb->lines);
+		free(cb->line_deltas);
+		cb->lines = lines;
+		cb->line_deltas = deltas;
+		cb->lines_size *= 2;
+		cb->lines_head = 0;
+	}
+	i = line_index(cb, cb->lines_count++);
+	cb->lines[i] = seq;
+	time_set(cb, i, cb->last_time, now);
+
+	return 0;
+}
+
+/* the newest line, in slot, ended the last chunk and only starts now */
+static void line_restart(struct console_buffer *cb, size_t slot,
+		uint64_t now)
+{
+	if (cb->line_deltas[slot] == TIME_BASE) {
+		*base_slot(cb, cb->bases_count - 1) = now;
+		cb->last_time = now;
+		return;
+	}
+
+	time_set(cb, slot, cb->last_time - cb->line_deltas[slot], now);
+}
+
+/* drop the oldest line, or everything if there is only a partial one */
+static void evict_line(struct console_buffer *cb)
+{
+	if (!cb->lines_count) {
+		cb->head = cb->tail;
+		return;
+	}
+	cb->head = cb->lines[cb->lines_head];
+	if (cb->line_deltas[cb->lines_head] == TIME_BASE) {
+		cb->head_time = *base_slot(cb, 0);
+		cb->bases_head = (cb->bases_head + 1) & (cb->bases_size - 1);
+		cb->bases_count--;
+	} else {
+		cb->head_time += cb->line_deltas[cb->lines_head];
+	}
+	cb->lines_head = (cb->lines_head + 1) & (cb->lines_size - 1);
+	cb->lines_count--;
+}
+
+/* copy len bytes into a ring of size bytes at sequence number seq,
+ * wrapping around the end of data
+ */
+static void ring_put(char *data, size_t size, uint64_t seq,
+		const char *buf, size_t len)
+{
+	size_t off = seq % size;
+	size_t first = size - off;
+
+	if (first > len)
+		first = len;
+	memcpy(&data[off], buf, first);
+	memcpy(data, buf + first, len - first);
+}
+
+/* record the start of each line after a newline in buf, which holds the
+ * bytes from sequence number seq
+ */
+static int index_lines(struct console_buffer *cb, uint64_t seq,
+		const char *buf, size_t len, uint64_t now)
+{
+	const char *p, *end = buf + len;
+	int rc;
+
+	for (p = buf; (p = memchr(p, '\n', end - p)); p++) {
+		rc = line_push(cb, seq + (p - buf) + 1, now);
+		if (rc)
+			return rc;
+	}
+
+	return 0;
+}
+
+static void header_update(struct console_buffer *cb)
+{
+	if (!cb->header)
+		return;
+	cb->header->alloc = cb->alloc;
+	cb->header->capacity = cb->capacity;
+	cb->header->head = cb->head;
+	cb->header->tail = cb->tail;
+}
+
+int console_buffer_append(struct console_buffer *cb, const char *buf,
+		size_t len, uint64_t now)
+{
+	size_t max = cb->capacity - 1;
+	size_t last;
+	int rc;
+
+	/* only the end of a chunk larger than the buffer can be kept */
+	if (len > max) {
+		cb->tail += len - max;
+		buf += len - max;
+		len = max;
+		cb->head = cb->tail;
+		cb->lines_count = 0;
+		cb->bases_count = 0;
+	}
+
+	while (console_buffer_size(cb) + len > max)
+		evict_line(cb);
+
+	/* a line that ended the last chunk only starts now */
+	if (cb->head == cb->tail) {
+		cb->head_time = cb->last_time = now;
+	} else if (cb->lines_count) {
+		last = line_index(cb, cb->lines_count - 1);
+		if (cb->lines[last] == cb->tail)
+			line_restart(cb, last, now);
+	}
+
+	ring_put(cb->data, cb->alloc, cb->tail, buf, len);
+	rc = index_lines(cb, cb->tail, buf, len, now);
+	cb->tail += len;
+
+	return rc;
+}
+
+/* Copy up to len bytes starting at sequence number seq, clipped to what
+ * the buffer still holds. Returns the number of bytes copied.
+ */
+size_t console_buffer_copy(const struct console_buffer *cb, uint64_t seq,
+		char *dst, size_t len)
+{
+	size_t off, first;
+
+	if (seq < cb->head)
+		seq = cb->head;
+	if (seq >= cb->tail)
+		return 0;
+	if (len > cb->tail - seq)
+		len = cb->tail - seq;
+
+	off = seq % cb->alloc;
+	first = cb->alloc - off;
+	if (first > len)
+		first = len;
+	memcpy(dst, &cb->data[off], first);
+	memcpy(dst + first, cb->data, len - first);
+
+	return len;
+}
+
+/* number of lines held, counting a final one with no newline yet */
+size_t console_buffer_lines(const struct console_buffer *cb)
+{
+	uint64_t last = cb->head;
+
+	if (cb->lines_count)
+		last = *line_slot(cb, cb->lines_count - 1);
+
+	return cb->lines_count + (last < cb->tail);
+}
+
+/* sequence number at which the last n lines start */
+uint64_t console_buffer_last_lines(const struct console_buffer *cb,
+		size_t n)
+{
+	size_t lines = console_buffer_lines(cb);
+
+	if (n >= lines)
+		return cb->head;
+	return *line_slot(cb, lines - n - 1);
+}
+
+/* Find the first line that started at or after time. Returns its index
+ * counting the line at head as 0, which is the number of lines if there
+ * is none, and sets *seq to where it starts.
+ */
+size_t console_buffer_seek_time(const struct console_buffer *cb,
+		uint64_t time, uint64_t *seq)
+{
+	size_t lines = console_buffer_lines(cb);
+	uint64_t t = cb->head_time;
+	size_t i, base = 0;
+
+	*seq = cb->head;
+	if (!lines || t >= time)
+		return 0;
+
+	for (i = 0; i < lines - 1; i++) {
+		t = time_next(cb, i, t, &base);
+		if (t >= time) {
+			*seq = *line_slot(cb, i);
+			return i + 1;
+		}
+	}
+
+	*seq = cb->tail;
+	return lines;
+}
+
+/* Fill times with the times of up to n lines from the line with index
+ * line, counting the line at head as 0. Returns how many were filled.
+ */
+size_t console_buffer_times(const struct console_buffer *cb, size_t line,
+		uint64_t *times, size_t n)
+{
+	size_t lines = console_buffer_lines(cb);
+	uint64_t t = cb->head_time;
+	size_t i, base = 0, filled = 0;
+
+	for (i = 0; i < lines && filled < n; i++) {
+		if (i)
+			t = time_next(cb, i - 1, t, &base);
+		if (i >= line)
+			times[filled++] = t;
+	}
+
+	return filled;
+}
+
+/* Change the limit on what the buffer holds, within what is already
+ * allocated. Shrinking drops whole lines from the front, so it costs
+ * only the lines dropped.
+ */
+int console_buffer_set_capacity(struct console_buffer *cb, size_t capacity)
+{
+	if (capacity < 2)
+		return -EINVAL;
+	if (capacity > cb->alloc)
+		return -ENOSPC;
+
+	while (console_buffer_size(cb) > capacity - 1)
+		evict_line(cb);
+	cb->capacity = capacity;
+
+	return 0;
+}
+
+/* copy len bytes from sequence number seq out of the buffer's ring into
+ * another ring of alloc bytes, at the same sequence numbers
+ */
+static void ring_move(char *data, size_t alloc,
+		const struct console_buffer *cb, uint64_t seq, size_t len)
+{
+	size_t off = seq % cb->alloc;
+	size_t first = cb->alloc - off;
+
+	if (first > len)
+		first = len;
+	ring_put(data, alloc, seq, &cb->data[off], first);
+	ring_put(data, alloc, seq + first, cb->data, len - first);
+}
+
+/* Moving the contents to a ring of another size is done in steps, so that
+ * the caller holds whatever lock guards the buffer only while bytes are
+ * copied between memory rings:
+ *
+ *   begin     no lock	allocates the ring, or creates and maps a new
+ *			file next to the buffer's own
+ *   snapshot  lock	copies what the buffer holds, into the ring or,
+ *			for a file, into scratch memory
+ *   fill      no lock	writes the scratch copy into the new file
+ *   commit    lock	copies what was appended since the snapshot and
+ *			switches the buffer to the new ring
+ *   end       no lock	renames the new file over the old one and frees
+ *			whatever the buffer no longer uses
+ *
+ * Only one resize may be under way, and nothing else may change the
+ * buffer's capacity meanwhile. end also abandons a resize after begin.
+ */
+int console_buffer_resize_begin(const struct console_buffer *cb,
+		struct console_buffer_resize *rs, size_t capacity)
+{
+	size_t map_size = sizeof(*rs->header) + capacity;
+	void *map;
+	int rc;
+
+	memset(rs, 0, sizeof(*rs));
+	rs->fd = -1;
+	if (capacity < 2)
+		return -EINVAL;
+	rs->alloc = capacity;
+	rs->capacity = capacity;
+
+	if (!cb->header) {
+		rs->data = malloc(capacity);
+		return rs->data ? 0 : -ENOMEM;
+	}
+
+	rs->target = cb->path;
+	rs->scratch = malloc(cb->capacity);
+	if (!rs->scratch ||
+			asprintf(&rs->path, "%s.resize", cb->path) < 0) {
+		rs->path = NULL;
+		console_buffer_resize_end(rs);
+		return -ENOMEM;
+	}
+	rs->fd = open(rs->path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (rs->fd < 0 || ftruncate(rs->fd, map_size))
+		goto err;
+	map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			rs->fd, 0);
+	if (map == MAP_FAILED)
+		goto err;
+	/* not valid until commit has filled in the header */
+	rs->header = map;
+	rs->header->version = CONSOLE_BUFFER_VERSION;
+	rs->data = (char *)map + sizeof(*rs->header);
+
+	return 0;
+
+err:
+	rc = -errno;
+	console_buffer_resize_end(rs);
+	return rc;
+}
+
+void console_buffer_resize_snapshot(const struct console_buffer *cb,
+		struct console_buffer_resize *rs)
+{
+	size_t keep = console_buffer_size(cb);
+
+	if (keep > rs->capacity - 1)
+		keep = rs->capacity - 1;
+	rs->tail = cb->tail;
+	rs->head = cb->tail - keep;
+	if (rs->scratch)
+		console_buffer_copy(cb, rs->head, rs->scratch, keep);
+	else
+		ring_move(rs->data, rs->alloc, cb, rs->head, keep);
+}
+
+void console_buffer_resize_fill(struct console_buffer_resize *rs)
+{
+	if (!rs->scratch)
+		return;
+	ring_put(rs->data, rs->alloc, rs->head, rs->scratch,
+			rs->tail - rs->head);
+	free(rs->scratch);
+	rs->scratch = NULL;
+}
+
+void console_buffer_resize_commit(struct console_buffer *cb,
+		struct console_buffer_resize *rs)
+{
+	struct console_buffer_header *header = cb->header;
+	char *data = cb->data;
+	size_t alloc = cb->alloc;
+	uint64_t from;
+	int fd = cb->fd;
+
+	while (console_buffer_size(cb) > rs->capacity - 1)
+		evict_line(cb);
+	from = rs->tail > cb->head ? rs->tail : cb->head;
+	ring_move(rs->data, rs->alloc, cb, from, cb->tail - from);
+
+	/* the old storage goes back to rs for end to release */
+	cb->header = rs->header;
+	cb->data = rs->data;
+	cb->alloc = rs->alloc;
+	cb->fd = rs->fd;
+	cb->capacity = rs->capacity;
+	rs->header = header;
+	rs->data = data;
+	rs->alloc = alloc;
+	rs->fd = fd;
+	rs->committed = 1;
+	if (cb->header) {
+		header_update(cb);
+		cb->header->magic = CONSOLE_BUFFER_MAGIC;
+	}
+}
+
+int console_buffer_resize_end(struct console_buffer_resize *rs)
+{
+	int rc = 0;
+
+	if (rs->path) {
+		if (!rs->committed)
+			unlink(rs->path);
+		else if (rename(rs->path, rs->target))
+			rc = -errno;
+		free(rs->path);
+	}
+	if (rs->header)
+		munmap(rs->header, sizeof(*rs->header) + rs->alloc);
+	else
+		free(rs->data);
+	if (rs->fd >= 0)
+		close(rs->fd);
+	free(rs->scratch);
+	memset(rs, 0, sizeof(*rs));
+	rs->fd = -1;
+
+	return rc;
+}
+
+/* Moving the header of a file backed buffer on is left to the caller's
+ * sync, so that it only ever covers data already written to the file.
+ * mark records, under the caller's lock, what the buffer holds; the
+ * caller then flushes a duplicate fd of the file without the lock, and
+ * console_buffer_sync_header(), under the lock again, points the header
+ * at what of the mark is still held. Returns 1 if the header changed and
+ * needs flushing in turn, 0 if not, as when a resize has moved the buffer
+ * to another file since the mark.
+ */
+void console_buffer_sync_mark(const struct console_buffer *cb,
+		struct console_buffer_header *mark)
+{
+	mark->magic = CONSOLE_BUFFER_MAGIC;
+	mark->version = CONSOLE_BUFFER_VERSION;
+	mark->alloc = cb->alloc;
+	mark->capacity = cb->capacity;
+	mark->head = cb->head;
+	mark->tail = cb->tail;
+}
+
+int console_buffer_sync_header(struct console_buffer *cb,
+		const struct console_buffer_header *mark, int fd)
+{
+	struct stat synced, current;
+	uint64_t head;
+
+	if (!cb->header)
+		return 0;
+	if (fstat(fd, &synced) || fstat(cb->fd, &current))
+		return -errno;
+	if (synced.st_dev != current.st_dev ||
+			synced.st_ino != current.st_ino)
+		return 0;
+
+	/* lines evicted since the mark may have been overwritten */
+	head = mark->head > cb->head ? mark->head : cb->head;
+	if (head > mark->tail)
+		head = mark->tail;
+	cb->header->alloc = cb->alloc;
+	cb->header->capacity = cb->capacity;
+	cb->header->head = head;
+	cb->header->tail = mark->tail;
+
+	return 1;
+}
+
+/* rebuild the line index from the contents of a recovered file */
+static int index_recovered(struct console_buffer *cb)
+{
+	size_t size = console_buffer_size(cb);
+	size_t off = cb->head % cb->alloc;
+	size_t first = cb->alloc - off;
+	int rc;
+
+	if (first > size)
+		first = size;
+	rc = index_lines(cb, cb->head, &cb->data[off], first, cb->last_time);
+	if (rc)
+		return rc;
+	return index_lines(cb, cb->head + first, cb->data, size - first,
+			cb->last_time);
+}
+
+static int header_valid(const struct console_buffer_header *header,
+		size_t file_size)
+{
+	return header->magic == CONSOLE_BUFFER_MAGIC &&
+		header->version == CONSOLE_BUFFER_VERSION &&
+		header->capacity >= 2 &&
+		header->capacity <= header->alloc &&
+		header->alloc <= file_size - sizeof(*header) &&
+		header->head <= header->tail &&
+		header->tail - header->head < header->capacity;
+}
+
+/* Open a buffer backed by the file at path. If the file holds a valid
+ * buffer its contents, sequence numbers and capacity are recovered;
+ * otherwise it is started afresh with the given capacity.
+ */
+int console_buffer_open(struct console_buffer *cb, const char *path,
+		size_t capacity)
+{
+	struct console_buffer_header saved, *header;
+	size_t map_size;
+	struct stat st;
+	void *map;
+	int rc;
+
+	memset(cb, 0, sizeof(*cb));
+	cb->fd = -1;
+	if (capacity < 2)
+		return -EINVAL;
+
+	cb->lines = malloc(LINES_INIT_SIZE * sizeof(*cb->lines));
+	cb->line_deltas = malloc(LINES_INIT_SIZE * sizeof(*cb->line_deltas));
+	if (!cb->lines || !cb->line_deltas) {
+		console_buffer_free(cb);
+		return -ENOMEM;
+	}
+	cb->lines_size = LINES_INIT_SIZE;
+
+	cb->path = strdup(path);
+	if (!cb->path) {
+		console_buffer_free(cb);
+		return -ENOMEM;
+	}
+	cb->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (cb->fd < 0 || fstat(cb->fd, &st))
+		goto err;
+
+	if ((size_t)st.st_size > sizeof(saved) &&
+			pread(cb->fd, &saved, sizeof(saved), 0) == sizeof(saved) &&
+			header_valid(&saved, st.st_size)) {
+		map_size = sizeof(saved) + saved.alloc;
+		map = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED, cb->fd, 0);
+		if (map == MAP_FAILED)
+			goto err;
+		cb->header = map;
+		cb->data = (char *)map + sizeof(saved);
+		cb->alloc = saved.alloc;
+		cb->capacity = saved.capacity;
+		cb->head = saved.head;
+		cb->tail = saved.tail;
+		cb->head_time = cb->last_time =
+			(uint64_t)st.st_mtim.tv_sec * 1000 +
+			st.st_mtim.tv_nsec / 1000000;
+		rc = index_recovered(cb);
+		if (rc) {
+			console_buffer_free(cb);
+			return rc;
+		}
+		return 0;
+	}
+
+	/* nothing usable in the file, start again */
+	map_size = sizeof(*header) + capacity;
+	if (ftruncate(cb->fd, 0) || ftruncate(cb->fd, map_size))
+		goto err;
+	map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			cb->fd, 0);
+	if (map == MAP_FAILED)
+		goto err;
+	header = map;
+	header->magic = CONSOLE_BUFFER_MAGIC;
+	header->version = CONSOLE_BUFFER_VERSION;
+	cb->header = header;
+	cb->data = (char *)map + sizeof(*header);
+	cb->alloc = capacity;
+	cb->capacity = capacity;
+	header_update(cb);
+
+	return 0;
+
+err:
+	rc = -errno;
+	console_buffer_free(cb);
+	return rc;
+}
@@ -0,0 +1,125 @@
+#ifndef __CONSOLE_BUFFER_H__
+#define __CONSOLE_BUFFER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Ring buffer of console output, evicted a whole line at a time.
+ *
+ * Every byte ever appended has a sequence number; the buffer holds the
+ * bytes from head up to (not including) tail, and the byte with sequence
+ * number s lives at data[s % alloc]. At most capacity - 1 bytes are
+ * kept, as the original flat buffer reserved one for a NUL. capacity may
+ * be below alloc, so a small shrink only drops lines and keeps the space
+ * for growing again; the console_buffer_resize_*() steps move the
+ * contents to a ring of another size.
+ *
+ * lines holds, oldest first, the sequence number at which every line but
+ * the first one starts (the byte after each '\n'), so dropping the oldest
+ * line is just moving head to the first entry.
+ *
+ * Each line also has the time, in milliseconds, at which its first byte
+ * was appended. line_deltas holds each entry's time as the step from the
+ * line before, so it costs four bytes a line and nothing per byte. A
+ * step that does not fit, because the clock went backwards or nothing
+ * came for weeks, is kept exactly instead: the delta is UINT32_MAX and
+ * the time is the next entry in bases. Times are as the caller gave
+ * them, so they need not be in order, and seeking finds the first line
+ * at or after a time. Lines recovered from a file are given the time
+ * the file was last written, as their own times are not kept.
+ *
+ * The buffer does no locking of its own; there is one writer and the
+ * caller serialises it against readers.
+ *
+ * A buffer opened with console_buffer_open() keeps data in a shared
+ * mapping of a file, behind a header recording head and tail, so the
+ * contents survive the daemon or the BMC restarting. Appending only
+ * touches the data; the header is moved on by the caller's sync, see
+ * console_buffer_sync_mark(), so it never covers data that has not
+ * reached the file. Resizing replaces the mapping and the file, so fd is
+ * only stable while the caller's lock is held.
+ */
+#define CONSOLE_BUFFER_MAGIC	0x4f424d43u	/* "OBMC" */
+#define CONSOLE_BUFFER_VERSION	2
+
+struct console_buffer_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t alloc;
+	uint64_t capacity;
+	uint64_t head;
+	uint64_t tail;
+};
+
+struct console_buffer {
+	char *data;
+	size_t alloc;		/* bytes in data */
+	size_t capacity;	/* limit on what is held, at most alloc */
+	struct console_buffer_header *header;	/* NULL if not file backed */
+	int fd;
+	char *path;		/* file backing it, NULL if none */
+	uint64_t head;
+	uint64_t tail;
+	uint64_t *lines;
+	uint32_t *line_deltas;	/* ms since the line before, as lines */
+	uint64_t *bases;	/* times of lines whose delta is UINT32_MAX */
+	size_t bases_size;	/* slots in bases, a power of two */
+	size_t bases_head;	/* slot of the oldest entry */
+	size_t bases_count;
+	uint64_t head_time;	/* time of the line starting at head */
+	uint64_t last_time;	/* time of the newest line */
+	size_t lines_size;	/* slots in lines, a power of two */
+	size_t lines_head;	/* slot of the oldest entry */
+	size_t lines_count;
+};
+
+/* a resize under way, see console_buffer_resize_begin() */
+struct console_buffer_resize {
+	char *data;
+	size_t alloc;
+	size_t capacity;
+	struct console_buffer_header *header;
+	int fd;
+	char *path;		/* new file, until renamed over target */
+	const char *target;
+	char *scratch;		/* contents at the snapshot, file backed only */
+	uint64_t head;		/* what the snapshot holds */
+	uint64_t tail;
+	int committed;
+};
+
+int console_buffer_init(struct console_buffer *cb, size_t capacity);
+int console_buffer_open(struct console_buffer *cb, const char *path,
+		size_t capacity);
+void console_buffer_free(struct console_buffer *cb);
+int console_buffer_append(struct console_buffer *cb, const char *buf,
+		size_t len, uint64_t now);
+int console_buffer_set_capacity(struct console_buffer *cb, size_t capacity);
+int console_buffer_resize_begin(const struct console_buffer *cb,
+		struct console_buffer_resize *rs, size_t capacity);
+void console_buffer_resize_snapshot(const struct console_buffer *cb,
+		struct console_buffer_resize *rs);
+void console_buffer_resize_fill(struct console_buffer_resize *rs);
+void console_buffer_resize_commit(struct console_buffer *cb,
+		struct console_buffer_resize *rs);
+int console_buffer_resize_end(struct console_buffer_resize *rs);
+void console_buffer_sync_mark(const struct console_buffer *cb,
+		struct console_buffer_header *mark);
+int console_buffer_sync_header(struct console_buffer *cb,
+		const struct console_buffer_header *mark, int fd);
+size_t console_buffer_copy(const struct console_buffer *cb, uint64_t seq,
+		char *dst, size_t len);
+size_t console_buffer_lines(const struct console_buffer *cb);
+uint64_t console_buffer_last_lines(const struct console_buffer *cb,
+		size_t n);
+size_t console_buffer_seek_time(const struct console_buffer *cb,
+		uint64_t time, uint64_t *seq);
+size_t console_buffer_times(const struct console_buffer *cb, size_t line,
+		uint64_t *times, size_t n);
+
+static inline size_t console_buffer_size(const struct console_buffer *cb)
+{
+	return cb->tail - cb->head;
+}
+
+#endif
@@ -1,12 +1,23 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
 #include <pthread.h>
 #include <sys/un.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <systemd/sd-bus.h>
+#include "console_buffer.h"
 
 #define DBUS_MAX_NAME_LEN 256
 
@@ -15,10 +26,162 @@ const char *objectmapper_object_name  =  "/org/openbmc/ObjectMapper";
 const char *objectmapper_intf_name    =  "org.openbmc.ObjectMapper";
 
 static const size_t buffer_init_capacity = 16 * 1024; /* initial buffer size */
-static pthread_mutex_t buffer_lock = PTHREAD_MUTEX_INITIALIZER;
-static char *buffer; /* a whole buffer where log stored */
-static size_t buffer_sz; /* data size */
-static size_t buffer_capacity; /* buffer size */
+static const size_t read_chunk_size = 4096; /* socket read size */
+static const time_t history_sync_interval = 10; /* seconds between syncs */
+static const time_t reconnect_interval = 5; /* seconds between retries */
+static const char *history_dir; /* directory of files backing buffers */
+
+struct subscriber;
+
+/* a console socket and the log kept of it, served as
+ * /org/openbmc/log/<name>
+ */
+struct console {
+	const char *name;
+	struct sockaddr_un addr;
+	socklen_t addr_len;
+	char object[DBUS_MAX_NAME_LEN];
+	char *history; /* file backing the buffer, if any */
+	sd_bus_slot *slot;
+
+	pthread_mutex_t lock;
+	struct console_buffer buffer; /* ring where log stored */
+	struct subscriber *new_subscribers; /* under lock */
+	uint64_t dropped; /* under lock */
+
+	/* owned by socket_thread */
+	int fd; /* -1 while disconnected */
+	bool connect_failed; /* reported since the last connection */
+	bool dirty; /* history written since the last sync */
+	struct subscriber *subscribers;
+};
+
+/* a client streaming the log through a socket from subscribe() */
+struct subscriber {
+	struct subscriber *next;
+	int fd;
+	uint64_t cursor; /* sequence number of the next byte to send */
+	uint64_t dropped; /* bytes evicted before they could be sent */
+	bool blocked; /* waiting for the socket to drain */
+};
+
+static struct console *consoles;
+static size_t n_consoles;
+static int wake_fd = -1; /* tells socket_thread about new subscribers */
+
+/* whether a code point may go out in a D-Bus string; sd-bus refuses
+ * surrogates and noncharacters as well as anything past U+10FFFF
+ */
+static bool text_char_valid(uint32_t c)
+{
+	if (c >= 0x110000 || (c >= 0xd800 && c <= 0xdfff))
+		return false;
+	if ((c >= 0xfdd0 && c <= 0xfdef) || (c & 0xfffe) == 0xfffe)
+		return false;
+	return true;
+}
+
+/* Make len bytes of console output safe to send as a D-Bus string, in
+ * place: NULs and bytes that are not part of a valid UTF-8 character
+ * become '?', one for one, so offsets into the log still hold. Returns
+ * the number of bytes to send, which stops short of a character cut off
+ * at the end so that it goes out whole with the next read.
+ */
+static size_t text_sanitise(char *data, size_t len)
+{
+	static const uint32_t min[] = { 0, 0x80, 0x800, 0x10000 };
+	size_t i = 0, k, n;
+	uint32_t c;
+
+	while (i < len) {
+		c = (unsigned char)data[i];
+		if (c < 0x80) {
+			if (c == 0)
+				data[i] = '?';
+			i++;
+			continue;
+		}
+		if (c >= 0xc0 && c < 0xe0) {
+			n = 1;
+			c &= 0x1f;
+		} else if (c >= 0xe0 && c < 0xf0) {
+			n = 2;
+			c &= 0x0f;
+		} else if (c >= 0xf0 && c < 0xf8) {
+			n = 3;
+			c &= 0x07;
+		} else {
+			data[i++] = '?';
+			continue;
+		}
+		for (k = 1; k <= n; k++) {
+			if (i + k == len)
+				return i;
+			if ((data[i + k] & 0xc0) != 0x80)
+				break;
+			c = (c << 6) | (data[i + k] & 0x3f);
+		}
+		if (k <= n || c < min[n] || !text_char_valid(c)) {
+			data[i++] = '?';
+			continue;
+		}
+		i += n + 1;
+	}
+
+	return len;
+}
+
+/* Copy out up to len bytes of the log starting at sequence number seq,
+ * as a NUL-terminated string the caller frees, made fit for a D-Bus
+ * string by text_sanitise(). seq is clipped to what the buffer holds, and
+ * *next is set to the sequence number after the last byte returned.
+ * Called with the console lock held.
+ */
+static char *buffer_slice_locked(struct console *con, uint64_t seq, uint64_t len, uint64_t *next)
+{
+	char *data;
+	size_t sz;
+
+	if (seq < con->buffer.head)
+		seq = con->buffer.head;
+	if (seq > con->buffer.tail)
+		seq = con->buffer.tail;
+	if (len > con->buffer.tail - seq)
+		len = con->buffer.tail - seq;
+
+	data = malloc(len + 1);
+	if (data) {
+		sz = console_buffer_copy(&con->buffer, seq, data, len);
+		sz = text_sanitise(data, sz);
+		data[sz] = '\0';
+		*next = seq + sz;
+	}
+
+	return data;
+}
+
+/* as buffer_slice_locked(), holding the lock only for the copy and not
+ * the reply
+ */
+static char *buffer_slice(struct console *con, uint64_t seq, uint64_t len, uint64_t *next)
+{
+	char *data;
+
+	pthread_mutex_lock(&con->lock);
+	data = buffer_slice_locked(con, seq, len, next);
+	pthread_mutex_unlock(&con->lock);
+
+	return data;
+}
+
+/* wall clock time in milliseconds, as line times are kept */
+static uint64_t time_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
 /* obmcConsole.read() method
  * return string containing obmcConsole log
@@ -26,13 +189,232 @@ static size_t buffer_capacity; /* buffer size */
 static int obmc_console_read(sd_bus_message *msg, void *user_data,
 		sd_bus_error *ret_error)
 {
+	struct console *con = user_data;
+	uint64_t next;
+	char *data;
+	int rc;
+
+	data = buffer_slice(con, 0, UINT64_MAX, &next);
+	if (!data)
+		return sd_bus_error_set_errno(ret_error, ENOMEM);
+
+	rc = sd_bus_reply_method_return(msg, "s", data);
+	free(data);
+	return rc;
+}
+
+/* obmcConsole.readSince(t cursor) method
+ * return the log from cursor onwards, and the cursor to pass next time.
+ * A cursor older than the buffer starts from the oldest byte held.
+ */
+static int obmc_console_read_since(sd_bus_message *msg, void *user_data,
+		sd_bus_error *ret_error)
+{
+	struct console *con = user_data;
+	uint64_t cursor, next;
+	char *data;
+	int rc;
+
+	rc = sd_bus_message_read(msg, "t", &cursor);
+	if (rc < 0) {
+		fprintf(stderr, "sd_bus_message_read(): %s\n",
+				strerror(-rc));
+		return rc;
+	}
+
+	data = buffer_slice(con, cursor, UINT64_MAX, &next);
+	if (!data)
+		return sd_bus_error_set_errno(ret_error, ENOMEM);
+
+	rc = sd_bus_reply_method_return(msg, "st", data, next);
+	free(data);
+	return rc;
+}
+
+/* obmcConsole.readRange(t offset, u len) method
+ * return up to len bytes of the log starting at sequence number offset
+ */
+static int obmc_console_read_range(sd_bus_message *msg, void *user_data,
+		sd_bus_error *ret_error)
+{
+	struct console *con = user_data;
+	uint64_t offset, next;
+	uint32_t len;
+	char *data;
 	int rc;
-	pthread_mutex_lock(&buffer_lock);
-	rc = sd_bus_reply_method_return(msg, "s", buffer);
-	pthread_mutex_unlock(&buffer_lock);
+
+	rc = sd_bus_message_read(msg, "tu", &offset, &len);
+	if (rc < 0) {
+		fprintf(stderr, "sd_bus_message_read(): %s\n",
+				strerror(-rc));
+		return rc;
+	}
+
+	data = buffer_slice(con, offset, len, &next);
+	if (!data)
+		return sd_bus_error_set_errno(ret_error, ENOMEM);
+
+	rc = sd_bus_reply_method_return(msg, "s", data);
+	free(data);
 	return rc;
 }
 
+/* obmcConsole.readLines(u n) method
+ * return the last n lines of the log
+ */
+static int obmc_console_read_lines(sd_bus_message *msg, void *user_data,
+		sd_bus_error *ret_error)
+{
+	struct console *con = user_data;
+	uint64_t seq, next;
+	uint32_t n;
+	char *data;
+	int rc;
+
+	rc = sd_bus_message_read(msg, "u", &n);
+	if (rc < 0) {
+		fprintf(stderr, "sd_bus_message_read(): %s\n",
+				strerror(-rc));
+		return rc;
+	}
+
+	pthread_mutex_lock(&con->lock);
+	seq = console_buffer_last_lines(&con->buffer, n);
+	data = buffer_slice_locked(con, seq, UINT64_MAX, &next);
+	pthread_mutex_unlock(&con->lock);
+	if (!data)
+		return sd_bus_error_set_errno(ret_error, ENOMEM);
+
+	rc = sd_bus_reply_method_return(msg, "s", data);
+	free(data);
+	return rc;
+}
+
+/* obmcConsole.readTimeRange(t start, t end) method
+ * return the lines that started from start up to end, in milliseconds
+ * since the epoch
+ */
+static int obmc_console_read_time_range(sd_bus_message *msg,
+		void *user_data, sd_bus_error *ret_error)
+{
+	struct console *con = user_data;
+	uint64_t start, end, seq, end_seq, next;
+	char *data;
+	int rc;
+
+	rc = sd_bus_message_read(msg, "tt", &start, &end);
+	if (rc < 0) {
+		fprintf(stderr, "sd_bus_message_read(): %s\n",
+				strerror(-rc));
+		return rc;
+	}
+
+	pthread_mutex_lock(&con->lock);
+	console_buffer_seek_time(&con->buffer, start, &seq);
+	console_buffer_seek_time(&con->buffer, end, &end_seq);
+	data = buffer_slice_locked(con, seq, end_seq > seq ? end_seq - seq : 0,
+			&next);
+	pthread_mutex_unlock(&con->lock);
+	if (!data)
+		return sd_bus_error_set_errno(ret_error, ENOMEM);
+
+	rc = sd_bus_reply_method_return(msg, "s", data);
+	free(data);
+	return rc;
+}
+
+/* obmcConsole.linesSince(t time) method
+ * return each line that started at or after time, with the time it
+ * started
+ */
+static int obmc_console_lines_since(sd_bus_message *msg, void *user_data,
+		sd_bus_error *ret_error)
+{
+	struct console *con = user_data;
+	sd_bus_message *reply = NULL;
+	uint64_t since, seq, next;
+	uint64_t *times = NULL;
+	size_t i, line, lines;
+	char *data, *p, *nl, *end;
+	int rc;
+
+	rc = sd_bus_message_read(msg, "t", &since);
+	if (rc < 0) {
+		fprintf(stderr, "sd_bus_message_read(): %s\n",
+				strerror(-rc));
+		return rc;
+	}
+
+	pthread_mutex_lock(&con->lock);
+	line = console_buffer_seek_time(&con->buffer, since, &seq);
+	lines = console_buffer_lines(&con->buffer) - line;
+	data = buffer_slice_locked(con, seq, UINT64_MAX, &next);
+	if (lines)
+		times = malloc(lines * sizeof(*times));
+	if (times)
+		lines = console_buffer_times(&con->buffer, line, times, lines);
+	pthread_mutex_unlock(&con->lock);
+	if (!data || (lines && !times)) {
+		rc = sd_bus_error_set_errno(ret_error, ENOMEM);
+		goto out;
+	}
+
+	rc = sd_bus_message_new_method_return(msg, &reply);
+	if (rc < 0)
+		goto out;
+	rc = sd_bus_message_open_container(reply, 'a', "(ts)");
+	if (rc < 0)
+		goto out;
+
+	/* the copy holds exactly these lines, the last maybe unfinished */
+	end = data + (next - seq);
+	for (i = 0, p = data; i < lines; i++, p = nl + 1) {
+		nl = memchr(p, '\n', end - p);
+		if (nl)
+			*nl = '\0';
+		rc = sd_bus_message_append(reply, "(ts)", times[i], p);
+		if (rc < 0 || !nl)
+			break;
+	}
+	if (rc < 0)
+		goto out;
+
+	rc = sd_bus_message_close_container(reply);
+	if (rc < 0)
+		goto out;
+	rc = sd_bus_send(NULL, reply, NULL);
+
+ out:
+	sd_bus_message_unref(reply);
+	free(times);
+	free(data);
+	return rc;
+}
+
+/* obmcConsole.lines property
+ * return number of lines in the log
+ */
+static int obmc_console_get_lines(sd_bus *bus, const char *path,
+		const char *interface, const char *property,
+		sd_bus_message *reply, void *userdata, sd_bus_error *error)
+{
+	struct console *con = userdata;
+	size_t lines;
+	int rc;
+
+	pthread_mutex_lock(&con->lock);
+	lines = console_buffer_lines(&con->buffer);
+	pthread_mutex_unlock(&con->lock);
+
+	rc = sd_bus_message_append(reply, "u", (uint32_t)lines);
+	if (rc < 0) {
+		fprintf(stderr, "sd_bus_message_append(): %s\n",
+				strerror(-rc));
+		return 0;
+	}
+	return 1;
+}
+
 /* obmcConsole.size property
  * return log size
  */
@@ -40,9 +422,15 @@ static int obmc_console_get_size(sd_bus *bus, const char *path,
 		const char *interface, const char *property, 
 		sd_bus_message *reply, void *userdata, sd_bus_error *error)
 {
+	struct console *con = userdata;
+	size_t sz;
 	int rc;
 
-	rc = sd_bus_message_append(reply, "i", (int32_t)buffer_sz);
+	pthread_mutex_lock(&con->lock);
+	sz = console_buffer_size(&con->buffer);
+	pthread_mutex_unlock(&con->lock);
+
+	rc = sd_bus_message_append(reply, "i", (int32_t)sz);
 	if (rc < 0) {
 		fprintf(stderr, "sd_bus_message_append(): %s\n",
 				strerror(-rc));
@@ -58,9 +446,15 @@ static int obmc_console_get_capacity(sd_bus *bus, const char *path,
 		const char *interface, const char *property,
 		sd_bus_message *reply, void *userdata, sd_bus_error *error)
 {
+	struct console *con = userdata;
+	size_t capacity;
 	int rc;
 
-	rc = sd_bus_message_append(reply, "i", (int32_t)buffer_capacity);
+	pthread_mutex_lock(&con->lock);
+	capacity = con->buffer.capacity;
+	pthread_mutex_unlock(&con->lock);
+
+	rc = sd_bus_message_append(reply, "i", (int32_t)capacity);
 	if (rc < 0) {
 		fprintf(stderr, "sd_bus_message_append(): %s\n",
 				strerror(-rc));
@@ -76,11 +470,11 @@ static int obmc_console_set_capacity(sd_bus *bus, const char *path,
 		const char *interface, const char *property,
 		sd_bus_message *value, void *userdata, sd_bus_error *error)
 {
+	struct console *con = userdata;
+	struct console_buffer_resize rs;
 	int32_t new_capacity;
-	char *new_buffer;
-	size_t new_buffer_offset;
-	size_t new_buffer_sz;
-	int rc;
+	size_t alloc;
+	int rc = 0;
 
 	rc = sd_bus_message_read(value, "i", &new_capacity);
 	if (rc < 0) {
@@ -88,38 +482,118 @@ static int obmc_console_set_capacity(sd_bus *bus, const char *path,
 				strerror(-rc));
 		return 0;
 	}
-	if (new_capacity <= 0) {
+	if (new_capacity < 2) {
 		fprintf(stderr, "invalid capacity %" PRId32 "\n", new_capacity);
 		return 0;
 	}
 
-	new_buffer = malloc(new_capacity);
-	if (!new_buffer) {
-		fprintf(stderr, "Failed to allocate memory\n");
-		return 0;
+	/* Growing past what is allocated, or shrinking to half of it or
+	 * less, moves the log to a ring of the new capacity; only this
+	 * thread changes the buffer's alloc. The new ring, and for a history
+	 * file the rewrite of it, are done without the lock, which is held
+	 * only to copy from the old ring and to switch over. Anything else
+	 * just moves the limit, dropping lines when shrinking.
+	 */
+	alloc = con->buffer.alloc;
+	if ((size_t)new_capacity > alloc ||
+			(size_t)new_capacity <= alloc / 2) {
+		rc = console_buffer_resize_begin(&con->buffer, &rs,
+				new_capacity);
+		if (rc < 0) {
+			fprintf(stderr, "Failed to resize buffer: %s\n",
+					strerror(-rc));
+			return 0;
+		}
+		pthread_mutex_lock(&con->lock);
+		console_buffer_resize_snapshot(&con->buffer, &rs);
+		pthread_mutex_unlock(&con->lock);
+		console_buffer_resize_fill(&rs);
+		pthread_mutex_lock(&con->lock);
+		console_buffer_resize_commit(&con->buffer, &rs);
+		pthread_mutex_unlock(&con->lock);
+		/* the log is resized even if the new file keeps its
+		 * temporary name; it is only lost on restart
+		 */
+		rc = console_buffer_resize_end(&rs);
+		if (rc < 0)
+			fprintf(stderr, "Failed to replace %s: %s\n",
+					con->buffer.path, strerror(-rc));
+	} else {
+		pthread_mutex_lock(&con->lock);
+		rc = console_buffer_set_capacity(&con->buffer, new_capacity);
+		pthread_mutex_unlock(&con->lock);
+		if (rc < 0) {
+			fprintf(stderr, "Failed to resize buffer: %s\n",
+					strerror(-rc));
+			return 0;
+		}
 	}
 
-	pthread_mutex_lock(&buffer_lock);
-	new_buffer_sz = buffer_sz;
-	new_buffer_offset = 0;
-	while (new_buffer_sz >= new_capacity) {
-		new_buffer_offset = strcspn(&buffer[new_buffer_offset], "\n");
-		if (new_buffer_offset != new_buffer_sz)
-			new_buffer_offset++;
-		new_buffer_sz -= new_buffer_offset;
-	}
+	sd_bus_emit_properties_changed(bus, path, interface, "size", "lines",
+			NULL);
+
+	return 1;
+}
 
-	if (new_buffer_sz) {
-		memcpy(new_buffer, &buffer[new_buffer_offset], new_buffer_sz);
-		new_buffer[new_buffer_sz] = '\0';
+/* obmcConsole.subscribe() method
+ * return a socket carrying the log held so far followed by live output
+ */
+static int obmc_console_subscribe(sd_bus_message *msg, void *user_data,
+		sd_bus_error *ret_error)
+{
+	struct console *con = user_data;
+	struct subscriber *sub;
+	uint64_t one = 1;
+	int fds[2];
+	int rc;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds))
+		return sd_bus_error_set_errno(ret_error, errno);
+
+	sub = calloc(1, sizeof(*sub));
+	if (!sub) {
+		close(fds[0]);
+		close(fds[1]);
+		return sd_bus_error_set_errno(ret_error, ENOMEM);
 	}
+	sub->fd = fds[0];
+
+	pthread_mutex_lock(&con->lock);
+	sub->cursor = con->buffer.head;
+	sub->next = con->new_subscribers;
+	con->new_subscribers = sub;
+	pthread_mutex_unlock(&con->lock);
+
+	if (write(wake_fd, &one, sizeof(one)) != sizeof(one))
+		perror("Failed to wake socket thread");
+
+	/* sd-bus sends a dup of the client end, so ours can go */
+	rc = sd_bus_reply_method_return(msg, "h", fds[1]);
+	close(fds[1]);
+	return rc;
+}
 
-	free(buffer);
-	buffer = new_buffer;
-	buffer_capacity = new_capacity;
-	buffer_sz = new_buffer_sz;
-	pthread_mutex_unlock(&buffer_lock);
+/* obmcConsole.dropped property
+ * return bytes evicted before a subscriber could be sent them
+ */
+static int obmc_console_get_dropped(sd_bus *bus, const char *path,
+		const char *interface, const char *property,
+		sd_bus_message *reply, void *userdata, sd_bus_error *error)
+{
+	struct console *con = userdata;
+	uint64_t dropped;
+	int rc;
 
+	pthread_mutex_lock(&con->lock);
+	dropped = con->dropped;
+	pthread_mutex_unlock(&con->lock);
+
+	rc = sd_bus_message_append(reply, "t", dropped);
+	if (rc < 0) {
+		fprintf(stderr, "sd_bus_message_append(): %s\n",
+				strerror(-rc));
+		return 0;
+	}
 	return 1;
 }
 
@@ -128,88 +602,595 @@ static const sd_bus_vtable obmc_console_vtable[] =
 	SD_BUS_VTABLE_START(0),
 	SD_BUS_METHOD("read", "", "s", &obmc_console_read,
 		SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("readSince", "t", "st", &obmc_console_read_since,
+		SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("readRange", "tu", "s", &obmc_console_read_range,
+		SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("readLines", "u", "s", &obmc_console_read_lines,
+		SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("readTimeRange", "tt", "s",
+		&obmc_console_read_time_range, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("linesSince", "t", "a(ts)", &obmc_console_lines_since,
+		SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("subscribe", "", "h", &obmc_console_subscribe,
+		SD_BUS_VTABLE_UNPRIVILEGED),
 	SD_BUS_PROPERTY("size", "i", obmc_console_get_size, 0, 
 		SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
 	SD_BUS_WRITABLE_PROPERTY("capacity", "i", obmc_console_get_capacity,
 		obmc_console_set_capacity, 0, 0),
+	SD_BUS_PROPERTY("lines", "u", obmc_console_get_lines, 0,
+		SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+	SD_BUS_PROPERTY("dropped", "t", obmc_console_get_dropped, 0, 0),
 	SD_BUS_VTABLE_END,
 };
 
-/* thread listening obmc-console socket
+/* only wait for the socket to drain while it has fallen behind; hangups
+ * are always reported
  */
-static void *socket_thread(void *args)
+static int subscriber_watch(int epfd, struct subscriber *sub, bool blocked)
 {
-	static const char console_socket_path[] = "\0obmc-console";
-	static const size_t console_socket_path_len = 
-		sizeof(console_socket_path) - 1;
-	struct sockaddr_un addr;
+	struct epoll_event ev;
+
+	if (sub->blocked == blocked)
+		return 0;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = blocked ? EPOLLOUT : 0;
+	ev.data.fd = sub->fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_MOD, sub->fd, &ev))
+		return -errno;
+	sub->blocked = blocked;
+
+	return 0;
+}
+
+/* Send a subscriber as much as its socket takes without blocking. If it
+ * has fallen further behind than the buffer holds, skip it forward and
+ * count what it missed.
+ */
+static int subscriber_flush(int epfd, struct console *con,
+		struct subscriber *sub, char *chunk)
+{
+	ssize_t sent;
+	size_t len;
+
+	for (;;) {
+		pthread_mutex_lock(&con->lock);
+		if (sub->cursor < con->buffer.head) {
+			sub->dropped += con->buffer.head - sub->cursor;
+			con->dropped += con->buffer.head - sub->cursor;
+			sub->cursor = con->buffer.head;
+		}
+		len = console_buffer_copy(&con->buffer, sub->cursor, chunk,
+				read_chunk_size);
+		pthread_mutex_unlock(&con->lock);
+		if (!len)
+			return subscriber_watch(epfd, sub, false);
+
+		sent = send(sub->fd, chunk, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return subscriber_watch(epfd, sub, true);
+		if (sent < 0)
+			return -errno;
+
+		sub->cursor += sent;
+		if ((size_t)sent < len)
+			return subscriber_watch(epfd, sub, true);
+	}
+}
+
+static void subscriber_free(int epfd, struct console *con,
+		struct subscriber *sub)
+{
+	if (sub->dropped)
+		fprintf(stderr, "%s subscriber dropped %" PRIu64 " bytes\n",
+				con->name, sub->dropped);
+	epoll_ctl(epfd, EPOLL_CTL_DEL, sub->fd, NULL);
+	close(sub->fd);
+	free(sub);
+}
+
+/* take over subscribers added since the last wakeup, and send them the
+ * backlog
+ */
+static void subscribers_adopt(int epfd, struct console *con, char *chunk)
+{
+	struct subscriber *sub, *next;
+	struct epoll_event ev;
+
+	pthread_mutex_lock(&con->lock);
+	sub = con->new_subscribers;
+	con->new_subscribers = NULL;
+	pthread_mutex_unlock(&con->lock);
+
+	for (; sub; sub = next) {
+		next = sub->next;
+		memset(&ev, 0, sizeof(ev));
+		ev.data.fd = sub->fd;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, sub->fd, &ev)) {
+			perror("Failed to watch subscriber");
+			close(sub->fd);
+			free(sub);
+			continue;
+		}
+		sub->next = con->subscribers;
+		con->subscribers = sub;
+		if (subscriber_flush(epfd, con, sub, chunk) < 0) {
+			con->subscribers = sub->next;
+			subscriber_free(epfd, con, sub);
+		}
+	}
+}
+
+/* Flush every subscriber, or just the one on fd if fd is not -1, and
+ * drop any that have gone away.
+ */
+static void subscribers_flush(int epfd, struct console *con, int fd,
+		uint32_t events, char *chunk)
+{
+	struct subscriber **p, *sub;
+
+	for (p = &con->subscribers; (sub = *p);) {
+		if (fd != -1 && sub->fd != fd) {
+			p = &sub->next;
+			continue;
+		}
+		if ((events & (EPOLLHUP | EPOLLERR)) ||
+				subscriber_flush(epfd, con, sub, chunk) < 0) {
+			*p = sub->next;
+			subscriber_free(epfd, con, sub);
+			continue;
+		}
+		p = &sub->next;
+	}
+}
+
+/* write a history file out to flash: the data first, then a header
+ * covering only what that wrote. A resize can replace the file, so a
+ * duplicate of its descriptor is taken under the lock and synced
+ * without it.
+ */
+static void history_sync(struct console *con)
+{
+	struct console_buffer_header mark;
+	int fd, rc = 0;
+
+	con->dirty = false;
+	pthread_mutex_lock(&con->lock);
+	fd = con->buffer.fd;
+	if (fd >= 0) {
+		console_buffer_sync_mark(&con->buffer, &mark);
+		fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+		if (fd < 0)
+			rc = -errno;
+	}
+	pthread_mutex_unlock(&con->lock);
+	if (fd >= 0) {
+		/* the data pages are shared with the mapping */
+		if (fdatasync(fd)) {
+			rc = -errno;
+		} else {
+			pthread_mutex_lock(&con->lock);
+			rc = console_buffer_sync_header(&con->buffer, &mark,
+					fd);
+			pthread_mutex_unlock(&con->lock);
+			if (rc > 0 && fdatasync(fd))
+				rc = -errno;
+		}
+		close(fd);
+	}
+	if (rc < 0)
+		fprintf(stderr, "Failed to sync %s history: %s\n",
+				con->name, strerror(-rc));
+}
+
+/* Connect to a console's socket, reporting a failure only the first time
+ * in a row so that retries stay quiet.
+ */
+static int console_connect(int epfd, struct console *con)
+{
+	struct epoll_event ev;
 	int fd;
-	char c;
-	size_t line_sz;
-       
-	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
 	if (fd == -1) {
 		perror("Failed to create socket");
-		goto out;
+		return -1;
 	}
-	memset(&addr, 0, sizeof(addr));
-	addr.sun_family = AF_UNIX;
-	memcpy(&addr.sun_path, &console_socket_path, console_socket_path_len);
 
-	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
-		perror("Failed to connect to console server");
-		goto close_sock;
+	if (connect(fd, (struct sockaddr *)&con->addr, con->addr_len)) {
+		if (!con->connect_failed)
+			fprintf(stderr, "Failed to connect to %s console: %s\n",
+					con->name, strerror(errno));
+		con->connect_failed = true;
+		close(fd);
+		return -1;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev)) {
+		perror("Failed to watch console socket");
+		close(fd);
+		return -1;
+	}
+
+	if (con->connect_failed)
+		fprintf(stderr, "Connected to %s console\n", con->name);
+	con->connect_failed = false;
+	con->fd = fd;
+
+	return 0;
+}
+
+static void console_disconnect(int epfd, struct console *con)
+{
+	fprintf(stderr, "Lost %s console, reconnecting\n", con->name);
+	epoll_ctl(epfd, EPOLL_CTL_DEL, con->fd, NULL);
+	close(con->fd);
+	con->fd = -1;
+	con->connect_failed = true;
+}
+
+/* connect any console that is not; returns true if some still are not */
+static bool consoles_connect(int epfd)
+{
+	bool pending = false;
+	size_t i;
+
+	for (i = 0; i < n_consoles; i++) {
+		if (consoles[i].fd == -1 && console_connect(epfd, &consoles[i]))
+			pending = true;
 	}
 
-	buffer = malloc(buffer_init_capacity);
-	if (!buffer) {
+	return pending;
+}
+
+/* Take whatever a console socket has, holding its lock only to copy it
+ * into the ring, and pass it on to the subscribers. Returns false if the
+ * console has gone away.
+ */
+static bool console_read(int epfd, struct console *con, char *chunk)
+{
+	ssize_t len;
+	uint64_t now;
+
+	len = read(con->fd, chunk, read_chunk_size);
+	if (len < 0 && (errno == EINTR || errno == EAGAIN))
+		return true;
+	if (len < 1)
+		return false;
+
+	now = time_ms();
+	pthread_mutex_lock(&con->lock);
+	console_buffer_append(&con->buffer, chunk, len, now);
+	pthread_mutex_unlock(&con->lock);
+	if (con->history)
+		con->dirty = true;
+
+	subscribers_flush(epfd, con, -1, 0, chunk);
+
+	return true;
+}
+
+static void arm_timer(int fd, time_t seconds, bool *armed)
+{
+	struct itimerspec time;
+
+	if (*armed)
+		return;
+
+	memset(&time, 0, sizeof(time));
+	time.it_value.tv_sec = seconds;
+	if (timerfd_settime(fd, 0, &time, NULL))
+		perror("Failed to arm timer");
+	else
+		*armed = true;
+}
+
+/* thread reading every console socket, and feeding subscribers
+ */
+static void *socket_thread(void *args)
+{
+	struct epoll_event ev, events[16];
+	bool sync_armed = false, retry_armed = false;
+	struct subscriber *sub;
+	struct console *con;
+	uint64_t expirations;
+	int epfd, sync_fd, retry_fd, fd;
+	char *chunk;
+	size_t j;
+	int i, n;
+
+	chunk = malloc(read_chunk_size);
+	if (!chunk) {
 		fprintf(stderr, "Failed to allocate memory\n");
-		goto close_sock;
+		goto out;
+	}
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd == -1) {
+		perror("Failed to create epoll");
+		goto free_chunk;
+	}
+
+	/* writes to history files are synced in batches on a timer, to
+	 * limit flash wear
+	 */
+	sync_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (sync_fd == -1) {
+		perror("Failed to create timer");
+		goto close_epoll;
+	}
+
+	/* and consoles that are not up are retried on another */
+	retry_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (retry_fd == -1) {
+		perror("Failed to create timer");
+		goto close_sync;
 	}
-	buffer[0] = '\0';
-	buffer_sz = 0;
-	buffer_capacity = buffer_init_capacity;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = wake_fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, wake_fd, &ev)) {
+		perror("Failed to watch wakeup fd");
+		goto close_retry;
+	}
+	ev.data.fd = sync_fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, sync_fd, &ev)) {
+		perror("Failed to watch timer");
+		goto close_retry;
+	}
+	ev.data.fd = retry_fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, retry_fd, &ev)) {
+		perror("Failed to watch timer");
+		goto close_retry;
+	}
+
+	if (consoles_connect(epfd))
+		arm_timer(retry_fd, reconnect_interval, &retry_armed);
 
 	for (;;) {
-		if (read(fd, &c, 1) < 1)
+		n = epoll_wait(epfd, events, sizeof(events) / sizeof(*events),
+				-1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			perror("Failed to wait for consoles");
 			break;
-		pthread_mutex_lock(&buffer_lock);
-		if (buffer_sz + 1 == buffer_capacity) {
-			/* if there is not enought space for new data */
-
-			line_sz = strcspn(buffer, "\n");
-			if (line_sz == buffer_sz) {
-				/* whole buffer is a line */
-				buffer_sz = 0;
-			} else {
-				buffer_sz -= line_sz + 1;
-				memmove(buffer, &buffer[line_sz + 1], 
-						buffer_sz);
+		}
+
+		for (i = 0; i < n; i++) {
+			fd = events[i].data.fd;
+
+			if (fd == wake_fd) {
+				if (read(wake_fd, &expirations,
+						sizeof(expirations)) > 0) {
+					for (j = 0; j < n_consoles; j++)
+						subscribers_adopt(epfd,
+							&consoles[j], chunk);
+				}
+				continue;
+			}
+			if (fd == sync_fd) {
+				if (read(sync_fd, &expirations,
+						sizeof(expirations)) > 0) {
+					for (j = 0; j < n_consoles; j++)
+						if (consoles[j].dirty)
+							history_sync(&consoles[j]);
+				}
+				sync_armed = false;
+				continue;
+			}
+			if (fd == retry_fd) {
+				if (read(retry_fd, &expirations,
+						sizeof(expirations)) > 0) {
+					retry_armed = false;
+					if (consoles_connect(epfd))
+						arm_timer(retry_fd,
+							reconnect_interval,
+							&retry_armed);
+				}
+				continue;
 			}
+
+			for (j = 0; j < n_consoles; j++)
+				if (consoles[j].fd == fd)
+					break;
+			if (j == n_consoles) {
+				/* a subscriber socket of one of them */
+				for (j = 0; j < n_consoles; j++)
+					subscribers_flush(epfd, &consoles[j],
+							fd, events[i].events,
+							chunk);
+				continue;
+			}
+
+			con = &consoles[j];
+			if (!console_read(epfd, con, chunk)) {
+				console_disconnect(epfd, con);
+				if (con->dirty)
+					history_sync(con);
+				arm_timer(retry_fd, reconnect_interval,
+						&retry_armed);
+				continue;
+			}
+			if (con->dirty)
+				arm_timer(sync_fd, history_sync_interval,
+						&sync_armed);
 		}
-		
-		buffer[buffer_sz] = c;
-		buffer[buffer_sz + 1] = '\0';
-		buffer_sz++;
-		pthread_mutex_unlock(&buffer_lock);
 	}
 
 	fprintf(stderr, "exit socket thread\n");
- close_sock:
-	close(fd);
+	for (j = 0; j < n_consoles; j++) {
+		con = &consoles[j];
+		if (con->fd != -1)
+			close(con->fd);
+		if (con->dirty)
+			history_sync(con);
+		/* let the subscribers see end of file */
+		while ((sub = con->subscribers)) {
+			con->subscribers = sub->next;
+			subscriber_free(epfd, con, sub);
+		}
+	}
+ close_retry:
+	close(retry_fd);
+ close_sync:
+	close(sync_fd);
+ close_epoll:
+	close(epfd);
+ free_chunk:
+	free(chunk);
  out:
 	return NULL;
 }
 
+/* Add a console from a "<name>:<socket>" argument. A socket starting
+ * with '@' is in the abstract namespace.
+ */
+static int console_add(const char *arg)
+{
+	const char *sep, *path, *p;
+	struct console *con;
+	size_t path_len;
+
+	sep = strchr(arg, ':');
+	if (!sep || sep == arg || !sep[1])
+		return -1;
+	/* the name is an object path element */
+	for (p = arg; p < sep; p++)
+		if (!isalnum((unsigned char)*p) && *p != '_')
+			return -1;
+
+	path = sep + 1;
+	path_len = strlen(path);
+	if (path_len >= sizeof(con->addr.sun_path))
+		return -1;
+
+	con = realloc(consoles, (n_consoles + 1) * sizeof(*consoles));
+	if (!con)
+		return -1;
+	consoles = con;
+	con = &consoles[n_consoles++];
+	memset(con, 0, sizeof(*con));
+
+	con->name = strndup(arg, sep - arg);
+	if (!con->name)
+		return -1;
+	con->addr.sun_family = AF_UNIX;
+	memcpy(con->addr.sun_path, path, path_len);
+	if (path[0] == '@')
+		con->addr.sun_path[0] = '\0';
+	con->addr_len = offsetof(struct sockaddr_un, sun_path) + path_len;
+	if (path[0] != '@')
+		con->addr_len++;
+	snprintf(con->object, sizeof(con->object), "/org/openbmc/log/%s",
+			con->name);
+	con->fd = -1;
+
+	return 0;
+}
+
+static int parse_argument(int argc, char **argv)
+{
+	int c;
+	struct option long_options[] =
+	{
+		{"console", required_argument, 0, 'c'},
+		{"history", required_argument, 0, 'h'},
+		{0, 0, 0, 0}
+	};
+
+	while (1) {
+		c = getopt_long(argc, argv, "c:h:", long_options, NULL);
+
+		/* Detect the end of the options. */
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'c':
+			if (console_add(optarg) < 0) {
+				fprintf(stderr, "log: Wrong console: %s\n",
+						optarg);
+				return -1;
+			}
+			break;
+		case 'h':
+			history_dir = optarg;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [--console <name>:<socket>]... "
+					"[--history <dir>]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	/* the host console that was all this used to serve */
+	if (!n_consoles && console_add("obmcConsole:@obmc-console") < 0) {
+		fprintf(stderr, "Failed to allocate memory\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* set up a console's buffer, on a heap buffer if its history file is
+ * unusable
+ */
+static int console_init(struct console *con)
+{
+	int rc;
+
+	pthread_mutex_init(&con->lock, NULL);
+
+	if (history_dir && asprintf(&con->history, "%s/%s", history_dir,
+				con->name) < 0)
+		con->history = NULL;
+	if (con->history) {
+		rc = console_buffer_open(&con->buffer, con->history,
+				buffer_init_capacity);
+		if (rc == 0)
+			return 0;
+		fprintf(stderr, "Failed to open console history %s: %s\n",
+				con->history, strerror(-rc));
+		free(con->history);
+		con->history = NULL;
+	}
+
+	return console_buffer_init(&con->buffer, buffer_init_capacity);
+}
+
 int main(int argc, char **argv)
 {
 	sd_bus *bus;
-	sd_bus_slot *obmc_console_slot = NULL;
-	const char *obmc_console_object = "/org/openbmc/log/obmcConsole";
 	const char *obmc_console_iface = "org.openbmc.log.obmcConsole";
 	pthread_t socket_th;
+	size_t i;
 	int rc;
 
+	if (parse_argument(argc, argv) < 0)
+		return 1;
+
+	for (i = 0; i < n_consoles; i++) {
+		rc = console_init(&consoles[i]);
+		if (rc < 0) {
+			fprintf(stderr, "Failed to allocate memory\n");
+			return rc;
+		}
+	}
+
+	wake_fd = eventfd(0, EFD_CLOEXEC);
+	if (wake_fd == -1) {
+		perror("Failed to create eventfd");
+		return 1;
+	}
+
 	rc = sd_bus_open_system(&bus);
 	if (rc < 0) {
 		fprintf(stderr,"Error opening system bus: %s\n",
@@ -217,13 +1198,15 @@ int main(int argc, char **argv)
 		return rc;
 	}
 
-	rc = sd_bus_add_object_vtable(bus, &obmc_console_slot, 
-			obmc_console_object, obmc_console_iface,
-			obmc_console_vtable, NULL);
-	if (rc < 0) {
-		fprintf(stderr, "Failed to add object to dbus: %s\n",
-			strerror(-rc));
-		return rc;
+	for (i = 0; i < n_consoles; i++) {
+		rc = sd_bus_add_object_vtable(bus, &consoles[i].slot,
+				consoles[i].object, obmc_console_iface,
+				obmc_console_vtable, &consoles[i]);
+		if (rc < 0) {
+			fprintf(stderr, "Failed to add object to dbus: %s\n",
+				strerror(-rc));
+			return rc;
+		}
 	}
 
 	rc = sd_bus_request_name(bus, obmc_console_iface, 0);
@@ -263,9 +1246,9 @@ int main(int argc, char **argv)
 
 	rc = 0;
  sdbus_free:
-	sd_bus_slot_unref(obmc_console_slot);
+	for (i = 0; i < n_consoles; i++)
+		sd_bus_slot_unref(consoles[i].slot);
 	sd_bus_unref(bus);
 
 	return rc;
 }
-
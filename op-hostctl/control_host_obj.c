@@ -2,12 +2,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <openbmc_intf.h>
 #include <openbmc.h>
 #include <gpio.h>
+#include "fsi.h"
 
 /* ------------------------------------------------------------------------- */
 static const gchar* dbus_object_path = "/org/openbmc/control";
@@ -23,23 +25,26 @@ GPIO cronus_sel   = (GPIO){ "CRONUS_SEL" };
 GPIO Throttle     = (GPIO){ "BMC_THROTTLE" };
 GPIO idbtn     	  = (GPIO){ "IDBTN" };
 
-/* Bit bang patterns */
+typedef struct {
+	uint32_t address;
+	uint32_t data;
+} CfamWrite;
 
-//putcfam pu 281c 30000000 -p0 (Primary Side Select)
-static const char* primary = "000011111111110101111000111001100111111111111111111111111111101111111111";
-//putcfam pu 281c B0000000 -p0
-static const char* go = "000011111111110101111000111000100111111111111111111111111111101101111111";
-//putcfam pu 0x281c 30900000 (Golden Side Select)
-static const char* golden = "000011111111110101111000111001100111101101111111111111111111101001111111";
+/* Flash side select, written to 0x281C; setting the top bit starts the
+ * host */
+#define CFAM_SIDE_SELECT   0x281C
+#define CFAM_PRIMARY_SIDE  0x30000000
+#define CFAM_GOLDEN_SIDE   0x30900000
+#define CFAM_GO            0xB0000000
 
-/* Setup attentions */
-//putcfam pu 0x081C 20000000
-static const char* attnA = "000011111111111101111110001001101111111111111111111111111111110001111111";
-//putcfam pu 0x100D 40000000
-static const char* attnB = "000011111111111011111100101001011111111111111111111111111111110001111111";
-//putcfam pu  0x100B FFFFFFFF
-static const char* attnC = "000011111111111011111101001000000000000000000000000000000000001011111111";
+/* Setup attentions. 0x0807 is the word at FSI byte address 0x081C. */
+static const CfamWrite attentions[] = {
+	{ 0x0807, 0x20000000 },
+	{ 0x100D, 0x40000000 },
+	{ 0x100B, 0xFFFFFFFF },
+};
 
+static FsiEngine fsi;
 
 
 static gboolean
@@ -52,30 +57,94 @@ on_init(Control *control,
 }
 
 int
-fsi_bitbang(const char* pattern)
+fsi_putcfam_standby(uint32_t address, uint32_t data)
 {
-	int rc=GPIO_OK;
-	int i;
-	for(i=0;i<strlen(pattern);i++) {
-		rc = gpio_writec(&fsi_data,pattern[i]);
-		if(rc!=GPIO_OK) { break; }
-		rc = gpio_clock_cycle(&fsi_clk,1);
-		if(rc!=GPIO_OK) { break; }
-	}
-	return rc;
+	int rc = fsi_putcfam(&fsi, address, data);
+	return rc | fsi_clock(&fsi, 1, 5000);
 }
 
 int
 fsi_standby()
 {
-	int rc=GPIO_OK;
-	rc = gpio_write(&fsi_data,1);
-	if(rc!=GPIO_OK) { return rc; }
-	rc = gpio_clock_cycle(&fsi_clk,5000);
+	return fsi_clock(&fsi, 1, 5000);
+}
+
+/* Opens the FSI lines and hands them to the BMC for a single CFAM access,
+ * returning the previous mux state in saved[] */
+static int
+fsi_access_begin(uint8_t* saved)
+{
+	int rc = gpio_open(&fsi_clk);
+	rc |= gpio_open(&fsi_data);
+	rc |= gpio_open(&fsi_enable);
+	rc |= gpio_open(&cronus_sel);
 	if(rc!=GPIO_OK) { return rc; }
+
+	rc = gpio_read(&fsi_enable,&saved[0]);
+	rc |= gpio_read(&cronus_sel,&saved[1]);
+	rc |= gpio_write(&cronus_sel,1);
+	rc |= gpio_write(&fsi_enable,1);
+	rc |= gpio_write(&fsi_clk,1);
 	return rc;
 }
 
+static void
+fsi_access_end(const uint8_t* saved)
+{
+	gpio_write(&fsi_enable,saved[0]);
+	gpio_write(&cronus_sel,saved[1]);
+	gpio_close(&fsi_clk);
+	gpio_close(&fsi_data);
+	gpio_close(&fsi_enable);
+	gpio_close(&cronus_sel);
+}
+
+static gboolean
+on_getcfam(ControlHost *host,
+		GDBusMethodInvocation *invocation,
+		guint address,
+		gpointer user_data)
+{
+	uint8_t saved[2] = { 0, 0 };
+	uint32_t data = 0;
+	int rc = fsi_access_begin(saved);
+	if(rc==GPIO_OK) {
+		rc = fsi_getcfam(&fsi,address,&data);
+	}
+	fsi_access_end(saved);
+	if(rc!=GPIO_OK) {
+		g_dbus_method_invocation_return_dbus_error(invocation,
+				"org.openbmc.Error.Fsi",
+				"CFAM read failed");
+		return TRUE;
+	}
+	control_host_complete_getcfam(host,invocation,data);
+	return TRUE;
+}
+
+static gboolean
+on_putcfam(ControlHost *host,
+		GDBusMethodInvocation *invocation,
+		guint address,
+		guint data,
+		gpointer user_data)
+{
+	uint8_t saved[2] = { 0, 0 };
+	int rc = fsi_access_begin(saved);
+	if(rc==GPIO_OK) {
+		rc = fsi_putcfam_standby(address,data);
+	}
+	fsi_access_end(saved);
+	if(rc!=GPIO_OK) {
+		g_dbus_method_invocation_return_dbus_error(invocation,
+				"org.openbmc.Error.Fsi",
+				"CFAM write failed");
+		return TRUE;
+	}
+	control_host_complete_putcfam(host,invocation);
+	return TRUE;
+}
+
 
 static gboolean
 on_boot(ControlHost *host,
@@ -104,6 +173,8 @@ on_boot(ControlHost *host,
 	g_print("Booting host\n");
 	Control* control = object_get_control((Object*)user_data);
 	control_host_complete_boot(host,invocation);
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	do {
 		rc = gpio_open(&fsi_clk);
 		rc |= gpio_open(&fsi_data);
@@ -125,28 +196,23 @@ on_boot(ControlHost *host,
 		rc = fsi_standby();
 
 		//clear out pipes
-		rc |= gpio_write(&fsi_data,0);
-		rc |= gpio_clock_cycle(&fsi_clk,256);
-		rc |= gpio_write(&fsi_data,1);
-		rc |= gpio_clock_cycle(&fsi_clk,50);
+		rc |= fsi_clock(&fsi,0,256);
+		rc |= fsi_clock(&fsi,1,50);
 		if(rc!=GPIO_OK) { break; }
 
-		rc = fsi_bitbang(attnA);
-		rc |= fsi_standby();
-
-		rc |= fsi_bitbang(attnB);
-		rc |= fsi_standby();
-
-		rc |= fsi_bitbang(attnC);
-		rc |= fsi_standby();
+		size_t i;
+		for(i=0;i<sizeof(attentions)/sizeof(attentions[0]);i++) {
+			rc |= fsi_putcfam_standby(attentions[i].address,
+					attentions[i].data);
+		}
 		if(rc!=GPIO_OK) { break; }
 
 		const gchar* flash_side = control_host_get_flash_side(host);
 		g_print("Using %s side of the bios flash\n",flash_side);
 		if(strcmp(flash_side,"primary")==0) {
-			rc |= fsi_bitbang(primary);
+			rc |= fsi_putcfam(&fsi,CFAM_SIDE_SELECT,CFAM_PRIMARY_SIDE);
 		} else if(strcmp(flash_side,"golden") == 0) {
-			rc |= fsi_bitbang(golden);
+			rc |= fsi_putcfam(&fsi,CFAM_SIDE_SELECT,CFAM_GOLDEN_SIDE);
 		} else {
 			g_print("ERROR: Invalid flash side: %s\n",flash_side);
 			rc = 0xff;
@@ -155,10 +221,9 @@ on_boot(ControlHost *host,
 		rc |= fsi_standby();
 		if(rc!=GPIO_OK) { break; }
 
-		rc = fsi_bitbang(go);
+		rc = fsi_putcfam(&fsi,CFAM_SIDE_SELECT,CFAM_GO);
 
-		rc |= gpio_write(&fsi_data,1); /* Data standby state */
-		rc |= gpio_clock_cycle(&fsi_clk,2);
+		rc |= fsi_clock(&fsi,1,2); /* Data standby state */
 
 		rc |= gpio_write(&fsi_clk,0); /* hold clk low for clock mux */
 		rc |= gpio_write(&fsi_enable,0);
@@ -166,6 +231,11 @@ on_boot(ControlHost *host,
 		rc |= gpio_write(&fsi_clk,0); /* Data standby state */
 
 	} while(0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	g_print("HostControl: boot sequence took %ld us (%s)\n",
+			(long)(end.tv_sec - start.tv_sec) * 1000000 +
+			(end.tv_nsec - start.tv_nsec) / 1000,
+			fsi.mmio ? "mmio" : "gpio");
 	if(rc != GPIO_OK)
 	{
 		g_print("ERROR HostControl: GPIO sequence failed (rc=%d)\n",rc);
@@ -260,6 +330,14 @@ on_bus_acquired(GDBusConnection *connection,
 			"handle-boot",
 			G_CALLBACK(on_boot),
 			object); /* user_data */
+	g_signal_connect(control_host,
+			"handle-getcfam",
+			G_CALLBACK(on_getcfam),
+			object); /* user_data */
+	g_signal_connect(control_host,
+			"handle-putcfam",
+			G_CALLBACK(on_putcfam),
+			object); /* user_data */
 	g_signal_connect(control,
 			"handle-init",
 			G_CALLBACK(on_init),
@@ -273,12 +351,14 @@ on_bus_acquired(GDBusConnection *connection,
 	g_dbus_object_manager_server_export(manager, G_DBUS_OBJECT_SKELETON(object));
 	g_object_unref(object);
 
-	gpio_init(connection,&fsi_data);
-	gpio_init(connection,&fsi_clk);
-	gpio_init(connection,&fsi_enable);
-	gpio_init(connection,&cronus_sel);
-	gpio_init(connection,&Throttle);
-	gpio_init(connection,&idbtn);
+	GPIO* host_gpios[] = {
+		&fsi_data, &fsi_clk, &fsi_enable, &cronus_sel, &Throttle, &idbtn,
+	};
+	gpio_init_many(connection, host_gpios,
+			sizeof(host_gpios) / sizeof(host_gpios[0]));
+
+	fsi_engine_init(&fsi, &fsi_clk, &fsi_data);
+	g_print("HostControl: FSI engine using %s\n", fsi.mmio ? "mmio" : "gpio");
 }
 
 static void
@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "fsi.h"
+#include <openbmc.h>
+
+/* ASPEED AST2x00 GPIO controller */
+#define ASPEED_GPIO_BASE   0x1E780000
+#define ASPEED_GPIO_SIZE   0x1000
+#define ASPEED_GPIO_LABEL  "1e780000.gpio"
+
+/* Data register of each group of four 8-bit banks (ABCD, EFGH, ...) */
+static const uint32_t aspeed_gpio_data_regs[] = {
+	0x000, 0x020, 0x070, 0x078, 0x080, 0x088, 0x1E0, 0x1E8,
+};
+
+/* FSI link protocol. The line is active low: a logical 1 is driven as 0
+ * and the idle level is 1. */
+#define FSI_SLAVE_ID        3
+#define FSI_CMD_ABS_AR      0x4
+#define FSI_RESP_ACK        0
+#define FSI_RESP_BUSY       1
+#define FSI_ADDR_BITS       21
+/* Idle clocks after a write; keeps frames the length of the old patterns */
+#define FSI_WRITE_IDLE      7
+/* Idle clocks the slave needs to echo a command before answering */
+#define FSI_ECHO_CLOCKS     16
+/* Clocks to wait for the response start bit */
+#define FSI_RESP_TIMEOUT    1000
+/* Idle clocks to prime the slave for the next command */
+#define FSI_PRIME_CLOCKS    20
+
+#define FSI_FRAME_CACHE_SIZE 16
+
+typedef struct {
+	bool valid;
+	bool read;
+	uint32_t addr;
+	uint32_t data;
+	FsiPattern frame;
+} FsiFrameCache;
+
+static FsiFrameCache frame_cache[FSI_FRAME_CACHE_SIZE];
+static size_t frame_cache_next;
+
+void
+fsi_pattern_free(FsiPattern* pattern)
+{
+	free(pattern->bits);
+	pattern->bits = NULL;
+	pattern->num_bits = 0;
+}
+
+static inline uint8_t
+fsi_pattern_bit(const FsiPattern* pattern, size_t i)
+{
+	return (pattern->bits[i / 8] >> (7 - i % 8)) & 1;
+}
+
+/* Frame builder; bits are logical values, inverted when emitted */
+typedef struct {
+	uint8_t bits[80];
+	size_t num_bits;
+	uint8_t crc;
+} FsiMsg;
+
+/* CRC-4 over every bit including the start bit, polynomial x^4 + x + 1 */
+static uint8_t
+fsi_crc4(uint8_t crc, uint32_t value, int num_bits)
+{
+	int i;
+
+	for (i = num_bits - 1; i >= 0; i--) {
+		uint8_t feedback = ((crc >> 3) ^ (value >> i)) & 1;
+		crc = (crc << 1) & 0xf;
+		if (feedback) {
+			crc ^= 0x7;
+		}
+	}
+	return crc;
+}
+
+static void
+fsi_msg_push(FsiMsg* msg, uint32_t value, int num_bits)
+{
+	int i;
+
+	for (i = num_bits - 1; i >= 0; i--) {
+		msg->bits[msg->num_bits++] = (value >> i) & 1;
+	}
+	msg->crc = fsi_crc4(msg->crc, value, num_bits);
+}
+
+/* CFAM addresses are word addresses; the low byte selects a word within
+ * the 256 byte engine window. The size bit marks a 4 byte access. */
+static uint32_t
+fsi_cfam_to_fsi(uint32_t cfam)
+{
+	uint32_t addr = (cfam & 0xffffff00) | ((cfam & 0xff) << 2);
+	return (addr | 1) & ((1 << FSI_ADDR_BITS) - 1);
+}
+
+int
+fsi_encode(FsiPattern* pattern, uint32_t cfam, bool read, uint32_t data)
+{
+	FsiMsg msg;
+	size_t idle = read ? FSI_ECHO_CLOCKS : FSI_WRITE_IDLE;
+	size_t i;
+
+	memset(&msg, 0, sizeof(msg));
+	fsi_msg_push(&msg, 1, 1);
+	fsi_msg_push(&msg, FSI_SLAVE_ID, 2);
+	fsi_msg_push(&msg, FSI_CMD_ABS_AR, 3);
+	fsi_msg_push(&msg, read ? 1 : 0, 1);
+	fsi_msg_push(&msg, fsi_cfam_to_fsi(cfam), FSI_ADDR_BITS);
+	fsi_msg_push(&msg, 1, 1);
+	if (!read) {
+		fsi_msg_push(&msg, data, 32);
+	}
+	fsi_msg_push(&msg, msg.crc, 4);
+
+	pattern->num_bits = msg.num_bits + idle;
+	pattern->bits = calloc((pattern->num_bits + 7) / 8, 1);
+	if (pattern->bits == NULL) {
+		pattern->num_bits = 0;
+		return GPIO_ERROR;
+	}
+	for (i = 0; i < pattern->num_bits; i++) {
+		if (i >= msg.num_bits || !msg.bits[i]) {
+			pattern->bits[i / 8] |= 0x80 >> (i % 8);
+		}
+	}
+	return GPIO_OK;
+}
+
+/* Encoded frames are kept so repeated accesses, such as the boot sequence,
+ * only pay for the encoding once. The oldest entry is recycled when full. */
+const FsiPattern*
+fsi_frame(uint32_t cfam, bool read, uint32_t data)
+{
+	FsiFrameCache* entry;
+	size_t i;
+
+	if (read) {
+		data = 0;
+	}
+	for (i = 0; i < FSI_FRAME_CACHE_SIZE; i++) {
+		entry = &frame_cache[i];
+		if (entry->valid && entry->read == read &&
+				entry->addr == cfam && entry->data == data) {
+			return &entry->frame;
+		}
+	}
+	entry = &frame_cache[frame_cache_next];
+	frame_cache_next = (frame_cache_next + 1) % FSI_FRAME_CACHE_SIZE;
+	if (entry->valid) {
+		fsi_pattern_free(&entry->frame);
+		entry->valid = false;
+	}
+	if (fsi_encode(&entry->frame, cfam, read, data) != GPIO_OK) {
+		return NULL;
+	}
+	entry->read = read;
+	entry->addr = cfam;
+	entry->data = data;
+	entry->valid = true;
+	return &entry->frame;
+}
+
+static int
+fsi_map_line(FsiEngine* fsi, GPIO* gpio, void** reg, uint32_t* mask)
+{
+	char label[32];
+	uint32_t bank;
+
+	if (gpio_chip_info(gpio, label, sizeof(label)) != GPIO_OK ||
+			strcmp(label, ASPEED_GPIO_LABEL) != 0) {
+		return GPIO_LOOKUP_ERROR;
+	}
+	bank = gpio->line_offset / 32;
+	if (bank >= sizeof(aspeed_gpio_data_regs) / sizeof(aspeed_gpio_data_regs[0])) {
+		return GPIO_LOOKUP_ERROR;
+	}
+	*reg = (uint8_t*)fsi->map + aspeed_gpio_data_regs[bank];
+	*mask = 1 << (gpio->line_offset % 32);
+	return GPIO_OK;
+}
+
+/* Lines must already be initialised as outputs with gpio_init(). Setting
+ * OBMC_FSI_MMIO=0 forces the gpio_* path, e.g. to compare boot timings.
+ *
+ * Reading an ASPEED data register returns the pin levels, not what was
+ * written, so the registers are not read back for every write: the value
+ * last written to each is kept in clk_latch/data_latch. Other lines in the
+ * same banks, such as CRONUS_SEL and FSI_ENABLE on Palmetto, are set
+ * through sysfs between sequences, so the latches are seeded again from
+ * the pins at the start of every sequence. Only a write to those banks
+ * made while a sequence is being clocked out would be lost. */
+int
+fsi_engine_init(FsiEngine* fsi, GPIO* clk, GPIO* data)
+{
+	memset(fsi, 0, sizeof(*fsi));
+	fsi->clk = clk;
+	fsi->data = data;
+#ifdef __arm__
+	int fd;
+	const char* env = getenv("OBMC_FSI_MMIO");
+
+	if (env != NULL && strcmp(env, "0") == 0) {
+		return GPIO_OK;
+	}
+	fd = open("/dev/mem", O_RDWR | O_SYNC);
+	if (fd < 0) {
+		return GPIO_OK;
+	}
+	fsi->map = mmap(NULL, ASPEED_GPIO_SIZE, PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, ASPEED_GPIO_BASE);
+	close(fd);
+	if (fsi->map == MAP_FAILED) {
+		fsi->map = NULL;
+		return GPIO_OK;
+	}
+	if (fsi_map_line(fsi, clk, &fsi->clk_reg, &fsi->clk_mask) != GPIO_OK ||
+			fsi_map_line(fsi, data, &fsi->data_reg, &fsi->data_mask) != GPIO_OK) {
+		munmap(fsi->map, ASPEED_GPIO_SIZE);
+		fsi->map = NULL;
+		return GPIO_OK;
+	}
+	fsi->mmio = true;
+#endif
+	return GPIO_OK;
+}
+
+void
+fsi_engine_close(FsiEngine* fsi)
+{
+	if (fsi->map != NULL) {
+		munmap(fsi->map, ASPEED_GPIO_SIZE);
+		fsi->map = NULL;
+	}
+	fsi->mmio = false;
+}
+
+/* Outputs read back the level they drive */
+static inline void
+fsi_mmio_seed(FsiEngine* fsi)
+{
+	fsi->clk_latch = devmem_read(fsi->clk_reg);
+	fsi->data_latch = devmem_read(fsi->data_reg);
+}
+
+static inline void
+fsi_mmio_set(void* reg, uint32_t* latch, uint32_t mask, uint8_t value)
+{
+	*latch = value ? (*latch | mask) : (*latch & ~mask);
+	devmem(reg, *latch);
+}
+
+/* Data changes with the falling clock edge and is sampled on the rising
+ * one. When both lines share a register each edge is a single write, and
+ * clk_latch holds the register. */
+static inline void
+fsi_mmio_bit(FsiEngine* fsi, uint8_t bit)
+{
+	if (fsi->clk_reg == fsi->data_reg) {
+		uint32_t v = fsi->clk_latch & ~fsi->clk_mask;
+		v = bit ? (v | fsi->data_mask) : (v & ~fsi->data_mask);
+		devmem(fsi->clk_reg, v);
+		fsi->clk_latch = v | fsi->clk_mask;
+		devmem(fsi->clk_reg, fsi->clk_latch);
+	} else {
+		fsi_mmio_set(fsi->data_reg, &fsi->data_latch, fsi->data_mask, bit);
+		fsi_mmio_set(fsi->clk_reg, &fsi->clk_latch, fsi->clk_mask, 0);
+		fsi_mmio_set(fsi->clk_reg, &fsi->clk_latch, fsi->clk_mask, 1);
+	}
+}
+
+/* The GPIO driver keeps its own copy of the data registers; write the
+ * final levels through it so later writes to neighbouring pins do not
+ * restore stale clock/data values. */
+static int
+fsi_mmio_sync(FsiEngine* fsi, uint8_t bit)
+{
+	int rc = gpio_write(fsi->data, bit);
+	rc |= gpio_write(fsi->clk, 1);
+	return rc;
+}
+
+int
+fsi_send(FsiEngine* fsi, const FsiPattern* pattern)
+{
+	int rc = GPIO_OK;
+	size_t i;
+	uint8_t bit = 0xff;
+
+	if (pattern->num_bits == 0) {
+		return rc;
+	}
+	if (fsi->mmio) {
+		fsi_mmio_seed(fsi);
+		for (i = 0; i < pattern->num_bits; i++) {
+			fsi_mmio_bit(fsi, fsi_pattern_bit(pattern, i));
+		}
+		return fsi_mmio_sync(fsi, fsi_pattern_bit(pattern,
+					pattern->num_bits - 1));
+	}
+	for (i = 0; i < pattern->num_bits; i++) {
+		uint8_t next = fsi_pattern_bit(pattern, i);
+		/* Only touch the data line when it changes */
+		if (next != bit) {
+			rc = gpio_write(fsi->data, next);
+			if (rc != GPIO_OK) { break; }
+			bit = next;
+		}
+		rc = gpio_clock_cycle(fsi->clk, 1);
+		if (rc != GPIO_OK) { break; }
+	}
+	return rc;
+}
+
+/* Holds data at a level for num_clks clock cycles */
+int
+fsi_clock(FsiEngine* fsi, uint8_t bit, int num_clks)
+{
+	int rc;
+	int i;
+
+	if (fsi->mmio) {
+		fsi_mmio_seed(fsi);
+		for (i = 0; i < num_clks; i++) {
+			fsi_mmio_bit(fsi, bit);
+		}
+		return fsi_mmio_sync(fsi, bit);
+	}
+	rc = gpio_write(fsi->data, bit);
+	if (rc != GPIO_OK) {
+		return rc;
+	}
+	return gpio_clock_cycle(fsi->clk, num_clks);
+}
+
+/* Clocks one bit in from the slave, sampled after the rising edge */
+static int
+fsi_clock_in(FsiEngine* fsi, uint8_t* bit)
+{
+	int rc = GPIO_OK;
+	uint8_t value = 0;
+
+	if (fsi->mmio) {
+		fsi_mmio_set(fsi->clk_reg, &fsi->clk_latch, fsi->clk_mask, 0);
+		fsi_mmio_set(fsi->clk_reg, &fsi->clk_latch, fsi->clk_mask, 1);
+		value = (devmem_read(fsi->data_reg) & fsi->data_mask) ? 1 : 0;
+	} else {
+		rc = gpio_clock_cycle(fsi->clk, 1);
+		rc |= gpio_read(fsi->data, &value);
+	}
+	*bit = !value;
+	return rc;
+}
+
+static int
+fsi_receive(FsiEngine* fsi, uint32_t* value, int num_bits, uint8_t* crc)
+{
+	int rc = GPIO_OK;
+	uint8_t bit;
+	int i;
+
+	*value = 0;
+	for (i = 0; i < num_bits; i++) {
+		rc = fsi_clock_in(fsi, &bit);
+		if (rc != GPIO_OK) {
+			return rc;
+		}
+		*value = (*value << 1) | bit;
+	}
+	*crc = fsi_crc4(*crc, *value, num_bits);
+	return rc;
+}
+
+/* Reads the slave's response to a command: start bit, slave id, response
+ * code, data on an acknowledged read, and a CRC over all of it. */
+static int
+fsi_response(FsiEngine* fsi, uint32_t* data)
+{
+	int rc;
+	int i;
+	uint32_t value;
+	uint8_t crc = 0;
+	uint8_t bit = 0;
+
+	rc = gpio_set_direction(fsi->data, false, 0);
+	if (rc != GPIO_OK) {
+		return rc;
+	}
+	if (fsi->mmio) {
+		fsi_mmio_seed(fsi);
+	}
+	do {
+		for (i = 0; i < FSI_RESP_TIMEOUT && !bit; i++) {
+			rc = fsi_clock_in(fsi, &bit);
+			if (rc != GPIO_OK) { break; }
+		}
+		if (rc != GPIO_OK) { break; }
+		if (!bit) {
+			g_print("ERROR FSI: no response from slave\n");
+			rc = GPIO_READ_ERROR;
+			break;
+		}
+		crc = fsi_crc4(crc, 1, 1);
+		rc = fsi_receive(fsi, &value, 2, &crc);
+		rc |= fsi_receive(fsi, &value, 2, &crc);
+		if (rc != GPIO_OK) { break; }
+		if (value != FSI_RESP_ACK) {
+			g_print("ERROR FSI: slave response %u\n", value);
+			rc = GPIO_READ_ERROR;
+			break;
+		}
+		if (data != NULL) {
+			rc = fsi_receive(fsi, data, 32, &crc);
+		}
+		rc |= fsi_receive(fsi, &value, 4, &crc);
+		if (rc != GPIO_OK) { break; }
+		if (crc != 0) {
+			g_print("ERROR FSI: response CRC mismatch\n");
+			rc = GPIO_READ_ERROR;
+		}
+	} while(0);
+	/* Take the line back even after a failed read */
+	if (gpio_set_direction(fsi->data, true, 1) != GPIO_OK) {
+		rc |= GPIO_WRITE_ERROR;
+	}
+	return rc | fsi_clock(fsi, 1, FSI_PRIME_CLOCKS);
+}
+
+int
+fsi_putcfam(FsiEngine* fsi, uint32_t cfam, uint32_t data)
+{
+	const FsiPattern* frame = fsi_frame(cfam, false, data);
+
+	if (frame == NULL) {
+		return GPIO_ERROR;
+	}
+	return fsi_send(fsi, frame);
+}
+
+int
+fsi_getcfam(FsiEngine* fsi, uint32_t cfam, uint32_t* data)
+{
+	int rc;
+	const FsiPattern* frame = fsi_frame(cfam, true, 0);
+
+	if (frame == NULL) {
+		return GPIO_ERROR;
+	}
+	rc = fsi_send(fsi, frame);
+	if (rc != GPIO_OK) {
+		return rc;
+	}
+	return fsi_response(fsi, data);
+}
@@ -0,0 +1,47 @@
+#ifndef __FSI_H__
+#define __FSI_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <gpio.h>
+
+/* A bit bang pattern packed MSB first */
+typedef struct {
+	size_t num_bits;
+	uint8_t *bits;
+} FsiPattern;
+
+/* FSI transmit engine. When the clock and data lines live on the BMC's own
+ * GPIO controller they are driven through its mmap'd data registers;
+ * otherwise through the regular gpio_* calls. The latches hold what was
+ * last written to each register, as reading one returns the pin levels;
+ * they are seeded from the pins at the start of each sequence. */
+typedef struct {
+	GPIO *clk;
+	GPIO *data;
+	bool mmio;
+	void *map;
+	void *clk_reg;
+	uint32_t clk_mask;
+	void *data_reg;
+	uint32_t data_mask;
+	uint32_t clk_latch;
+	uint32_t data_latch;
+} FsiEngine;
+
+void fsi_pattern_free(FsiPattern*);
+
+/* CFAM access frames built from (address, data) at runtime. Addresses are
+ * in putcfam/getcfam form, e.g. 0x281C. */
+int fsi_encode(FsiPattern*, uint32_t, bool, uint32_t);
+const FsiPattern* fsi_frame(uint32_t, bool, uint32_t);
+
+int fsi_engine_init(FsiEngine*, GPIO*, GPIO*);
+void fsi_engine_close(FsiEngine*);
+int fsi_send(FsiEngine*, const FsiPattern*);
+int fsi_clock(FsiEngine*, uint8_t, int);
+int fsi_putcfam(FsiEngine*, uint32_t, uint32_t);
+int fsi_getcfam(FsiEngine*, uint32_t, uint32_t*);
+
+#endif
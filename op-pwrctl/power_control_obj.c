@@ -18,16 +18,112 @@ static const gchar* instance_name = "power0";
 static const gchar* dbus_name = "org.openbmc.control.Power";
 
 static PowerGpio g_power_gpio;
+static GpioGroup g_power_up_group;
+static GpioGroup g_reset_group;
 
 static GDBusObjectManagerServer *manager = NULL;
 
-time_t pgood_timeout_start = 0;
+/* One-shot timer armed while pgood has not reached the requested state */
+static guint pgood_timeout_id = 0;
 
-// TODO:  Change to interrupt driven instead of polling
 static gboolean
-poll_pgood(gpointer user_data)
+on_pgood_timeout(gpointer user_data)
 {
 	ControlPower *control_power = object_get_control_power((Object*)user_data);
+
+	g_print("ERROR PowerControl: Pgood timeout\n");
+	// set timeout to 0 so timeout doesn't happen again
+	control_power_set_pgood_timeout(control_power,0);
+	pgood_timeout_id = 0;
+	return FALSE;
+}
+
+static void
+disarm_pgood_timeout(void)
+{
+	if(pgood_timeout_id != 0) {
+		g_source_remove(pgood_timeout_id);
+		pgood_timeout_id = 0;
+	}
+}
+
+static void
+arm_pgood_timeout(Object *object)
+{
+	ControlPower *control_power = object_get_control_power(object);
+	gint timeout = control_power_get_pgood_timeout(control_power);
+
+	disarm_pgood_timeout();
+	if(control_power_get_pgood(control_power) !=
+			control_power_get_state(control_power) && timeout > 0) {
+		pgood_timeout_id = g_timeout_add_seconds(timeout,
+				on_pgood_timeout, object);
+	}
+}
+
+/* timestamp is CLOCK_MONOTONIC nanoseconds of the pgood edge */
+static void
+pgood_changed(Object *object, uint8_t pgood_state, guint64 timestamp)
+{
+	ControlPower *control_power = object_get_control_power(object);
+	Control* control = object_get_control(object);
+	int rc;
+
+	if(pgood_state == control_power_get_pgood(control_power)) {
+		return;
+	}
+	control_power_set_pgood(control_power, pgood_state);
+	if(pgood_state == 0)
+	{
+		control_power_emit_power_lost(control_power);
+		control_power_emit_power_lost_at(control_power, timestamp);
+		control_emit_goto_system_state(control,"HOST_POWERED_OFF");
+	}
+	else
+	{
+		control_power_emit_power_good(control_power);
+		control_power_emit_power_good_at(control_power, timestamp);
+		control_emit_goto_system_state(control,"HOST_POWERED_ON");
+	}
+
+	g_print("PowerControl: setting %Zu resets to %s\n",
+			g_power_gpio.num_reset_outs,
+			pgood_state ? "released" : "asserted");
+	rc = gpio_group_set(&g_reset_group, pgood_state);
+	if(rc != GPIO_OK)
+	{
+		g_print("ERROR PowerControl: GPIO reset set error (rc=%d)\n",
+				rc);
+	}
+
+	if(pgood_state == control_power_get_state(control_power)) {
+		disarm_pgood_timeout();
+	}
+}
+
+static gboolean
+on_pgood_event(GIOChannel *channel,
+		GIOCondition condition,
+		gpointer user_data)
+{
+	uint8_t pgood_state;
+	guint64 timestamp;
+
+	int rc = gpio_read_event(&g_power_gpio.power_good_in, &pgood_state,
+			&timestamp);
+	if(rc != GPIO_OK) {
+		g_print("ERROR PowerControl: GPIO event read error (gpio=%s,rc=%d)\n",
+				g_power_gpio.power_good_in.name, rc);
+		return TRUE;
+	}
+	pgood_changed((Object*)user_data, pgood_state, timestamp);
+	return TRUE;
+}
+
+/* Fallback for platforms whose pgood line cannot generate edges */
+static gboolean
+poll_pgood(gpointer user_data)
+{
 	Control* control = object_get_control((Object*)user_data);
 
 	//send the heartbeat
@@ -37,17 +133,6 @@ poll_pgood(gpointer user_data)
 		g_print("ERROR PowerControl: Poll interval cannot be 0\n");
 		return FALSE;
 	}
-	//handle timeout
-	time_t current_time = time(NULL);
-	if(difftime(current_time,pgood_timeout_start) > control_power_get_pgood_timeout(control_power)
-			&& pgood_timeout_start != 0)
-	{
-		g_print("ERROR PowerControl: Pgood poll timeout\n");
-		// set timeout to 0 so timeout doesn't happen again
-		control_power_set_pgood_timeout(control_power,0);
-		pgood_timeout_start = 0;
-		return TRUE;
-	}
 	uint8_t pgood_state;
 
 	int rc = gpio_open(&g_power_gpio.power_good_in);
@@ -58,61 +143,14 @@ poll_pgood(gpointer user_data)
 	}
 	rc = gpio_read(&g_power_gpio.power_good_in, &pgood_state);
 	gpio_close(&g_power_gpio.power_good_in);
-	if(rc == GPIO_OK)
-	{
-		//if changed, set property and emit signal
-		if(pgood_state != control_power_get_pgood(control_power))
-		{
-			int i;
-			uint8_t reset_state;
-			control_power_set_pgood(control_power, pgood_state);
-			if(pgood_state == 0)
-			{
-				control_power_emit_power_lost(control_power);
-				control_emit_goto_system_state(control,"HOST_POWERED_OFF");
-			}
-			else
-			{
-				control_power_emit_power_good(control_power);
-				control_emit_goto_system_state(control,"HOST_POWERED_ON");
-			}
-
-			for(i = 0; i < g_power_gpio.num_reset_outs; i++)
-			{
-				GPIO *reset_out = &g_power_gpio.reset_outs[i];
-				rc = gpio_open(reset_out);
-				if(rc != GPIO_OK)
-				{
-					g_print("ERROR PowerControl: GPIO open error (gpio=%s,rc=%d)\n",
-							reset_out->name, rc);
-					continue;
-				}
-
-				reset_state = pgood_state ^ !g_power_gpio.reset_pols[i];
-				g_print("PowerControl: setting reset %s to %d\n", reset_out->name,
-						(int)reset_state);
-				gpio_write(reset_out, reset_state);
-				gpio_close(reset_out);
-			}
-		}
-	} else {
+	if(rc != GPIO_OK) {
 		g_print("ERROR PowerControl: GPIO read error (gpio=%s,rc=%d)\n",
 				g_power_gpio.power_good_in.name, rc);
 		//return false so poll won't get called anymore
 		return FALSE;
 	}
-	//pgood is not at desired state yet
-	if(pgood_state != control_power_get_state(control_power) &&
-			control_power_get_pgood_timeout(control_power) > 0)
-	{
-		if(pgood_timeout_start == 0 ) {
-			pgood_timeout_start = current_time;
-		}
-	}
-	else
-	{
-		pgood_timeout_start = 0;
-	}
+	pgood_changed((Object*)user_data, pgood_state,
+			g_get_monotonic_time() * 1000);
 	return TRUE;
 }
 
@@ -140,32 +178,17 @@ on_set_power_state(ControlPower *pwr,
 	{
 		int error = 0;
 		do {
-			int i;
-			uint8_t power_up_out;
 			if(state == 1) {
 				control_emit_goto_system_state(control,"HOST_POWERING_ON");
 			} else {
 				control_emit_goto_system_state(control,"HOST_POWERING_OFF");
 			}
-			for (i = 0; i < g_power_gpio.num_power_up_outs; i++) {
-				GPIO *power_pin = &g_power_gpio.power_up_outs[i];
-				error = gpio_open(power_pin);
-				if(error != GPIO_OK) {
-					g_print("ERROR PowerControl: GPIO open error (gpio=%s,rc=%d)\n",
-							g_power_gpio.power_up_outs[i].name, error);
-					continue;
-				}
-				power_up_out = state ^ !g_power_gpio.power_up_pols[i];
-				g_print("PowerControl: setting power up %s to %d\n",
-						g_power_gpio.power_up_outs[i].name, (int)power_up_out);
-				error = gpio_write(power_pin, power_up_out);
-				if(error != GPIO_OK) {
-					continue;
-				}
-				gpio_close(power_pin);
-			}
+			g_print("PowerControl: setting %Zu power up outputs to %d\n",
+					g_power_gpio.num_power_up_outs, state);
+			error = gpio_group_set(&g_power_up_group, state);
 			if(error != GPIO_OK) { break;	}
 			control_power_set_state(pwr,state);
+			arm_pgood_timeout((Object*)user_data);
 		} while(0);
 		if(error != GPIO_OK)
 		{
@@ -180,7 +203,7 @@ on_init(Control *control,
 		GDBusMethodInvocation *invocation,
 		gpointer user_data)
 {
-	pgood_timeout_start = 0;
+	disarm_pgood_timeout();
 	//guint poll_interval = control_get_poll_interval(control);
 	//g_timeout_add(poll_interval, poll_pgood, user_data);
 	control_complete_init(control,invocation);
@@ -205,31 +228,28 @@ set_up_gpio(GDBusConnection *connection,
 	int error = GPIO_OK;
 	int rc;
 	int i;
+	size_t num_gpios = 0;
+	GPIO **gpios;
 	uint8_t pgood_state;
 
-	// get gpio device paths
+	// get gpio device paths in a single lookup
+	gpios = g_malloc0_n(2 + power_gpio->num_power_up_outs +
+			power_gpio->num_reset_outs, sizeof(GPIO*));
 	if(power_gpio->latch_out.name != NULL) {  /* latch is optional */
-		rc = gpio_init(connection, &power_gpio->latch_out);
-		if(rc != GPIO_OK) {
-			error = rc;
-		}
+		gpios[num_gpios++] = &power_gpio->latch_out;
 	}
-	rc = gpio_init(connection, &power_gpio->power_good_in);
-	if(rc != GPIO_OK) {
-		error = rc;
+	gpios[num_gpios++] = &power_gpio->power_good_in;
+	for(i = 0; i < power_gpio->num_power_up_outs; i++) {
+		gpios[num_gpios++] = &power_gpio->power_up_outs[i];
 	}
-	for(int i = 0; i < power_gpio->num_power_up_outs; i++) {
-		rc = gpio_init(connection, &power_gpio->power_up_outs[i]);
-		if(rc != GPIO_OK) {
-			error = rc;
-		}
+	for(i = 0; i < power_gpio->num_reset_outs; i++) {
+		gpios[num_gpios++] = &power_gpio->reset_outs[i];
 	}
-	for(int i = 0; i < power_gpio->num_reset_outs; i++) {
-		rc = gpio_init(connection, &power_gpio->reset_outs[i]);
-		if(rc != GPIO_OK) {
-			error = rc;
-		}
+	rc = gpio_init_many(connection, gpios, num_gpios);
+	if(rc != GPIO_OK) {
+		error = rc;
 	}
+	g_free(gpios);
 
 	/* If there's a latch, it only needs to be set once. */
 	if(power_gpio->latch_out.name != NULL) {
@@ -251,6 +271,22 @@ set_up_gpio(GDBusConnection *connection,
 		}
 	}
 
+	/* Power up and reset outputs are driven as groups from here on. The
+	 * latch gates the power up outputs so they change together. */
+	rc = gpio_group_init(&g_power_up_group, power_gpio->power_up_outs,
+			power_gpio->power_up_pols, power_gpio->num_power_up_outs,
+			power_gpio->latch_out.name != NULL ? &power_gpio->latch_out : NULL);
+	if(rc != GPIO_OK) {
+		error = rc;
+		g_print("PowerControl ERROR power up group setup rc=%d\n", rc);
+	}
+	rc = gpio_group_init(&g_reset_group, power_gpio->reset_outs,
+			power_gpio->reset_pols, power_gpio->num_reset_outs, NULL);
+	if(rc != GPIO_OK) {
+		error = rc;
+		g_print("PowerControl ERROR reset group setup rc=%d\n", rc);
+	}
+
 	rc = gpio_open(&power_gpio->power_good_in);
 	if(rc != GPIO_OK) {
 		return rc;
@@ -323,8 +359,7 @@ on_bus_acquired(GDBusConnection *connection,
 	if(rc != GPIO_OK) {
 		g_print("ERROR PowerControl: GPIO setup (rc=%d)\n",rc);
 	}
-	//start poll
-	pgood_timeout_start = 0;
+	//start monitoring pgood
 	int poll_interval = atoi(cmd->argv[1]);
 	int pgood_timeout = atoi(cmd->argv[2]);
 	if(poll_interval < 1000 || pgood_timeout <5) {
@@ -332,7 +367,21 @@ on_bus_acquired(GDBusConnection *connection,
 	} else {
 		control_set_poll_interval(control,poll_interval);
 		control_power_set_pgood_timeout(control_power,pgood_timeout);
-		g_timeout_add(poll_interval, poll_pgood, object);
+		rc = gpio_open_events(&g_power_gpio.power_good_in,
+				on_pgood_event, object);
+		if(rc == GPIO_OK) {
+			uint8_t pgood_state;
+			g_print("PowerControl: pgood is interrupt driven\n");
+			// catch an edge that raced the initial read in set_up_gpio
+			if(gpio_read(&g_power_gpio.power_good_in, &pgood_state) == GPIO_OK) {
+				pgood_changed((Object*)object, pgood_state,
+						g_get_monotonic_time() * 1000);
+			}
+		} else {
+			g_print("PowerControl: no pgood edge support (rc=%d), polling\n",
+					rc);
+			g_timeout_add(poll_interval, poll_pgood, object);
+		}
 	}
 }
 
@@ -348,6 +397,8 @@ on_name_lost(GDBusConnection *connection,
 		const gchar *name,
 		gpointer user_data)
 {
+	gpio_group_close(&g_power_up_group);
+	gpio_group_close(&g_reset_group);
 	free_power_gpio(&g_power_gpio);
 }
 
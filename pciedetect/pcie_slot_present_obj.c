@@ -112,8 +112,6 @@ get_presence(GDBusConnection* connection, GPIO* gpio, uint8_t* present)
 {
 	int rc = GPIO_OK;
 	do {
-		rc = gpio_init(connection,gpio);
-		if(rc != GPIO_OK) { break; }
 		uint8_t gpio_val;
 		rc = gpio_open(gpio);
 		if(rc != GPIO_OK) { break; }
@@ -196,6 +194,14 @@ main(gint argc, gchar *argv[])
 
 	int i = 0;
 	int rc = 0;
+	GPIO* slot_gpios[NUM_SLOTS];
+	for(i=0;i<NUM_SLOTS;i++)
+		slot_gpios[i] = &slots[i];
+	/* Resolve every presence pin in one round trip */
+	rc = gpio_init_many(c, slot_gpios, NUM_SLOTS);
+	if(rc != GPIO_OK)
+		printf("ERROR pcie_slot_present: GPIO init (rc=%d)\n", rc);
+
 	for(i=0;i<NUM_SLOTS;i++)
 	{
 		object_info obj_info;
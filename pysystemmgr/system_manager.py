@@ -5,6 +5,7 @@ import dbus
 import dbus.service
 import dbus.mainloop.glib
 import os
+import re
 import obmc.dbuslib.propertycacher as PropertyCacher
 from obmc.dbuslib.bindings import DbusProperties, DbusObjectManager, get_dbus
 import obmc.enums
@@ -155,8 +156,7 @@ class SystemManager(DbusProperties, DbusObjectManager):
         if obj_path in System.EXIT_STATE_DEPEND[current_state]:
             print "New object: "+obj_path+" ("+bus_name+")"
 
-    @dbus.service.method(DBUS_NAME, in_signature='s', out_signature='sis')
-    def gpioInit(self, name):
+    def doGpioLookup(self, name):
         gpio_path = ''
         gpio_num = -1
         r = ['', gpio_num, '']
@@ -183,6 +183,22 @@ class SystemManager(DbusProperties, DbusObjectManager):
                 r = [obmc.enums.GPIO_DEV, gpio_num, gpio['direction']]
         return r
 
+    @dbus.service.method(DBUS_NAME, in_signature='s', out_signature='sis')
+    def gpioInit(self, name):
+        return self.doGpioLookup(name)
+
+    # Resolve several GPIOs in one call. A name that cannot be resolved
+    # comes back as ['', -1, ''] so the remaining lines still resolve.
+    @dbus.service.method(DBUS_NAME, in_signature='as', out_signature='a(sis)')
+    def gpioInitMany(self, names):
+        r = []
+        for name in names:
+            try:
+                r.append(self.doGpioLookup(name))
+            except Exception:
+                r.append(['', -1, ''])
+        return r
+
     @dbus.service.method(DBUS_NAME, in_signature='',
             out_signature='ssa(sb)a(sb)')
     def getPowerConfiguration(self):
@@ -194,6 +210,35 @@ class SystemManager(DbusProperties, DbusObjectManager):
         print "Power GPIO config: " + str(r)
         return r
 
+    # LED groups for ledctl: group name -> names under /sys/class/leds
+    @dbus.service.method(DBUS_NAME, in_signature='',
+            out_signature='a{sas}')
+    def getLedGroupConfiguration(self):
+        return getattr(System, 'LED_GROUP_CONFIG', {})
+
+    # Fan tachs for fanctl, from the HWMON_CONFIG entries of each fan's
+    # 'tach/fanNH' and 'tach/fanNL' sensors:
+    # (fan, hwmon instance, high attribute, low attribute)
+    @dbus.service.method(DBUS_NAME, in_signature='',
+            out_signature='a(isss)')
+    def getFanTachConfiguration(self):
+        halves = {}
+        for instance, hwmon in getattr(System, 'HWMON_CONFIG', {}).items():
+            for attr, sensor in hwmon.get('names', {}).items():
+                m = re.match(r'tach/fan(\d+)([HL])$',
+                             sensor.get('object_path', ''))
+                if m:
+                    fan = halves.setdefault(int(m.group(1)), {})
+                    fan[m.group(2)] = (instance, attr)
+        r = []
+        for fan in sorted(halves):
+            high = halves[fan].get('H')
+            low = halves[fan].get('L')
+            # both halves must come from the same chip to be read together
+            if high and low and high[0] == low[0]:
+                r.append([fan, high[0], high[1], low[1]])
+        return r
+
 
 if __name__ == '__main__':
     dbus.mainloop.glib.DBusGMainLoop(set_as_default=True)
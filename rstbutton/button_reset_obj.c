@@ -1,17 +1,21 @@
 #include <stdio.h>
 #include <openbmc_intf.h>
 #include <gpio.h>
+#include <gpio_event.h>
 #include <openbmc.h>
 
 /* ------------------------------------------------------------------------- */
 static const gchar* dbus_object_path = "/org/openbmc/buttons";
 static const gchar* instance_name = "reset0";
 static const gchar* dbus_name = "org.openbmc.buttons.reset";
-static const int LONG_PRESS_SECONDS = 3;
+static const uint64_t LONG_PRESS_MS = 3000;
+static const guint DEBOUNCE_MS = 20;
 static GDBusObjectManagerServer *manager = NULL;
 
 //This object will use these GPIOs
 GPIO gpio_button = (GPIO){ "RESET_BUTTON" };
+static GpioEventLine button_line;
+static uint64_t press_timestamp = 0;
 
 static gboolean
 on_is_on(Button *btn,
@@ -33,47 +37,31 @@ on_button_press(Button *btn,
 	return TRUE;
 }
 
-static gboolean
-on_button_interrupt( GIOChannel *channel,
-		GIOCondition condition,
-		gpointer user_data )
+static void
+on_button_event(const GpioEvent* event, gpointer user_data)
 {
-	GError *error = 0;
-	gsize bytes_read = 0;
-	gchar buf[2];
-	buf[1] = '\0';
-	g_io_channel_seek_position( channel, 0, G_SEEK_SET, 0 );
-	g_io_channel_read_chars( channel,
-			buf, 1,
-			&bytes_read,
-			&error );
-	printf("%s\n",buf);
-
-	time_t current_time = time(NULL);
-	if(gpio_button.irq_inited)
+	Button* button = object_get_button((Object*)user_data);
+	if(event->value == 0)
 	{
-		Button* button = object_get_button((Object*)user_data);
-		if(buf[0] == '0')
-		{
-			printf("reset Button pressed\n");
-			button_emit_pressed(button);
-			button_set_timer(button,(long)current_time);
-		}
-		else
+		printf("reset Button pressed\n");
+		press_timestamp = event->timestamp;
+		button_emit_pressed(button);
+		button_set_timer(button,(long)time(NULL));
+	}
+	else if(press_timestamp != 0)
+	{
+		uint64_t press_ms = (event->timestamp - press_timestamp) / 1000000;
+		// a release is only measured against the press it ends
+		press_timestamp = 0;
+		printf("reset Button released, held for %llu ms\n",
+				(unsigned long long)press_ms);
+		if(press_ms > LONG_PRESS_MS)
 		{
-			long press_time = current_time-button_get_timer(button);
-			printf("reset Button released, held for %ld seconds\n",press_time);
-			if(press_time > LONG_PRESS_SECONDS)
-			{
-				button_emit_pressed_long(button);
-			} else {
-				button_emit_released(button);
-			}
+			button_emit_pressed_long(button);
+		} else {
+			button_emit_released(button);
 		}
 	}
-	else { gpio_button.irq_inited = true; }
-
-	return TRUE;
 }
 
 static void
@@ -114,7 +102,8 @@ on_bus_acquired(GDBusConnection *connection,
 	do {
 		rc = gpio_init(connection,&gpio_button);
 		if(rc != GPIO_OK) { break; }
-		rc = gpio_open_interrupt(&gpio_button,on_button_interrupt,object);
+		rc = gpio_event_open(&button_line,&gpio_button,DEBOUNCE_MS,0,
+				on_button_event,object);
 		if(rc != GPIO_OK) { break; }
 	} while(0);
 	if(rc != GPIO_OK)